@@ -0,0 +1,208 @@
+#include "AllocationTracker.h"
+#include <assert.h>
+#include <new>
+#include "bullet-2.81-rev2613\src\LinearMath\btAlignedAllocator.h"
+
+AllocationTracker::AllocCounters AllocationTracker::counters[ALLOC_SUBSYSTEM_COUNT];
+int AllocationTracker::frame = 0;
+int AllocationTracker::budget = 0;
+bool AllocationTracker::steady = true;
+int AllocationTracker::settleFrames = ALLOC_SETTLE_FRAMES;
+int AllocationTracker::framesOverBudget = 0;
+int AllocationTracker::worstFrame = 0;
+int AllocationTracker::worstAllocations = 0;
+int AllocationTracker::lastFrameAllocations = 0;
+double AllocationTracker::totalAllocations = 0.0;
+ofstream AllocationTracker::out;
+
+static const char* SUBSYSTEM_NAMES[ALLOC_SUBSYSTEM_COUNT] = { "Game", "Physics", "Rooms", "Render", "Audio" };
+
+//Each thread bills its own scope, and the tracker's own writes aren't counted
+static __declspec(thread) int currentSubsystem = ALLOC_GAME;
+static __declspec(thread) bool inTracker = false;
+
+#if TRACK_ALLOCATIONS
+void* operator new(size_t size)
+{
+	AllocationTracker::countAllocation(size, false);
+	void* memory = malloc(size > 0 ? size : 1);
+	if(memory == NULL)
+		throw std::bad_alloc();
+	return memory;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* memory)
+{
+	if(memory == NULL)
+		return;
+	AllocationTracker::countFree();
+	free(memory);
+}
+
+void operator delete[](void* memory)
+{
+	operator delete(memory);
+}
+#endif
+
+//Sends Bullet's allocations through the tracker, must run before the first Bullet object is made
+void AllocationTracker::install()
+{
+	btAlignedAllocSetCustom(bulletAlloc, bulletFree);
+}
+
+/* openReport()
+ *
+ * Starts saving each frame's allocations to fileName as csv, one row per subsystem that
+ * allocated anything that frame.
+ */
+bool AllocationTracker::openReport(string fileName)
+{
+	close();
+	inTracker = true;
+	out.open(fileName.c_str());
+	if(out.is_open())
+		out << "frame,subsystem,allocations,bytes,bullet allocations,bullet bytes,frees" << endl;
+	inTracker = false;
+	return out.is_open();
+}
+
+//Closes the report and writes a summary of every frame since the start to the debug output
+void AllocationTracker::close()
+{
+	inTracker = true;
+	if(frame > 0)
+	{
+		DBOUT("Allocations: " << frame << " frames, avg " << totalAllocations / frame << " a frame, worst " <<
+			worstAllocations << " in frame " << worstFrame << ", " << framesOverBudget << " frames over budget");
+	}
+	if(out.is_open())
+		out.close();
+	inTracker = false;
+}
+
+void AllocationTracker::setBudget(int maxAllocations)
+{
+	budget = maxAllocations;
+}
+
+void AllocationTracker::setSteadyState(bool isSteady)
+{
+	if(isSteady && !steady)
+		settleFrames = ALLOC_SETTLE_FRAMES;
+	steady = isSteady;
+}
+
+AllocSubsystem AllocationTracker::enter(AllocSubsystem subsystem)
+{
+	AllocSubsystem previous = (AllocSubsystem)currentSubsystem;
+	currentSubsystem = subsystem;
+	return previous;
+}
+
+void AllocationTracker::leave(AllocSubsystem previous)
+{
+	currentSubsystem = previous;
+}
+
+void AllocationTracker::countAllocation(size_t bytes, bool bullet)
+{
+	if(inTracker)
+		return;
+
+	int subsystem = currentSubsystem;
+	if(bullet)
+	{
+		//Only Bullet calls this, so unscoped ones came from a step or a world query
+		if(subsystem == ALLOC_GAME)
+			subsystem = ALLOC_PHYSICS;
+		InterlockedIncrement(&counters[subsystem].bulletAllocations);
+		InterlockedExchangeAdd(&counters[subsystem].bulletBytes, (LONG)bytes);
+	}
+	else
+	{
+		InterlockedIncrement(&counters[subsystem].allocations);
+		InterlockedExchangeAdd(&counters[subsystem].bytes, (LONG)bytes);
+	}
+}
+
+void AllocationTracker::countFree()
+{
+	if(!inTracker)
+		InterlockedIncrement(&counters[currentSubsystem].frees);
+}
+
+/* endFrame()
+ *
+ * Takes this frame's counts, writes them to the report, checks them against the budget
+ * and zeroes them for the next frame. The physics thread can still be stepping, whatever
+ * it allocates after this goes to the next frame.
+ */
+void AllocationTracker::endFrame()
+{
+	inTracker = true;
+
+	AllocCounters frameCounters[ALLOC_SUBSYSTEM_COUNT];
+	int allocations = 0;
+	for(int i = 0; i < ALLOC_SUBSYSTEM_COUNT; i++)
+	{
+		frameCounters[i].allocations = InterlockedExchange(&counters[i].allocations, 0);
+		frameCounters[i].bytes = InterlockedExchange(&counters[i].bytes, 0);
+		frameCounters[i].bulletAllocations = InterlockedExchange(&counters[i].bulletAllocations, 0);
+		frameCounters[i].bulletBytes = InterlockedExchange(&counters[i].bulletBytes, 0);
+		frameCounters[i].frees = InterlockedExchange(&counters[i].frees, 0);
+		allocations += frameCounters[i].allocations + frameCounters[i].bulletAllocations;
+
+		if(out.is_open() && (frameCounters[i].allocations > 0 || frameCounters[i].bulletAllocations > 0 || frameCounters[i].frees > 0))
+		{
+			out << frame << "," << SUBSYSTEM_NAMES[i] << "," << frameCounters[i].allocations << "," << frameCounters[i].bytes << "," <<
+				frameCounters[i].bulletAllocations << "," << frameCounters[i].bulletBytes << "," << frameCounters[i].frees << endl;
+		}
+	}
+
+	lastFrameAllocations = allocations;
+	totalAllocations += allocations;
+	if(allocations > worstAllocations)
+	{
+		worstAllocations = allocations;
+		worstFrame = frame;
+	}
+
+	//Loading a room allocates plenty, give the frames after it time to settle down too
+	if(frameCounters[ALLOC_ROOMS].allocations > 0 || frameCounters[ALLOC_ROOMS].bulletAllocations > 0)
+		settleFrames = ALLOC_SETTLE_FRAMES;
+	else if(settleFrames > 0)
+		settleFrames--;
+	else if(steady && budget > 0 && allocations > budget)
+	{
+		framesOverBudget++;
+		DBOUT("Frame " << frame << " made " << allocations << " allocations, the budget is " << budget);
+		for(int i = 0; i < ALLOC_SUBSYSTEM_COUNT; i++)
+		{
+			if(frameCounters[i].allocations > 0 || frameCounters[i].bulletAllocations > 0)
+				DBOUT("    " << SUBSYSTEM_NAMES[i] << ": " << frameCounters[i].allocations << " new, " << frameCounters[i].bulletAllocations << " Bullet");
+		}
+		assert(allocations <= budget && "Frame went over the allocation budget");
+	}
+
+	frame++;
+	inTracker = false;
+}
+
+void* AllocationTracker::bulletAlloc(size_t size)
+{
+	countAllocation(size, true);
+	return malloc(size);
+}
+
+void AllocationTracker::bulletFree(void* memblock)
+{
+	if(memblock != NULL)
+		countFree();
+	free(memblock);
+}
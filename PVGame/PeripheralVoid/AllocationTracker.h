@@ -0,0 +1,90 @@
+#pragma once
+
+#include <Windows.h>
+#include <fstream>
+#include <string>
+#include "Constants.h"
+
+using namespace std;
+
+//Allocation counting compiles away completely unless TRACK_ALLOCATIONS is on
+#if TRACK_ALLOCATIONS
+#define ALLOC_SCOPE(subsystem) AllocScope allocScope(subsystem)
+#define ALLOC_END_FRAME() AllocationTracker::endFrame()
+#else
+#define ALLOC_SCOPE(subsystem)
+#define ALLOC_END_FRAME()
+#endif
+
+enum AllocSubsystem { ALLOC_GAME, ALLOC_PHYSICS, ALLOC_ROOMS, ALLOC_RENDER, ALLOC_AUDIO, ALLOC_SUBSYSTEM_COUNT };
+
+/* AllocationTracker
+ *
+ * Counts every global new and every Bullet allocation along with their bytes, split by
+ * the subsystem that made them and by frame. Code inside ALLOC_SCOPE(subsystem) is billed
+ * to that subsystem, anything else to ALLOC_GAME, except that Bullet allocations made
+ * outside a scope go to ALLOC_PHYSICS. Each thread has its own scope.
+ *
+ * ALLOC_END_FRAME() closes the frame. With a report open every subsystem that allocated
+ * gets a csv row. With a budget set, a frame of steady play making more allocations than
+ * the budget is written to the debug output and, in debug builds, asserts. A frame that
+ * loads a room isn't steady, nor are the ALLOC_SETTLE_FRAMES after it.
+ */
+class AllocationTracker
+{
+	public:
+		static void install();
+		static bool openReport(string fileName);
+		static void close();
+
+		//0 turns the budget off
+		static void setBudget(int maxAllocations);
+
+		//False while in menus or anything else that isn't normal play
+		static void setSteadyState(bool steady);
+
+		static AllocSubsystem enter(AllocSubsystem subsystem);
+		static void leave(AllocSubsystem previous);
+		static void countAllocation(size_t bytes, bool bullet);
+		static void countFree();
+		static void endFrame();
+
+		//Allocations of every subsystem in the frame endFrame() last closed
+		static int getLastFrameAllocations() { return lastFrameAllocations; }
+
+	private:
+		struct AllocCounters
+		{
+			volatile LONG allocations;
+			volatile LONG bytes;
+			volatile LONG bulletAllocations;
+			volatile LONG bulletBytes;
+			volatile LONG frees;
+		};
+
+		static void* bulletAlloc(size_t size);
+		static void bulletFree(void* memblock);
+
+		static AllocCounters counters[ALLOC_SUBSYSTEM_COUNT];
+		static int frame;
+		static int budget;
+		static bool steady;
+		static int settleFrames;
+		static int framesOverBudget;
+		static int worstFrame;
+		static int worstAllocations;
+		static int lastFrameAllocations;
+		static double totalAllocations;
+		static ofstream out;
+};
+
+//Bills allocations to a subsystem for the rest of the scope, use ALLOC_SCOPE() rather than this
+class AllocScope
+{
+	public:
+		AllocScope(AllocSubsystem subsystem) { previous = AllocationTracker::enter(subsystem); }
+		~AllocScope() { AllocationTracker::leave(previous); }
+
+	private:
+		AllocSubsystem previous;
+};
@@ -0,0 +1,258 @@
+#include "AudioSource.h"
+#include "AudioListener.h"
+
+/* NullAudio
+ *
+ * Silent AudioSource and AudioListener for the headless build. Compiled in place of
+ * AudioSource.cpp and AudioListener.cpp so the game logic links without OpenAL.
+ * Positions are still tracked, nothing ever plays.
+ */
+
+AudioSource::AudioSource(void)
+{
+	position    = new float[3];
+	position[0] = 0;
+	position[1] = 0;
+	position[2] = 0;
+	data        = NULL;
+	channel     = 0;
+	sampleRate  = 0;
+	bps         = 0;
+	size        = 0;
+	sourceid    = 0;
+	bufferid    = 0;
+	format      = 0;
+	state       = 0;
+	initialized = false;
+}
+
+AudioSource::~AudioSource(void)
+{
+	delete[] position;
+}
+
+bool AudioSource::initialize(const char* fileName, FILE_TYPE type)
+{
+	initialized = true;
+	return true;
+}
+
+bool AudioSource::Initialized()
+{
+	return initialized;
+}
+
+bool AudioSource::isBigEndian()
+{
+	int a = 1;
+	return !((char*)&a)[0];
+}
+
+int AudioSource::convertToInt(char* buffer,int len)
+{
+	return 0;
+}
+
+char* AudioSource::loadWAV(const char* fn,int& chan,int& samplerate,int& bps,int& size)
+{
+	return NULL;
+}
+
+bool AudioSource::is3D()
+{
+	return true;
+}
+
+void AudioSource::setPosition(float x, float y, float z)
+{
+	position[0] = x;
+	position[1] = y;
+	position[2] = z;
+}
+
+void AudioSource::setPosition(float* newPosition)
+{
+	setPosition(newPosition[0], newPosition[1], newPosition[2]);
+}
+
+void AudioSource::move(float x, float y, float z)
+{
+	setPosition(position[0] + x, position[1] + y, position[2] + z);
+}
+
+void AudioSource::move(float* amount)
+{
+	move(amount[0], amount[1], amount[2]);
+}
+
+float* AudioSource::getPosition()
+{
+	return position;
+}
+
+float AudioSource::getX()
+{
+	return position[0];
+}
+
+float AudioSource::getY()
+{
+	return position[1];
+}
+
+float AudioSource::getZ()
+{
+	return position[2];
+}
+
+void AudioSource::play() {}
+
+void AudioSource::playAt(float x, float y, float z)
+{
+	setPosition(x, y, z);
+}
+
+void AudioSource::playAt(float* position)
+{
+	setPosition(position);
+}
+
+void AudioSource::playAtAndMoveTo(float x, float y, float z)
+{
+	setPosition(x, y, z);
+}
+
+void AudioSource::playAtAndMoveTo(float* position)
+{
+	setPosition(position);
+}
+
+void AudioSource::setLooping(bool looping) {}
+void AudioSource::stop() {}
+void AudioSource::pause() {}
+void AudioSource::resume() {}
+void AudioSource::restart() {}
+void AudioSource::restartAndPlay() {}
+
+bool AudioSource::isPlaying()
+{
+	return false;
+}
+
+unsigned int AudioSource::getSourceID()
+{
+	return sourceid;
+}
+
+AudioListener::AudioListener(void)
+{
+	position = new float[3];
+	orientation = new float[6];
+	for(int i = 0; i < 3; i++)
+		position[i] = 0;
+	for(int i = 0; i < 6; i++)
+		orientation[i] = 0;
+	gain = 1.0f;
+}
+
+AudioListener::~AudioListener(void)
+{
+	delete[] position;
+	delete[] orientation;
+}
+
+void AudioListener::setPosition(float x, float y, float z)
+{
+	position[0] = x;
+	position[1] = y;
+	position[2] = z;
+}
+
+void AudioListener::setPosition(float* newPosition)
+{
+	setPosition(newPosition[0], newPosition[1], newPosition[2]);
+}
+
+float* AudioListener::getPosition()
+{
+	return position;
+}
+
+float AudioListener::getX()
+{
+	return position[0];
+}
+
+float AudioListener::getY()
+{
+	return position[1];
+}
+
+float AudioListener::getZ()
+{
+	return position[2];
+}
+
+void AudioListener::move(float x, float y, float z)
+{
+	setPosition(position[0] + x, position[1] + y, position[2] + z);
+}
+
+void AudioListener::move(float* amount)
+{
+	move(amount[0], amount[1], amount[2]);
+}
+
+void AudioListener::setForward(float x, float y, float z)
+{
+	orientation[0] = x;
+	orientation[1] = y;
+	orientation[2] = z;
+}
+
+void AudioListener::setForward(float* fwd)
+{
+	setForward(fwd[0], fwd[1], fwd[2]);
+}
+
+void AudioListener::setUp(float x, float y, float z)
+{
+	orientation[3] = x;
+	orientation[4] = y;
+	orientation[5] = z;
+}
+
+void AudioListener::setUp(float* up)
+{
+	setUp(up[0], up[1], up[2]);
+}
+
+void AudioListener::setOrientation(float fX, float fY, float fZ, float uX, float uY, float uZ)
+{
+	setForward(fX, fY, fZ);
+	setUp(uX, uY, uZ);
+}
+
+void AudioListener::setOrientation(float* newOrientation)
+{
+	setOrientation(newOrientation[0], newOrientation[1], newOrientation[2],
+		newOrientation[3], newOrientation[4], newOrientation[5]);
+}
+
+float* AudioListener::getOrientation()
+{
+	return orientation;
+}
+
+void AudioListener::mute() {}
+void AudioListener::unmute() {}
+
+bool AudioListener::isMuted()
+{
+	return false;
+}
+
+void AudioListener::setGain(float ngain)
+{
+	gain = ngain;
+}
@@ -0,0 +1,33 @@
+#include "CacheDirectory.h"
+
+// Worked out before main(), so the loader thread never races to fill it in
+const string CacheDirectory::path = CacheDirectory::findPath();
+
+//%LOCALAPPDATA%\PeripheralVoid\Cache\, or the temp directory if there is no app data
+string CacheDirectory::findPath(void)
+{
+	char buffer[MAX_PATH];
+	DWORD length = GetEnvironmentVariableA("LOCALAPPDATA", buffer, MAX_PATH);
+	if(length == 0 || length >= MAX_PATH)
+		length = GetTempPathA(MAX_PATH, buffer);
+
+	string root(buffer, length);
+	if(!root.empty() && root[root.size() - 1] != '\\')
+		root += '\\';
+	return root + "PeripheralVoid\\Cache\\";
+}
+
+string CacheDirectory::fileFor(const string& sourceFile, const char* extension)
+{
+	return path + sourceFile.substr(sourceFile.find_last_of("/\\") + 1) + extension;
+}
+
+bool CacheDirectory::create(void)
+{
+	// One level at a time since CreateDirectory won't make the parent, it just fails for the ones already there
+	for(size_t slash = path.find('\\'); slash != string::npos; slash = path.find('\\', slash + 1))
+		CreateDirectoryA(path.substr(0, slash).c_str(), NULL);
+
+	DWORD attributes = GetFileAttributesA(path.c_str());
+	return attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY);
+}
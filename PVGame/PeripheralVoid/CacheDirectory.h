@@ -0,0 +1,28 @@
+#pragma once
+
+#include <Windows.h>
+#include <string>
+
+using namespace std;
+
+/* CacheDirectory
+ *
+ * Where the game keeps files it builds for itself at runtime, under the user's local app
+ * data so nothing is written next to an install that may be read only. Everything in it can
+ * be rebuilt, so a write that fails only means building the same file again next time.
+ */
+class CacheDirectory
+{
+	public:
+		//Path of the file built from sourceFile, say Assets/level1.xml gets <cache>\level1.xml.phys
+		static string fileFor(const string& sourceFile, const char* extension);
+
+		//Makes the directory if it isn't there, returns false if it couldn't be
+		static bool create(void);
+
+		static const string& getPath(void) { return path; }
+
+	private:
+		static const string path;
+		static string findPath(void);
+};
@@ -3,6 +3,8 @@
 //***************************************************************************************
 
 #include "Camera.h"
+#include "../FrustumCuller.h"
+#include "../Profiler.h"
 
 Camera::Camera(PhysicsManager* pM, RiftManager* rm, float aspect)
 	: mPosition(0.0f, 0.0f, 0.0f), 
@@ -19,7 +21,7 @@ Camera::Camera(PhysicsManager* pM, RiftManager* rm, float aspect)
 
 Camera::~Camera()
 {
-#if USE_FRUSTUM_CULLING
+#if USE_FRUSTUM_CULLING && !USE_PLANE_CULLING
 		physicsMan->removeGhostObjectFromWorld(body);
 #endif
 }
@@ -141,7 +143,7 @@ void Camera::SetLens(float fovY, float aspect, float zn, float zf)
 	XMMATRIX P = XMMatrixPerspectiveFovLH(mFovY, mAspect, mNearZ, mFarZ);
 	XMStoreFloat4x4(&mProj, P);
 
-#if USE_FRUSTUM_CULLING
+#if USE_FRUSTUM_CULLING && !USE_PLANE_CULLING
 	float mNearWindowWidth = 2.0f * mNearZ * tanf( 0.5f*mAspect );
 	float mFarWindowWidth  = 2.0f * mFarZ  * tanf( 0.5f*mAspect );
 	float nearHeight = mNearWindowHeight/2;
@@ -462,7 +464,7 @@ void Camera::UpdateViewMatrix()
 
 void Camera::transformBody()
 {
-#if USE_FRUSTUM_CULLING
+#if USE_FRUSTUM_CULLING && !USE_PLANE_CULLING
 	btTransform t = body->getWorldTransform();
 	t.setOrigin(btVector3(mPosition.x, mPosition.y, mPosition.z));
 
@@ -493,7 +495,13 @@ void Camera::transformBody()
 #endif
 }
 
-void Camera::frustumCull()
+//Marks what the camera can see, either with the plane culler or the ghost object in the physics world
+void Camera::frustumCull(FrustumCuller* culler)
 {
+	PROFILE("Frustum Cull");
+#if USE_PLANE_CULLING
+	culler->cull(ViewProj());
+#else
 	physicsMan->frustumCulling(body);
+#endif
 }
\ No newline at end of file
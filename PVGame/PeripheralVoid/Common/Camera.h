@@ -19,6 +19,7 @@
 
 class PhysicsManager;
 class GameObject;
+class FrustumCuller;
 
 class Camera
 {
@@ -78,7 +79,7 @@ public:
 	// After modifying camera position/orientation, call to rebuild the view matrix.
 	void UpdateViewMatrix();
 
-	void frustumCull();
+	void frustumCull(FrustumCuller* culler);
 	btPairCachingGhostObject* getBody();
 	
 	GameObject* frustumBody;
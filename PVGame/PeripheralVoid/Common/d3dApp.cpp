@@ -29,7 +29,8 @@ D3DApp::D3DApp(HINSTANCE hInstance)
 	mAppPaused(false),
 	mMinimized(false),
 	mMaximized(false),
-	mResizing(false)
+	mResizing(false),
+	inputRecorder(NULL)
 {
 	renderMan = &RenderManager::getInstance();
 	renderMan->SetClientSize(1280, 800);
@@ -42,7 +43,10 @@ D3DApp::D3DApp(HINSTANCE hInstance)
 
 D3DApp::~D3DApp()
 {
+	delete inputRecorder;
 	delete input;
+	Profiler::close();
+	AllocationTracker::close();
 }
 
 HINSTANCE D3DApp::AppInst()const
@@ -90,11 +94,33 @@ int D3DApp::Run()
 			{
 				CalculateFrameStats();
 
+				//Save this frame's input, or swap in the recorded one
+				float dt = mTimer.DeltaTime();
+				if(inputRecorder != NULL && !inputRecorder->update(input, dt))
+				{
+					//The replay ran out
+					PostMessage(mhMainWnd, WM_CLOSE, 0, 0);
+					continue;
+				}
+
+				LARGE_INTEGER frameStart;
+				QueryPerformanceCounter(&frameStart);
+
 				//Update
-				UpdateScene(mTimer.DeltaTime());
+				UpdateScene(dt);
 				
 				//Draw
 				DrawScene();
+				PROFILE_END_FRAME();
+				ALLOC_END_FRAME();
+
+				if(inputRecorder != NULL && inputRecorder->isReplaying())
+				{
+					LARGE_INTEGER frameEnd, frequency;
+					QueryPerformanceCounter(&frameEnd);
+					QueryPerformanceFrequency(&frequency);
+					inputRecorder->addFrameTime((double)(frameEnd.QuadPart - frameStart.QuadPart) * 1000.0 / (double)frequency.QuadPart);
+				}
 
 				//Maybe put in something for locking the frame rate later on
 
@@ -20,6 +20,7 @@
 #include <memory>
 #include "../PhysicsManager.h"
 #include "../Input.h"
+#include "../InputRecorder.h"
 #include "../RenderManager.h"
 
 class D3DApp
@@ -72,6 +73,7 @@ protected:
 	std::string curRoomStr;
 
 	Input* input;
+	InputRecorder* inputRecorder; //NULL unless recording or replaying
 	RenderManager* renderMan;
 };
 
@@ -17,8 +17,20 @@ using std::string;
 #define DEV_MODE 0
 #define WALL_LOWERED 1
 #define USE_FRUSTUM_CULLING 1
-#define DRAW_FRUSTUM 0 //Only Make 1 if USE_FRUSTUM_CULLING is 1
+#define USE_PLANE_CULLING 1 //Cull against the camera's frustum planes instead of a ghost object in the physics world
+#define DRAW_FRUSTUM 0 //Only Make 1 if USE_FRUSTUM_CULLING is 1 and USE_PLANE_CULLING is 0
 #define FINE_PHASE 0
+#define USE_PHYSICS_THREAD 0 //Step the physics world on its own thread while the scene is drawn
+#define USE_PARALLEL_PHYSICS 0 //Use Bullet's multithreaded dispatcher and solver, needs the BulletMultiThreaded lib
+#define MERGE_STATIC_GEOMETRY 1 //Give each room one static triangle mesh body for its walls and floors instead of a body per segment
+#define CACHE_ROOM_PHYSICS 1 //Save each room's merged mesh to the CacheDirectory and load it from there next time, needs MERGE_STATIC_GEOMETRY
+#define CACHE_LEVELS 1 //Load levels from binary copies in Assets/Cache or the CacheDirectory, compiling any that are missing or older than their xml
+#define STREAM_ROOMS 1 //Keep only the rooms near the current one loaded, loading them on a loader thread and adding them a batch a frame
+#ifndef HEADLESS
+#define HEADLESS 0 //Set to 1 by the PeripheralVoidHeadless project, which builds the game logic without Direct3D or OpenAL
+#endif
+#define USE_PROFILER 0 //Time the PROFILE zones every frame, -profile file.csv or file.json saves them
+#define TRACK_ALLOCATIONS 0 //Count every new and Bullet allocation per frame and subsystem, -allocreport file.csv saves them
 #define MOBILITY_MULTIPLIER 0.75f
 
 #define USINGVLD 0
@@ -34,6 +46,18 @@ const enum CREST_TYPE { MEDUSA, MOBILITY, LEAP, UNLOCK, HADES, WIN, HEPHAESTUS};
 const enum TURRET_TYPE { ALPHA, BETA, GAMMA };
 
 const float TARGET_FPS = 1000.0f/60.0f; //in milliseconds
+const float PHYSICS_STEP_RATE = 60.0f;  //Fixed physics steps per second
+const int PHYSICS_MAX_SUBSTEPS = 5;     //Most catch up steps in one frame, time past that is dropped
+const int PHYSICS_WORKER_COUNT = 4;     //Threads for the parallel dispatcher and solver, 1 means sequential
+const int PHYSICS_POOL_CHUNK = 256;     //Bodies, motion states or shapes added at a time when a physics pool runs out
+const float VISIBILITY_CAMERA_THRESHOLD = 0.05f; //How far the camera can move before cached crest visibility is checked again
+const int HULL_VERTEX_BUDGET = 32;      //Most points a collision hull cooked from a model keeps, 0 keeps the triangle mesh hull
+const float HULL_MARGIN = 0.04f;       //Collision margin of cooked hulls, the hull is shrunk by this much first so it doesn't grow
+const int ALLOC_FRAME_BUDGET = 64;     //Most allocations a frame of normal play should make, -allocassert stops on frames over it
+const int ALLOC_SETTLE_FRAMES = 120;   //Frames after a room load before the allocation budget applies again
+const int ROOM_STREAM_BATCH = 48;      //Most objects of a streamed room added to the world in one frame
+const int ROOM_STREAM_DEPTH = 2;       //Rooms more exits than this away from the current one are unloaded
+const int INSTANCE_MIN_CAPACITY = 16;  //Slots a mesh's instance data starts with, it doubles each time it fills up
 
 const float GAME_SCALE = 0.5f;
 
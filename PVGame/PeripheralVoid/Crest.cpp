@@ -1,4 +1,5 @@
 #include "Crest.h"
+#include "Profiler.h"
 
 Crest::Crest(void)
 {
@@ -53,6 +54,7 @@ void Crest::SetLightIndex(int newLightIndex)
 
 void Crest::ChangeView(bool newVisionBool)
 {
+	PROFILE("Crest View");
 	if(newVisionBool && !inVision)
 	{
 		if(!audioSource->isPlaying() && crestType != WIN)
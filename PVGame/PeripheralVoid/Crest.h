@@ -1,6 +1,10 @@
 #pragma once
 #include "GameObject.h"
+#if HEADLESS
+#include "Player.h"
+#else
 #include "PVGame.h"
+#endif
 #include "MovingObject.h"
 
 class MovingObject;
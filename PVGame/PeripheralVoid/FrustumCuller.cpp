@@ -0,0 +1,235 @@
+#include "FrustumCuller.h"
+#include <algorithm>
+
+using namespace XNA;
+
+//Most items a leaf holds before it gets split
+#define CULL_LEAF_SIZE 4
+
+//Deepest the hierarchy can get, median splits keep it near log2 of the item count
+#define CULL_STACK_SIZE 64
+
+//Orders items by the center of their box along one axis
+struct CullItemComparer
+{
+	int axis;
+
+	CullItemComparer(int anAxis) : axis(anAxis) {}
+
+	inline bool operator() (const CullItem& itemA, const CullItem& itemB)
+	{
+		const float* minA = &itemA.min.x;
+		const float* maxA = &itemA.max.x;
+		const float* minB = &itemB.min.x;
+		const float* maxB = &itemB.max.x;
+		return (minA[axis] + maxA[axis]) < (minB[axis] + maxB[axis]);
+	}
+};
+
+FrustumCuller::FrustumCuller(void)
+{
+}
+
+FrustumCuller::~FrustumCuller(void)
+{
+}
+
+/* build()
+ *
+ * Rebuilds the hierarchy from the current game objects. Call it whenever objects are added
+ * or removed, the culler keeps pointers to them. Only objects on the vision affected layer
+ * are culled, everything else is always seen.
+ *
+ * param: gameObjects - every object in the loaded rooms
+ */
+void FrustumCuller::build(const vector<GameObject*>& gameObjects)
+{
+	staticItems.clear();
+	nodes.clear();
+	dynamicObjects.clear();
+
+	for(unsigned int i = 0; i < gameObjects.size(); i++)
+	{
+		btRigidBody* body = gameObjects[i]->getRigidBody();
+		if(body == NULL || !(gameObjects[i]->getCollisionLayer() & COL_VISION_AFFECTED))
+			continue;
+
+		if(!body->isStaticObject())
+		{
+			dynamicObjects.push_back(gameObjects[i]);
+			continue;
+		}
+
+		btVector3 min, max;
+		body->getCollisionShape()->getAabb(body->getWorldTransform(), min, max);
+
+		CullItem item;
+		item.object = gameObjects[i];
+		item.min = XMFLOAT3(min.getX(), min.getY(), min.getZ());
+		item.max = XMFLOAT3(max.getX(), max.getY(), max.getZ());
+		staticItems.push_back(item);
+	}
+
+	if(!staticItems.empty())
+	{
+		nodes.reserve(staticItems.size() * 2 / CULL_LEAF_SIZE + 1);
+		buildNode(0, staticItems.size());
+	}
+}
+
+/* add()
+ *
+ * Adds one object spawned since the last build() without rebuilding the hierarchy. Only
+ * objects that can move are taken this way, the hierarchy is built around the static ones.
+ *
+ * param: gameObject - the object that was just added to the game objects
+ * returns: false if gameObject is static and needs a build() to be culled
+ */
+bool FrustumCuller::add(GameObject* gameObject)
+{
+	btRigidBody* body = gameObject->getRigidBody();
+	if(body == NULL || !(gameObject->getCollisionLayer() & COL_VISION_AFFECTED))
+		return true;
+	if(body->isStaticObject())
+		return false;
+
+	dynamicObjects.push_back(gameObject);
+	return true;
+}
+
+//Builds the node covering staticItems[first, first + count) and returns its index
+int FrustumCuller::buildNode(int first, int count)
+{
+	XMFLOAT3 min = staticItems[first].min;
+	XMFLOAT3 max = staticItems[first].max;
+	for(int i = first + 1; i < first + count; i++)
+	{
+		min = XMFLOAT3(btMin(min.x, staticItems[i].min.x), btMin(min.y, staticItems[i].min.y), btMin(min.z, staticItems[i].min.z));
+		max = XMFLOAT3(btMax(max.x, staticItems[i].max.x), btMax(max.y, staticItems[i].max.y), btMax(max.z, staticItems[i].max.z));
+	}
+
+	int index = nodes.size();
+	CullNode node;
+	node.center = XMFLOAT3((min.x + max.x) * 0.5f, (min.y + max.y) * 0.5f, (min.z + max.z) * 0.5f);
+	node.extents = XMFLOAT3((max.x - min.x) * 0.5f, (max.y - min.y) * 0.5f, (max.z - min.z) * 0.5f);
+	node.first = first;
+	node.count = count;
+	node.left = -1;
+	node.right = -1;
+	nodes.push_back(node);
+
+	if(count <= CULL_LEAF_SIZE)
+		return index;
+
+	//Split at the median along the longest side
+	int axis = 0;
+	if(node.extents.y > node.extents.x)
+		axis = 1;
+	if(node.extents.z > (axis == 0 ? node.extents.x : node.extents.y))
+		axis = 2;
+
+	int half = count / 2;
+	nth_element(staticItems.begin() + first, staticItems.begin() + first + half, staticItems.begin() + first + count, CullItemComparer(axis));
+
+	//The vector can grow while building children, so don't hold a reference into it
+	int left = buildNode(first, half);
+	int right = buildNode(first + half, count - half);
+	nodes[index].left = left;
+	nodes[index].right = right;
+	return index;
+}
+
+/* cull()
+ *
+ * Marks every culled object inside the view frustum as seen. Objects that aren't marked
+ * stop counting as seen on their own at the next physics update.
+ *
+ * param: viewProj - the camera's view * projection matrix
+ */
+void FrustumCuller::cull(CXMMATRIX viewProj)
+{
+	//Pull the planes out of the columns of the matrix. XNA wants them facing out of the frustum.
+	XMMATRIX columns = XMMatrixTranspose(viewProj);
+	XMVECTOR leftPlane   = XMPlaneNormalize(XMVectorNegate(XMVectorAdd(columns.r[3], columns.r[0])));
+	XMVECTOR rightPlane  = XMPlaneNormalize(XMVectorSubtract(columns.r[0], columns.r[3]));
+	XMVECTOR bottomPlane = XMPlaneNormalize(XMVectorNegate(XMVectorAdd(columns.r[3], columns.r[1])));
+	XMVECTOR topPlane    = XMPlaneNormalize(XMVectorSubtract(columns.r[1], columns.r[3]));
+	XMVECTOR nearPlane   = XMPlaneNormalize(XMVectorNegate(columns.r[2]));
+	XMVECTOR farPlane    = XMPlaneNormalize(XMVectorSubtract(columns.r[2], columns.r[3]));
+
+	AxisAlignedBox box;
+	if(!nodes.empty())
+	{
+		int stack[CULL_STACK_SIZE];
+		int stackSize = 0;
+		stack[stackSize++] = 0;
+
+		while(stackSize > 0)
+		{
+			const CullNode& node = nodes[stack[--stackSize]];
+			box.Center = node.center;
+			box.Extents = node.extents;
+
+			int result = IntersectAxisAlignedBox6Planes(&box, leftPlane, rightPlane, bottomPlane, topPlane, nearPlane, farPlane);
+			if(result == 0)
+				continue;
+
+			//Everything under a node fully inside is seen without testing it
+			if(result == 2)
+			{
+				markSeen(node.first, node.count);
+			}
+			else if(node.left == -1)
+			{
+				for(int i = node.first; i < node.first + node.count; i++)
+				{
+					const CullItem& item = staticItems[i];
+					box.Center = XMFLOAT3((item.min.x + item.max.x) * 0.5f, (item.min.y + item.max.y) * 0.5f, (item.min.z + item.max.z) * 0.5f);
+					box.Extents = XMFLOAT3((item.max.x - item.min.x) * 0.5f, (item.max.y - item.min.y) * 0.5f, (item.max.z - item.min.z) * 0.5f);
+					if(IntersectAxisAlignedBox6Planes(&box, leftPlane, rightPlane, bottomPlane, topPlane, nearPlane, farPlane) != 0)
+						item.object->setSeen(true);
+				}
+			}
+			else
+			{
+				stack[stackSize++] = node.left;
+				stack[stackSize++] = node.right;
+			}
+		}
+	}
+
+	for(unsigned int i = 0; i < dynamicObjects.size(); i++)
+	{
+		btRigidBody* body = dynamicObjects[i]->getRigidBody();
+		btVector3 min, max;
+		body->getCollisionShape()->getAabb(body->getWorldTransform(), min, max);
+
+		btVector3 center = (min + max) * 0.5f;
+		btVector3 extents = (max - min) * 0.5f;
+		box.Center = XMFLOAT3(center.getX(), center.getY(), center.getZ());
+		box.Extents = XMFLOAT3(extents.getX(), extents.getY(), extents.getZ());
+		if(IntersectAxisAlignedBox6Planes(&box, leftPlane, rightPlane, bottomPlane, topPlane, nearPlane, farPlane) != 0)
+			dynamicObjects[i]->setSeen(true);
+	}
+}
+
+void FrustumCuller::markSeen(int first, int count)
+{
+	for(int i = first; i < first + count; i++)
+		staticItems[i].object->setSeen(true);
+}
+
+int FrustumCuller::getNodeCount()
+{
+	return nodes.size();
+}
+
+int FrustumCuller::getStaticCount()
+{
+	return staticItems.size();
+}
+
+int FrustumCuller::getDynamicCount()
+{
+	return dynamicObjects.size();
+}
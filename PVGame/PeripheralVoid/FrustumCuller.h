@@ -0,0 +1,56 @@
+#pragma once
+
+#include "GameObject.h"
+#include "Common\xnacollision.h"
+
+class GameObject;
+
+//One culled object and the world space box it was built with
+struct CullItem
+{
+	GameObject* object;
+	XMFLOAT3 min;
+	XMFLOAT3 max;
+};
+
+//A node of the bounding volume hierarchy. Every node covers a contiguous run of the item list,
+//leaves have no children.
+struct CullNode
+{
+	XMFLOAT3 center;
+	XMFLOAT3 extents;
+	int first;
+	int count;
+	int left;  //-1 for leaves
+	int right;
+};
+
+/* FrustumCuller
+ *
+ * Decides which vision affected objects the camera can see by testing their bounds against
+ * the six planes of the view frustum. Static objects are kept in a bounding volume hierarchy
+ * so whole chunks of the loaded rooms are accepted or rejected with one test. Objects that
+ * can move are few, so they are tested one by one against where they are right now.
+ */
+class FrustumCuller
+{
+	public:
+		FrustumCuller(void);
+		~FrustumCuller(void);
+
+		void build(const vector<GameObject*>& gameObjects);
+		bool add(GameObject* gameObject);
+		void cull(CXMMATRIX viewProj);
+
+		int getNodeCount();
+		int getStaticCount();
+		int getDynamicCount();
+
+	private:
+		vector<CullItem> staticItems;      //Reordered while building so each node's items sit together
+		vector<CullNode> nodes;            //nodes[0] is the root
+		vector<GameObject*> dynamicObjects;
+
+		int buildNode(int first, int count);
+		void markSeen(int first, int count);
+};
@@ -3,8 +3,12 @@
 //Default Constructor
 GameObject::GameObject(void)
 {
-	meshKey = "None";
+	meshHandle = HandleTable::meshes.getHandle("None");
+	materialHandle = HandleTable::materials.getHandle("");
 	rigidBody = NULL;
+	physicsMan = NULL;
+	seenFrame = 0;
+	instanceSlot = -1;
 	audioSource = new AudioSource();
 	visionAffected = false;
 	collisionLayer = 0;
@@ -19,14 +23,16 @@ GameObject::GameObject(void)
 GameObject::GameObject(string aMeshKey, string aMaterialKey, XMMATRIX* aWorldMatrix, PhysicsManager* physicsMan, bool visionAff)
 {
 	visionAffected = visionAff;
-	meshKey = aMeshKey;
-	materialKey = aMaterialKey;
+	meshHandle = HandleTable::meshes.getHandle(aMeshKey);
+	materialHandle = HandleTable::materials.getHandle(aMaterialKey);
 	XMStoreFloat4x4(&worldMatrix, *aWorldMatrix);
 	rigidBody = NULL;
+	seenFrame = 0;
+	instanceSlot = -1;
 	localScale = XMFLOAT3(1.0,1.0,1.0);
 	this->physicsMan = physicsMan;
 	mass = 0.0;
-	//this->collisionLayer = ObjectType::WORLD;
+	collisionLayer = COL_NOTHING; //Nothing to collide with without a rigid body
 	audioSource = new AudioSource();
 	if(USE_FRUSTUM_CULLING && (collisionLayer & COL_VISION_AFFECTED))
 		seen = false;
@@ -38,12 +44,14 @@ GameObject::GameObject(string aMeshKey, string aMaterialKey, XMMATRIX* aWorldMat
 GameObject::GameObject(string aMeshKey, string aMaterialKey, btRigidBody* rB, PhysicsManager* physicsMan, short collisionLayer, float mass, bool visionAff)
 {
 	visionAffected = visionAff;
-	meshKey = aMeshKey;
-	materialKey = aMaterialKey;
+	meshHandle = HandleTable::meshes.getHandle(aMeshKey);
+	materialHandle = HandleTable::materials.getHandle(aMaterialKey);
 	XMStoreFloat4x4(&worldMatrix, XMMatrixIdentity());
 	rigidBody = rB;
-	btVector3 s = rigidBody->getCollisionShape()->getLocalScaling();
-	localScale = XMFLOAT3(1.0,1.0,1.0);
+	seenFrame = 0;
+	instanceSlot = -1;
+	btVector3 s = physicsMan->getShapeScale(rigidBody->getCollisionShape()); //Bodies can be created at their final size
+	localScale = XMFLOAT3(s.getX(), s.getY(), s.getZ());
 	this->physicsMan = physicsMan;
 	physicsMan->addRigidBodyToWorld(rigidBody, collisionLayer);
 	rigidBody->setUserPointer(this);
@@ -60,10 +68,16 @@ GameObject::GameObject(string aMeshKey, string aMaterialKey, btRigidBody* rB, Ph
 void GameObject::setSeen(bool s)
 {
 	seen = s;
+	if(physicsMan != NULL)
+		seenFrame = physicsMan->getUpdateFrame();
 }
 
+//Culled objects only count as seen if the frustum touched them since the last physics update,
+//so they don't need resetting every frame
 bool GameObject::isSeen()
 {
+	if(USE_FRUSTUM_CULLING && rigidBody != NULL && (collisionLayer & COL_VISION_AFFECTED))
+		return seen && seenFrame == physicsMan->getUpdateFrame();
 	return seen;
 }
 
@@ -91,20 +105,14 @@ void GameObject::translate(float x, float y, float z)
 	}
 }
 
-//BROKEN AS ALL HELL. I HATE EVERYTHING
+//Rescales the GameObject. The rigid body stays in the world, only its shape is swapped or rescaled.
+//If the final size is known up front, pass it to createRigidBody instead.
 void GameObject::scale(float x, float y, float z)
 {
 	if(rigidBody != NULL)
 	{
 		localScale = XMFLOAT3(x, y, z);
-		btTransform t;
-		rigidBody->getMotionState()->getWorldTransform(t);
-		btVector3 position = t.getOrigin();
-
-		physicsMan->removeRigidBodyFromWorld(rigidBody);
-		rigidBody = physicsMan->createRigidBody(meshKey, position.getX(), position.getY(), position.getZ(), x, y, z, mass);
-		rigidBody->setUserPointer(this);
-		physicsMan->addRigidBodyToWorld(rigidBody, collisionLayer);
+		physicsMan->scaleRigidBody(rigidBody, x, y, z, mass);
 		CalculateWorldMatrix();
 	}
 }
@@ -148,13 +156,13 @@ void GameObject::setLinearVelocity(float x, float y, float z)
 	rigidBody->setLinearVelocity(btVector3(x, y, z));
 }
 
-void GameObject::SetMeshKey(string aKey) { meshKey = aKey; }
-void GameObject::SetMaterialKey(string aKey) { materialKey = aKey; }
+void GameObject::SetMeshKey(string aKey) { meshHandle = HandleTable::meshes.getHandle(aKey); }
+void GameObject::SetMaterialKey(string aKey) { materialHandle = HandleTable::materials.getHandle(aKey); }
 void GameObject::SetWorldMatrix(XMMATRIX* aMatrix) { XMStoreFloat4x4(&worldMatrix, *aMatrix); }
 
 bool GameObject::GetVisionAffected() { return visionAffected; }
-string GameObject::GetMeshKey() const { return meshKey; }
-string GameObject::GetMaterialKey() const { return materialKey; }
+const string& GameObject::GetMeshKey() const { return HandleTable::meshes.getKey(meshHandle); }
+const string& GameObject::GetMaterialKey() const { return HandleTable::materials.getKey(materialHandle); }
 btRigidBody* GameObject::getRigidBody() const { return rigidBody; }
 
 void GameObject::SetRigidBody(btRigidBody* rBody, short layer)
@@ -181,7 +189,7 @@ void GameObject::changeCollisionLayer(short layer)
 		btVector3 position = t.getOrigin();
 
 		physicsMan->removeRigidBodyFromWorld(rigidBody);
-		rigidBody = physicsMan->createRigidBody(meshKey, position.getX(), position.getY(), position.getZ(), localScale.x, localScale.y, localScale.z, mass);
+		rigidBody = physicsMan->createRigidBody(GetMeshKey(), position.getX(), position.getY(), position.getZ(), localScale.x, localScale.y, localScale.z, mass);
 		rigidBody->setUserPointer(this);
 		physicsMan->addRigidBodyToWorld(rigidBody, layer);
 	}
@@ -192,10 +200,6 @@ void GameObject::Update()
 {
 	if(rigidBody != NULL)
 	{
-		if(USE_FRUSTUM_CULLING && (collisionLayer & COL_VISION_AFFECTED))
-		{
-			seen = false;
-		}
 		CalculateWorldMatrix();
 		rigidBody->setUserPointer(this);
 	}
@@ -206,7 +210,7 @@ void GameObject::CalculateWorldMatrix()
 {
 	btTransform t;
 	rigidBody->getMotionState()->getWorldTransform(t);
-	btScalar* mat = new btScalar[16];
+	btScalar mat[16];
 	t.getOpenGLMatrix(mat);
 		
 	worldMatrix = XMFLOAT4X4(mat[0 ] * localScale.x, mat[1 ]                , mat[2 ]               , mat[3 ],    //NOT Transposed Matrix  
@@ -215,7 +219,6 @@ void GameObject::CalculateWorldMatrix()
 							    mat[12]               , mat[13]                , mat[14]               , mat[15]);
 
 	audioSource->setPosition(t.getOrigin().getX(),t.getOrigin().getY(), t.getOrigin().getZ()); //THIS IS AWEFULL 
-	delete[] mat;
 }
 
 /* GetWorldMatrix()
@@ -286,3 +289,18 @@ GameObject::~GameObject(void)
 	if (audioSource)
 		delete audioSource;
 }
+
+void SortByMesh(vector<GameObject*>& objects)
+{
+	//Where each handle's run of objects starts, found from how many objects have each handle
+	vector<unsigned int> starts(HandleTable::meshes.getCount() + 1, 0);
+	for(unsigned int i = 0; i < objects.size(); i++)
+		starts[objects[i]->GetMeshHandle() + 1]++;
+	for(unsigned int i = 1; i < starts.size(); i++)
+		starts[i] += starts[i - 1];
+
+	vector<GameObject*> sorted(objects.size());
+	for(unsigned int i = 0; i < objects.size(); i++)
+		sorted[starts[objects[i]->GetMeshHandle()]++] = objects[i];
+	objects.swap(sorted);
+}
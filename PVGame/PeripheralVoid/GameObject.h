@@ -2,6 +2,7 @@
 #include "Constants.h"
 #include "Audio\AudioSource.h"
 #include "PhysicsManager.h"
+#include "HandleTable.h"
 
 class PhysicsManager;
 
@@ -31,8 +32,14 @@ class GameObject
 		void Update();
 
 		bool GetVisionAffected();
-		string GetMeshKey() const;
-		string GetMaterialKey() const;
+		const string& GetMeshKey() const;
+		const string& GetMaterialKey() const;
+		int GetMeshHandle() const { return meshHandle; }
+		int GetMaterialHandle() const { return materialHandle; }
+
+		//The renderer's slot for this object's instance, -1 until it's been added
+		int GetInstanceSlot() const { return instanceSlot; }
+		void SetInstanceSlot(int slot) { instanceSlot = slot; }
 
 		void CalculateWorldMatrix();
 		XMFLOAT4X4 GetWorldMatrix() const;
@@ -41,6 +48,7 @@ class GameObject
 
 		void SetRigidBody(btRigidBody* rBody, short layer);
 		btRigidBody* getRigidBody() const;
+		short getCollisionLayer() const { return collisionLayer; }
 		void changeCollisionLayer(short layer);
 
 		virtual ~GameObject(void);
@@ -61,8 +69,10 @@ class GameObject
 	protected:
 		bool visionAffected;
 		bool seen;
-		string meshKey;
-		string materialKey;
+		unsigned int seenFrame; //The physics update frame the frustum last touched this object in
+		int meshHandle;     //Index of the mesh key in HandleTable::meshes
+		int materialHandle; //Index of the material key in HandleTable::materials
+		int instanceSlot;   //Index into the renderer's instances of meshHandle
 		btRigidBody* rigidBody;
 		XMFLOAT4X4 worldMatrix;
 		XMFLOAT3 localScale;
@@ -75,11 +85,10 @@ class GameObject
 		// Figure out how to make this work: //static RenderManager *renderMan = RenderManager::getInstance();
 };
 
-struct GameObjectComparer
-{
-    inline bool operator() (const GameObject* objectA, const GameObject* objectB)
-    {
-		// Returns true if A's key is 'less than' B's key.
-        return (objectA->GetMeshKey().compare(objectB->GetMeshKey()) < 0);
-    }
-};
+/* SortByMesh()
+ *
+ * Groups objects by mesh handle, in handle order, keeping the order objects sharing a mesh
+ * were already in. Counts each handle and places every object straight into its slot, so it
+ * takes one pass over the objects instead of comparing them.
+ */
+void SortByMesh(vector<GameObject*>& objects);
@@ -0,0 +1,16 @@
+#include "HandleTable.h"
+
+HandleTable HandleTable::meshes;
+HandleTable HandleTable::materials;
+
+int HandleTable::getHandle(const string& key)
+{
+	map<string, int>::const_iterator found = handles.find(key);
+	if(found != handles.end())
+		return found->second;
+
+	int handle = (int)keys.size();
+	keys.push_back(key);
+	handles[key] = handle;
+	return handle;
+}
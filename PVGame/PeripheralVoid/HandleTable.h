@@ -0,0 +1,35 @@
+#pragma once
+
+#include <deque>
+#include <map>
+#include <string>
+
+using namespace std;
+
+/* HandleTable
+ *
+ * Gives every distinct key a small integer handle, counting up from 0, and turns handles
+ * back into keys. Keys get their handles while things load, so each frame can sort and
+ * index arrays by the integers and never compare or look up a string.
+ *
+ * meshes holds the MeshMaps keys GameObjects draw with, materials holds the GAME_MATERIALS
+ * keys. Only the game thread may add keys.
+ */
+class HandleTable
+{
+	public:
+		static HandleTable meshes;
+		static HandleTable materials;
+
+		//Returns key's handle, giving it the next one if it hasn't been seen before
+		int getHandle(const string& key);
+
+		//Stays valid for the life of the table
+		const string& getKey(int handle) const { return keys[handle]; }
+
+		int getCount() const { return (int)keys.size(); }
+
+	private:
+		map<string, int> handles;
+		deque<string> keys; //A deque so adding keys doesn't move the ones getKey() handed out
+};
@@ -0,0 +1,223 @@
+#include "Player.h"
+#include "RoomSet.h"
+#include "FrustumCuller.h"
+#include "Profiler.h"
+#include "AllocationTracker.h"
+#include "PhysicsBenchmark.h"
+#include <fstream>
+#include <algorithm>
+#include <cstdio>
+
+map<string, MeshData>MeshMaps::MESH_MAPS = MeshMaps::create_map();
+
+const float HEADLESS_DT = 1.0f / 60.0f;
+const int HEADLESS_FRAMES = 1800;
+
+//How long each stage of one simulated frame took, in milliseconds
+struct HeadlessFrame
+{
+	double player;
+	double physics;
+	double culling;
+	double logic;
+	double total;
+};
+
+//Holds a key down, or lets it go, the way the window procedure would
+static void SetKey(Input* input, WPARAM key, bool down)
+{
+	if(down && !input->isKeyDown((UCHAR)key))
+		input->keyDown(key);
+	else if(!down && input->isKeyDown((UCHAR)key))
+		input->keyUp(key);
+}
+
+/* ScriptInput()
+ *
+ * Presses the keys for one frame of a fixed four second loop: walk forward, turn while
+ * walking, strafe with a jump in the middle, then back up. The same frame number always
+ * gets the same keys so runs can be compared.
+ */
+static void ScriptInput(Input* input, int frame)
+{
+	int step = frame % 240;
+
+	SetKey(input, 'W', step < 150);
+	SetKey(input, VK_RIGHT, step >= 120 && step < 150);
+	SetKey(input, 'A', step >= 150 && step < 210);
+	SetKey(input, VK_SPACE, step == 180);
+	SetKey(input, 'S', step >= 210);
+}
+
+static double ElapsedMs(LARGE_INTEGER& start, LARGE_INTEGER& frequency)
+{
+	LARGE_INTEGER end;
+	QueryPerformanceCounter(&end);
+	double ms = (double)(end.QuadPart - start.QuadPart) * 1000.0 / (double)frequency.QuadPart;
+	start = end;
+	return ms;
+}
+
+/* RunLevel()
+ *
+ * Loads a level, streaming in the rooms around it the same way the game does, then plays the
+ * scripted input through the same update PVGame does while PLAYING, minus the rendering and sound.
+ *
+ * param: levelFile - the level xml to start in
+ * param: frames    - how many 60hz frames to simulate
+ * param: csv       - gets a row per frame
+ * param: riftMan   - shared, the rift is only polled once
+ */
+static void RunLevel(const char* levelFile, int frames, ofstream& csv, RiftManager* riftMan)
+{
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+
+	PhysicsManager* physicsMan = new PhysicsManager();
+	physicsMan->addTriangleMesh("Cube", MeshMaps::MESH_MAPS["Cube"]);
+	physicsMan->addTriangleMesh("Sphere", MeshMaps::MESH_MAPS["Sphere"]);
+
+	FrustumCuller* culler = new FrustumCuller();
+	Input* input = new Input();
+	Player* player = new Player(physicsMan, &RenderManager::getInstance(), riftMan);
+	player->OnResize(RenderManager::getInstance().AspectRatio());
+
+	LARGE_INTEGER start;
+	QueryPerformanceCounter(&start);
+
+	vector<GameObject*> gameObjects;
+	RoomSet* rooms = new RoomSet(physicsMan, &gameObjects);
+	//Wait on the loader every frame so the same script always streams the same rooms in
+	rooms->getStreamer()->setBlocking(true);
+	rooms->load(levelFile, 0, 0, "NOLOAD");
+	culler->build(gameObjects);
+	rooms->spawnPlayer(player);
+
+	printf("%s: %u rooms, %u objects, loaded in %.2f ms\n", levelFile, rooms->getLoadedRooms().size(), gameObjects.size(), ElapsedMs(start, frequency));
+
+	vector<double> totals;
+
+	for(int frame = 0; frame < frames; frame++)
+	{
+		HeadlessFrame times;
+		LARGE_INTEGER frameStart;
+		QueryPerformanceCounter(&frameStart);
+		start = frameStart;
+
+		ScriptInput(input, frame);
+
+		physicsMan->syncStep();
+		#if STREAM_ROOMS
+		if(rooms->stream())
+			culler->build(gameObjects);
+		#endif
+		player->Update(HEADLESS_DT, input);
+		times.player = ElapsedMs(start, frequency);
+
+		physicsMan->update(HEADLESS_DT);
+		physicsMan->updateMovedObjects();
+		times.physics = ElapsedMs(start, frequency);
+
+		#if USE_FRUSTUM_CULLING
+			player->GetCamera()->frustumCull(culler);
+		#endif
+		times.culling = ElapsedMs(start, frequency);
+
+		rooms->trackPlayer(player);
+
+		if (player->getPosition().y < -5)
+			rooms->spawnPlayer(player);
+
+		player->resetStatuses(input->isActivateKeyDown());
+
+		rooms->updateVisionAffected(player);
+
+		physicsMan->startStep();
+		input->clear(inputNS::KEYS_PRESSED);
+		times.logic = ElapsedMs(start, frequency);
+		times.total = ElapsedMs(frameStart, frequency);
+
+		PROFILE_END_FRAME();
+		ALLOC_END_FRAME();
+
+		csv << levelFile << "," << frame << "," << times.player << "," << times.physics << "," << times.culling << "," << times.logic << "," << times.total << endl;
+		totals.push_back(times.total);
+	}
+	physicsMan->syncStep();
+
+	if(!totals.empty())
+	{
+		double sum = 0.0;
+		for(unsigned int i = 0; i < totals.size(); i++)
+			sum += totals[i];
+		sort(totals.begin(), totals.end());
+		printf("%s: %d frames, avg %.3f ms, 95th %.3f ms, worst %.3f ms\n", levelFile, frames,
+			sum / totals.size(), totals[(totals.size() * 95) / 100], totals[totals.size() - 1]);
+	}
+
+	delete player;
+	delete rooms;
+	delete input;
+	delete culler;
+	delete physicsMan;
+}
+
+/* main()
+ *
+ * PeripheralVoidHeadless [-frames count] [-csv file] [-profile file] [-allocreport file] [-allocassert] [-compilelevels] [level.xml ...]
+ *
+ * Simulates each level with no window, renderer or sound and writes per frame timings.
+ * With no levels given it runs the first one. -compilelevels rebuilds every level's binary
+ * in Assets/Cache and exits.
+ */
+int main(int argc, char* argv[])
+{
+	#if TRACK_ALLOCATIONS
+	AllocationTracker::install();
+	#endif
+
+	int frames = HEADLESS_FRAMES;
+	string csvFile = "headless_timings.csv";
+	vector<const char*> levels;
+
+	for(int i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "-frames") == 0 && i + 1 < argc)
+			frames = atoi(argv[++i]);
+		else if(strcmp(argv[i], "-csv") == 0 && i + 1 < argc)
+			csvFile = argv[++i];
+		else if(strcmp(argv[i], "-profile") == 0 && i + 1 < argc)
+			Profiler::open(argv[++i]);
+		else if(strcmp(argv[i], "-allocreport") == 0 && i + 1 < argc)
+			AllocationTracker::openReport(argv[++i]);
+		else if(strcmp(argv[i], "-allocassert") == 0)
+			AllocationTracker::setBudget(ALLOC_FRAME_BUDGET);
+		else if(strcmp(argv[i], "-compilelevels") == 0)
+		{
+			LevelDescription::compileAll();
+			return 0;
+		}
+		else if(strcmp(argv[i], "-spawnbenchmark") == 0)
+		{
+			return RunSpawnBenchmark(5000, 200, "spawn_benchmark.csv") ? 0 : 1;
+		}
+		else
+			levels.push_back(argv[i]);
+	}
+	if(levels.empty())
+		levels.push_back(MAP_LEVEL_1);
+
+	ofstream csv(csvFile.c_str());
+	csv << "level,frame,player ms,physics ms,culling ms,logic ms,total ms" << endl;
+
+	char noArgs[] = "";
+	RiftManager* riftMan = new RiftManager(noArgs);
+
+	for(unsigned int i = 0; i < levels.size(); i++)
+		RunLevel(levels[i], frames, csv, riftMan);
+
+	delete riftMan;
+	Profiler::close();
+	AllocationTracker::close();
+	return 0;
+}
@@ -48,10 +48,13 @@ Input::Input()
     {
         controllers[i].vibrateTimeLeft = 0;
         controllers[i].vibrateTimeRight = 0;
+        controllers[i].connected = false;
     }
 
 	screenWidth = 1280;
 	screenHeight = 800;
+	window = NULL;
+	mouseCaptured = false;
 }
 
 //=============================================================================
@@ -230,6 +233,85 @@ void Input::clear(UCHAR what)
         clearTextIn();
 }
 
+//=============================================================================
+// Pack the state the game reads into frame
+//=============================================================================
+void Input::getFrame(InputFrame& frame) const
+{
+    memset(&frame, 0, sizeof(InputFrame));
+    for (size_t i = 0; i < inputNS::KEYS_ARRAY_LEN; i++)
+    {
+        if(keysDown[i])
+            frame.keysDown[i / 8] |= 1 << (i % 8);
+        if(keysPressed[i])
+            frame.keysPressed[i / 8] |= 1 << (i % 8);
+    }
+    for (size_t i = 0; i < inputNS::GAMEPAD_ARRAY_LEN; i++)
+    {
+        if(gamepadButtonsDown[i])
+            frame.gamepadButtonsDown |= 1 << i;
+        if(gamepadButtonsPressed[i])
+            frame.gamepadButtonsPressed |= 1 << i;
+    }
+    for (size_t i = 0; i < inputNS::MOUSE_BUTTON_ARRAY_LEN; i++)
+    {
+        if(mouseButtonsDown[i])
+            frame.mouseButtonsDown |= 1 << i;
+        if(mouseButtonsPressed[i])
+            frame.mouseButtonsPressed |= 1 << i;
+    }
+    frame.mouseButtons = (mouseLButton ? 1 : 0) | (mouseMButton ? 2 : 0) | (mouseRButton ? 4 : 0) |
+                         (mouseX1Button ? 8 : 0) | (mouseX2Button ? 16 : 0);
+    frame.mouseX = mouseX;
+    frame.mouseY = mouseY;
+    frame.mouseRawX = mouseRawX;
+    frame.mouseRawY = mouseRawY;
+    for (DWORD i = 0; i < MAX_CONTROLLERS; i++)
+    {
+        if(controllers[i].connected)
+        {
+            frame.controllersConnected |= 1 << i;
+            frame.gamepads[i] = controllers[i].state.Gamepad;
+        }
+    }
+}
+
+//=============================================================================
+// Unpack a recorded frame over the current state
+//=============================================================================
+void Input::setFrame(const InputFrame& frame)
+{
+    for (size_t i = 0; i < inputNS::KEYS_ARRAY_LEN; i++)
+    {
+        keysDown[i] = (frame.keysDown[i / 8] & (1 << (i % 8))) != 0;
+        keysPressed[i] = (frame.keysPressed[i / 8] & (1 << (i % 8))) != 0;
+    }
+    for (size_t i = 0; i < inputNS::GAMEPAD_ARRAY_LEN; i++)
+    {
+        gamepadButtonsDown[i] = (frame.gamepadButtonsDown & (1 << i)) != 0;
+        gamepadButtonsPressed[i] = (frame.gamepadButtonsPressed & (1 << i)) != 0;
+    }
+    for (size_t i = 0; i < inputNS::MOUSE_BUTTON_ARRAY_LEN; i++)
+    {
+        mouseButtonsDown[i] = (frame.mouseButtonsDown & (1 << i)) != 0;
+        mouseButtonsPressed[i] = (frame.mouseButtonsPressed & (1 << i)) != 0;
+    }
+    mouseLButton = (frame.mouseButtons & 1) != 0;
+    mouseMButton = (frame.mouseButtons & 2) != 0;
+    mouseRButton = (frame.mouseButtons & 4) != 0;
+    mouseX1Button = (frame.mouseButtons & 8) != 0;
+    mouseX2Button = (frame.mouseButtons & 16) != 0;
+    mouseX = frame.mouseX;
+    mouseY = frame.mouseY;
+    mouseRawX = frame.mouseRawX;
+    mouseRawY = frame.mouseRawY;
+    for (DWORD i = 0; i < MAX_CONTROLLERS; i++)
+    {
+        controllers[i].connected = (frame.controllersConnected & (1 << i)) != 0;
+        controllers[i].state.Gamepad = frame.gamepads[i];
+    }
+}
+
 //=============================================================================
 // Reads mouse screen position into mouseX, mouseY
 //=============================================================================
@@ -246,8 +328,11 @@ void Input::centerMouse()
 	p.y = screenHeight/2;
 	mouseX = p.x;
 	mouseY = p.y;
-	ClientToScreen(window, &p);
-	SetCursorPos(p.x,p.y);
+	if(window != NULL) //No window when running headless
+	{
+		ClientToScreen(window, &p);
+		SetCursorPos(p.x,p.y);
+	}
 }
 
 //=============================================================================
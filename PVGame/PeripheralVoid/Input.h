@@ -68,6 +68,23 @@ struct ControllerState
     bool                connected;
 };
 
+// Everything the game reads out of Input in one frame, packed to bits where it can be.
+// InputRecorder saves these and hands them back when replaying.
+struct InputFrame
+{
+    BYTE keysDown[inputNS::KEYS_ARRAY_LEN / 8];     // bit per virtual key
+    BYTE keysPressed[inputNS::KEYS_ARRAY_LEN / 8];
+    WORD gamepadButtonsDown;                        // bit per GamepadButtons
+    WORD gamepadButtonsPressed;
+    BYTE mouseButtonsDown;                          // bit per MouseButtons
+    BYTE mouseButtonsPressed;
+    BYTE mouseButtons;                              // L, M, R, X1, X2 as the window reported them
+    int  mouseX, mouseY;
+    int  mouseRawX, mouseRawY;
+    BYTE controllersConnected;                      // bit per controller
+    XINPUT_GAMEPAD gamepads[MAX_CONTROLLERS];
+};
+
 class Input
 {
 private:
@@ -138,6 +155,12 @@ public:
     // Clears key, mouse and text input data
     void clearAll() {clear(inputNS::KEYS_MOUSE_TEXT);}
 
+	// Copy the state the game reads this frame into frame, for recording.
+	void getFrame(InputFrame& frame) const;
+
+	// Replace the current state with a recorded frame.
+	void setFrame(const InputFrame& frame);
+
     // Clear text input buffer
     void clearTextIn() {textIn.clear();}
 
@@ -0,0 +1,223 @@
+#include "InputRecorder.h"
+#include "Constants.h"
+#include <algorithm>
+
+InputRecorder::InputRecorder(void)
+{
+	mode = IDLE;
+	frameCount = 0;
+	fixedDt = 0.0f;
+	memset(&lastFrame, 0, sizeof(InputFrame));
+}
+
+InputRecorder::~InputRecorder(void)
+{
+	stop();
+}
+
+/* record()
+ *
+ * Starts saving every frame to aFileName, replacing whatever was there.
+ */
+bool InputRecorder::record(string aFileName)
+{
+	stop();
+	out.open(aFileName.c_str(), ios::out | ios::binary | ios::trunc);
+	if(!out.is_open())
+		return false;
+
+	out.write((const char*)&INPUT_LOG_MAGIC, sizeof(unsigned int));
+	out.write((const char*)&INPUT_LOG_VERSION, sizeof(unsigned int));
+
+	fileName = aFileName;
+	mode = RECORDING;
+	frameCount = 0;
+	memset(&lastFrame, 0, sizeof(InputFrame));
+	return true;
+}
+
+/* replay()
+ *
+ * Starts feeding the frames saved in aFileName back to the game. The frame times of the
+ * replay go to aFileName.csv when it ends.
+ *
+ * params: aFileName - a log saved by record()
+ *         aFixedDt  - dt for every replayed frame, 0 or less replays the recorded ones
+ */
+bool InputRecorder::replay(string aFileName, float aFixedDt)
+{
+	stop();
+	in.open(aFileName.c_str(), ios::in | ios::binary);
+	if(!in.is_open())
+		return false;
+
+	unsigned int magic = 0;
+	unsigned int version = 0;
+	in.read((char*)&magic, sizeof(unsigned int));
+	in.read((char*)&version, sizeof(unsigned int));
+	if(!in || magic != INPUT_LOG_MAGIC || version != INPUT_LOG_VERSION)
+	{
+		in.close();
+		return false;
+	}
+
+	fileName = aFileName;
+	mode = REPLAYING;
+	frameCount = 0;
+	fixedDt = aFixedDt > 0.0f ? aFixedDt : 0.0f;
+	memset(&lastFrame, 0, sizeof(InputFrame));
+	replayDts.clear();
+	replayTimes.clear();
+	return true;
+}
+
+void InputRecorder::stop()
+{
+	if(mode == RECORDING)
+		out.close();
+	else if(mode == REPLAYING)
+	{
+		in.close();
+		writeProfile();
+	}
+	mode = IDLE;
+}
+
+bool InputRecorder::update(Input* input, float& dt)
+{
+	if(mode == RECORDING)
+	{
+		InputFrame frame;
+		input->getFrame(frame);
+		writeFrame(frame, dt);
+		frameCount++;
+	}
+	else if(mode == REPLAYING)
+	{
+		float recordedDt;
+		if(!readFrame(lastFrame, recordedDt))
+		{
+			stop();
+			return false;
+		}
+		input->setFrame(lastFrame);
+		replayDts.push_back(recordedDt);
+		dt = fixedDt > 0.0f ? fixedDt : recordedDt;
+		frameCount++;
+	}
+	return true;
+}
+
+void InputRecorder::addFrameTime(double ms)
+{
+	if(mode == REPLAYING)
+		replayTimes.push_back(ms);
+}
+
+//Writes dt, which parts changed since the last frame, then just those parts
+void InputRecorder::writeFrame(const InputFrame& frame, float dt)
+{
+	unsigned char parts = 0;
+	if(frameCount == 0 || memcmp(frame.keysDown, lastFrame.keysDown, sizeof(frame.keysDown)) != 0 ||
+		memcmp(frame.keysPressed, lastFrame.keysPressed, sizeof(frame.keysPressed)) != 0)
+		parts |= PART_KEYS;
+	if(frameCount == 0 || frame.gamepadButtonsDown != lastFrame.gamepadButtonsDown || frame.gamepadButtonsPressed != lastFrame.gamepadButtonsPressed ||
+		frame.mouseButtonsDown != lastFrame.mouseButtonsDown || frame.mouseButtonsPressed != lastFrame.mouseButtonsPressed ||
+		frame.mouseButtons != lastFrame.mouseButtons)
+		parts |= PART_BUTTONS;
+	if(frameCount == 0 || frame.mouseX != lastFrame.mouseX || frame.mouseY != lastFrame.mouseY ||
+		frame.mouseRawX != lastFrame.mouseRawX || frame.mouseRawY != lastFrame.mouseRawY)
+		parts |= PART_MOUSE;
+	if(frameCount == 0 || frame.controllersConnected != lastFrame.controllersConnected ||
+		memcmp(frame.gamepads, lastFrame.gamepads, sizeof(frame.gamepads)) != 0)
+		parts |= PART_GAMEPADS;
+
+	out.write((const char*)&dt, sizeof(float));
+	out.write((const char*)&parts, sizeof(unsigned char));
+
+	if(parts & PART_KEYS)
+	{
+		out.write((const char*)frame.keysDown, sizeof(frame.keysDown));
+		out.write((const char*)frame.keysPressed, sizeof(frame.keysPressed));
+	}
+	if(parts & PART_BUTTONS)
+	{
+		out.write((const char*)&frame.gamepadButtonsDown, sizeof(WORD));
+		out.write((const char*)&frame.gamepadButtonsPressed, sizeof(WORD));
+		out.write((const char*)&frame.mouseButtonsDown, sizeof(BYTE));
+		out.write((const char*)&frame.mouseButtonsPressed, sizeof(BYTE));
+		out.write((const char*)&frame.mouseButtons, sizeof(BYTE));
+	}
+	if(parts & PART_MOUSE)
+	{
+		out.write((const char*)&frame.mouseX, sizeof(int));
+		out.write((const char*)&frame.mouseY, sizeof(int));
+		out.write((const char*)&frame.mouseRawX, sizeof(int));
+		out.write((const char*)&frame.mouseRawY, sizeof(int));
+	}
+	if(parts & PART_GAMEPADS)
+	{
+		out.write((const char*)&frame.controllersConnected, sizeof(BYTE));
+		out.write((const char*)frame.gamepads, sizeof(frame.gamepads));
+	}
+
+	lastFrame = frame;
+}
+
+//Reads the next frame over frame, which still holds the last one so unchanged parts carry over
+bool InputRecorder::readFrame(InputFrame& frame, float& dt)
+{
+	unsigned char parts = 0;
+	in.read((char*)&dt, sizeof(float));
+	in.read((char*)&parts, sizeof(unsigned char));
+
+	if(parts & PART_KEYS)
+	{
+		in.read((char*)frame.keysDown, sizeof(frame.keysDown));
+		in.read((char*)frame.keysPressed, sizeof(frame.keysPressed));
+	}
+	if(parts & PART_BUTTONS)
+	{
+		in.read((char*)&frame.gamepadButtonsDown, sizeof(WORD));
+		in.read((char*)&frame.gamepadButtonsPressed, sizeof(WORD));
+		in.read((char*)&frame.mouseButtonsDown, sizeof(BYTE));
+		in.read((char*)&frame.mouseButtonsPressed, sizeof(BYTE));
+		in.read((char*)&frame.mouseButtons, sizeof(BYTE));
+	}
+	if(parts & PART_MOUSE)
+	{
+		in.read((char*)&frame.mouseX, sizeof(int));
+		in.read((char*)&frame.mouseY, sizeof(int));
+		in.read((char*)&frame.mouseRawX, sizeof(int));
+		in.read((char*)&frame.mouseRawY, sizeof(int));
+	}
+	if(parts & PART_GAMEPADS)
+	{
+		in.read((char*)&frame.controllersConnected, sizeof(BYTE));
+		in.read((char*)frame.gamepads, sizeof(frame.gamepads));
+	}
+
+	//A frame cut short means the game closed mid write, stop at the last whole one
+	return !in.fail();
+}
+
+//Writes the replayed frame times next to the log, plus a summary to the debug output
+void InputRecorder::writeProfile()
+{
+	if(replayTimes.empty())
+		return;
+
+	ofstream csv((fileName + ".csv").c_str());
+	csv << "frame,recorded dt,ms" << endl;
+	double total = 0.0;
+	for(unsigned int i = 0; i < replayTimes.size(); i++)
+	{
+		csv << i << "," << replayDts[i] << "," << replayTimes[i] << endl;
+		total += replayTimes[i];
+	}
+
+	vector<double> sorted(replayTimes);
+	sort(sorted.begin(), sorted.end());
+	DBOUT("Replay " << fileName.c_str() << ": " << sorted.size() << " frames, avg " << total / sorted.size() << " ms, 95th " <<
+		sorted[(sorted.size() * 95) / 100] << " ms, worst " << sorted[sorted.size() - 1] << " ms");
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "Input.h"
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+const unsigned int INPUT_LOG_MAGIC = 0x52495650; //"PVIR"
+const unsigned int INPUT_LOG_VERSION = 1;
+
+/* InputRecorder
+ *
+ * Saves the Input state and dt of every frame to a binary log, or plays a log back by
+ * overwriting Input and dt before each UpdateScene. A replay runs the same frames with
+ * the same timesteps no matter how fast the build is, so the frame times it collects can
+ * be compared between builds. Given a fixed dt, every replayed frame gets that instead of
+ * the recorded one, so physics steps the same way whatever the recording machine's frame
+ * times were. The recorded dt still goes in the csv.
+ *
+ * Each frame in the log is its dt, a byte saying which parts of the InputFrame changed
+ * since the last frame, then only those parts.
+ */
+class InputRecorder
+{
+	public:
+		InputRecorder(void);
+		~InputRecorder(void);
+
+		bool record(string aFileName);
+		bool replay(string aFileName, float aFixedDt = 0.0f);
+		void stop();
+
+		bool isRecording() const { return mode == RECORDING; }
+		bool isReplaying() const { return mode == REPLAYING; }
+		int getFrameCount() const { return frameCount; }
+
+		/* update()
+		 *
+		 * Called once a frame before UpdateScene. Recording saves the frame, replaying
+		 * replaces the input with the next one from the log and dt with the fixed dt,
+		 * or the recorded one if there isn't one.
+		 *
+		 * params: input - the game's input
+		 *         dt    - the measured frame time, overwritten when replaying
+		 * returns: false once a replay has run out of frames
+		 */
+		bool update(Input* input, float& dt);
+
+		//Replay only, how long the frame that was just replayed took to update and draw
+		void addFrameTime(double ms);
+
+	private:
+		enum RecorderMode { IDLE, RECORDING, REPLAYING };
+		enum FrameParts { PART_KEYS = 1, PART_BUTTONS = 2, PART_MOUSE = 4, PART_GAMEPADS = 8 };
+
+		void writeFrame(const InputFrame& frame, float dt);
+		bool readFrame(InputFrame& frame, float& dt);
+		void writeProfile();
+
+		RecorderMode mode;
+		string fileName;
+		ofstream out;
+		ifstream in;
+		InputFrame lastFrame;
+		int frameCount;
+		float fixedDt;            //Replay only, 0 to use the recorded dt
+		vector<float> replayDts;  //As recorded
+		vector<double> replayTimes;
+};
@@ -0,0 +1,87 @@
+#include "InstanceRegistry.h"
+#include "GameObject.h"
+
+int InstanceRegistry::add(int meshHandle, const InstancedData& data)
+{
+	if (meshHandle >= (int)meshes.size())
+	{
+		MeshInstances noInstances;
+		noInstances.liveCount = 0;
+		meshes.resize(meshHandle + 1, noInstances);
+	}
+	MeshInstances& mesh = meshes[meshHandle];
+	mesh.liveCount++;
+
+	if (!mesh.freeSlots.empty())
+	{
+		int slot = mesh.freeSlots.back();
+		mesh.freeSlots.pop_back();
+		mesh.instances[slot] = data;
+		return slot;
+	}
+
+	//Grow by doubling ourselves, vector is free to grow by less
+	if (mesh.instances.size() == mesh.instances.capacity())
+	{
+		unsigned int capacity = mesh.instances.capacity() * 2;
+		if (capacity < INSTANCE_MIN_CAPACITY)
+			capacity = INSTANCE_MIN_CAPACITY;
+		mesh.instances.reserve(capacity);
+		mesh.freeSlots.reserve(capacity);
+	}
+	mesh.instances.push_back(data);
+	return mesh.instances.size() - 1;
+}
+
+void InstanceRegistry::remove(int meshHandle, int slot)
+{
+	MeshInstances& mesh = meshes[meshHandle];
+	mesh.instances[slot].isRendered = false;
+	mesh.freeSlots.push_back(slot);
+	mesh.liveCount--;
+}
+
+void InstanceRegistry::clear(void)
+{
+	for (unsigned int meshHandle = 0; meshHandle < meshes.size(); meshHandle++)
+	{
+		meshes[meshHandle].instances.clear();
+		meshes[meshHandle].freeSlots.clear();
+		meshes[meshHandle].liveCount = 0;
+	}
+}
+
+int InstanceRegistry::getCapacity(int meshHandle) const
+{
+	if (meshHandle >= (int)meshes.size())
+		return 0;
+	return meshes[meshHandle].instances.capacity();
+}
+
+int InstanceRegistry::getLiveCount(int meshHandle) const
+{
+	if (meshHandle >= (int)meshes.size())
+		return 0;
+	return meshes[meshHandle].liveCount;
+}
+
+/* makeInstance()
+ *
+ * Fills in the instance data for an object from its material, ready for add().
+ *
+ * param: object      - the object being drawn
+ * param: material    - object's game material
+ * param: surface     - the surface material that game material names
+ * param: atlasCoords - where the material's diffuse texture sits in the atlas
+ */
+InstancedData InstanceRegistry::makeInstance(const GameObject* object, const GameMaterial& material, const SurfaceMaterial& surface, const XMFLOAT2& atlasCoords)
+{
+	InstancedData data;
+	data.World = object->GetWorldMatrix();
+	data.SurfMaterial = surface;
+	data.AtlasC = atlasCoords;
+	data.GlowColor = material.GlowColor;
+	data.TexScale = object->GetTexScale();
+	data.isRendered = false; // DrawScene sets it from isSeen every frame.
+	return data;
+}
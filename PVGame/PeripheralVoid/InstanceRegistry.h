@@ -0,0 +1,51 @@
+#pragma once
+
+#include "Constants.h"
+
+class GameObject;
+
+/* InstanceRegistry
+ *
+ * Holds the instance data of everything drawn, one array per mesh handle. An object gets a
+ * slot in its mesh's array from add() and keeps it until remove(), so the renderer can find
+ * its instance through the slot without the objects being in any order.
+ *
+ * remove() puts the slot on its mesh's free list and add() takes from there before using a
+ * new one. A mesh's array doubles its capacity whenever it fills up, so adding or removing
+ * an object is constant time apart from those, and getCapacity() only changes with them.
+ *
+ * Free slots keep isRendered false, so copying out the rendered instances skips them.
+ */
+class InstanceRegistry
+{
+	public:
+		//Returns data's slot in meshHandle's instances
+		int add(int meshHandle, const InstancedData& data);
+		void remove(int meshHandle, int slot);
+
+		//Frees every slot, keeping each mesh's capacity
+		void clear(void);
+
+		InstancedData& get(int meshHandle, int slot) { return meshes[meshHandle].instances[slot]; }
+
+		//Every slot handed out since the last clear(), free ones included
+		const vector<InstancedData>& getInstances(int meshHandle) const { return meshes[meshHandle].instances; }
+
+		int getMeshCount() const { return (int)meshes.size(); }
+		int getCapacity(int meshHandle) const;
+		int getLiveCount(int meshHandle) const;
+
+		// The material maps in Constants.h are static, so every file has its own copy and the
+		// caller passes in what it found in the ones it filled.
+		static InstancedData makeInstance(const GameObject* object, const GameMaterial& material, const SurfaceMaterial& surface, const XMFLOAT2& atlasCoords);
+
+	private:
+		struct MeshInstances
+		{
+			vector<InstancedData> instances;
+			vector<int> freeSlots;
+			int liveCount;
+		};
+
+		vector<MeshInstances> meshes;
+};
@@ -0,0 +1,576 @@
+#include "LevelDescription.h"
+#include "Profiler.h"
+#include "CacheDirectory.h"
+#include <fstream>
+
+using namespace tinyxml2;
+
+map<string, LevelDescription> LevelDescription::levels;
+
+//Rooms are read on the RoomStreamer's thread as well as the game thread
+static struct LevelLock
+{
+	CRITICAL_SECTION section;
+	LevelLock() { InitializeCriticalSection(&section); }
+	~LevelLock() { DeleteCriticalSection(&section); }
+} levelLock;
+
+const unsigned int LEVEL_FILE_MAGIC = 0x564c5650; //"PVLV"
+
+//Bump this whenever LevelFileHeader, LevelRecord or the way levels are read changes
+const unsigned int LEVEL_FILE_VERSION = 1;
+
+//Start of a compiled level, followed by the records of each kind in order then the strings
+struct LevelFileHeader
+{
+	unsigned int magic;
+	unsigned int version;
+	DWORD sourceTimeLow;  //Last write time and size of the xml it was compiled from
+	DWORD sourceTimeHigh;
+	DWORD sourceSize;
+	float width;
+	float depth;
+	float mapOffsetX;
+	float mapOffsetZ;
+	unsigned int wallCount;
+	unsigned int floorCount;
+	unsigned int exitCount;
+	unsigned int spawnCount;
+	unsigned int cubeCount;
+	unsigned int crestCount;
+	unsigned int stringBytes;
+};
+
+//Every kind of level object has the same layout on disk, strings are offsets into the string table
+struct LevelRecord
+{
+	float row;
+	float col;
+	float xLength;
+	float yLength;
+	float zLength;
+	float centerX;
+	float centerY;
+	float centerZ;
+	float xRotation;
+	float yRotation;
+	float zRotation;
+	float translateX;
+	float translateY;
+	float translateZ;
+	int effect;
+	unsigned int direction;
+	unsigned int file;
+	unsigned int target;
+	unsigned int texture;
+};
+
+//Collects each distinct string once, offset 0 is always the empty string
+class LevelStringTable
+{
+	public:
+		LevelStringTable() : bytes(1, '\0') {}
+
+		unsigned int add(const string& text)
+		{
+			if(text.empty())
+				return 0;
+			map<string, unsigned int>::iterator found = offsets.find(text);
+			if(found != offsets.end())
+				return found->second;
+
+			unsigned int offset = bytes.size();
+			bytes.insert(bytes.end(), text.begin(), text.end());
+			bytes.push_back('\0');
+			offsets[text] = offset;
+			return offset;
+		}
+
+		vector<char> bytes;
+
+	private:
+		map<string, unsigned int> offsets;
+};
+
+static LevelRecord ToRecord(const Wall& wall, LevelStringTable& strings)
+{
+	LevelRecord record = { wall.row, wall.col, wall.xLength, wall.yLength, wall.zLength, wall.centerX, wall.centerY, wall.centerZ,
+		wall.xRotation, wall.yRotation, wall.zRotation, 0.0f, 0.0f, 0.0f, (int)wall.effect,
+		strings.add(wall.direction), strings.add(wall.file), strings.add(wall.target), strings.add(wall.texture) };
+	return record;
+}
+
+static void FromRecord(const LevelRecord& record, const char* strings, Wall& wall)
+{
+	wall.row = record.row;
+	wall.col = record.col;
+	wall.xLength = record.xLength;
+	wall.yLength = record.yLength;
+	wall.zLength = record.zLength;
+	wall.centerX = record.centerX;
+	wall.centerY = record.centerY;
+	wall.centerZ = record.centerZ;
+	wall.xRotation = record.xRotation;
+	wall.yRotation = record.yRotation;
+	wall.zRotation = record.zRotation;
+	wall.effect = (CREST_TYPE)record.effect;
+	wall.direction = strings + record.direction;
+	wall.file = strings + record.file;
+	wall.target = strings + record.target;
+	wall.texture = strings + record.texture;
+}
+
+static void WriteRecords(ofstream& out, const vector<Wall>& walls, LevelStringTable& strings)
+{
+	for(unsigned int i = 0; i < walls.size(); i++)
+	{
+		LevelRecord record = ToRecord(walls[i], strings);
+		out.write((const char*)&record, sizeof(LevelRecord));
+	}
+}
+
+static const LevelRecord* ReadRecords(const LevelRecord* records, unsigned int count, const char* strings, vector<Wall>& walls)
+{
+	walls.resize(count);
+	for(unsigned int i = 0; i < count; i++)
+		FromRecord(records[i], strings, walls[i]);
+	return records + count;
+}
+
+const LevelDescription* LevelDescription::load(const string& fileName)
+{
+	EnterCriticalSection(&levelLock.section);
+	map<string, LevelDescription>::iterator found = levels.find(fileName);
+	if(found != levels.end())
+	{
+		LeaveCriticalSection(&levelLock.section);
+		return &found->second;
+	}
+
+	LevelDescription& level = levels[fileName];
+
+	#if CACHE_LEVELS
+	// Only -compilelevels writes under Assets, levels missing or stale there are compiled into the user's cache
+	string userBinaryFile = CacheDirectory::fileFor(fileName, ".lvl");
+	if(!level.readBinary(binaryFileFor(fileName), fileName) && !level.readBinary(userBinaryFile, fileName) && level.readXml(fileName))
+	{
+		if(!CacheDirectory::create() || !level.writeBinary(userBinaryFile, fileName))
+			DBOUT("Could not cache " << userBinaryFile.c_str());
+	}
+	#else
+	level.readXml(fileName);
+	#endif
+
+	LeaveCriticalSection(&levelLock.section);
+	return &level;
+}
+
+int LevelDescription::compileAll()
+{
+	CreateDirectoryA("Assets/Cache", NULL);
+
+	vector<string> levelFiles = findLevelFiles();
+	int compiled = 0;
+	for(unsigned int i = 0; i < levelFiles.size(); i++)
+	{
+		LevelDescription level;
+		if(level.readXml(levelFiles[i]) && level.writeBinary(binaryFileFor(levelFiles[i]), levelFiles[i]))
+			compiled++;
+		else
+			DBOUT("Could not compile " << levelFiles[i].c_str());
+	}
+	return compiled;
+}
+
+vector<string> LevelDescription::findLevelFiles()
+{
+	vector<string> levelFiles;
+	WIN32_FIND_DATAA found;
+	HANDLE search = FindFirstFileA("Assets/level*.xml", &found);
+	if(search == INVALID_HANDLE_VALUE)
+		return levelFiles;
+
+	do
+	{
+		levelFiles.push_back(string("Assets/") + found.cFileName);
+	} while(FindNextFileA(search, &found));
+	FindClose(search);
+	return levelFiles;
+}
+
+string LevelDescription::binaryFileFor(const string& fileName)
+{
+	return "Assets/Cache/" + fileName.substr(fileName.find_last_of("/\\") + 1) + ".lvl";
+}
+
+bool LevelDescription::readXml(const string& fileName)
+{
+	PROFILE("Level Parse");
+	file = fileName;
+	width = -100.0f;
+	depth = -100.0f;
+	mapOffsetX = 0.0f;
+	mapOffsetZ = 0.0f;
+
+	tinyxml2::XMLDocument doc;
+	doc.LoadFile(fileName.c_str());
+	XMLElement* level = doc.FirstChildElement("level");
+	loaded = doc.ErrorID() == 0 && level != NULL;
+	if(!loaded)
+		return false;
+
+	//The walls set the map offset everything else is shifted by, so they go first
+	parseWalls(level->FirstChildElement("walls"));
+
+	XMLElement* exitList = level->FirstChildElement("exits");
+	for (XMLElement* exit = exitList->FirstChildElement("exit"); exit != NULL; exit = exit->NextSiblingElement("exit"))
+	{
+		Wall tempWall = Wall();
+
+		// Get full filename of xml file
+		char folder[80] = "Assets/";
+		const char* fullFile = strcat(folder, exit->Attribute("file"));
+
+		tempWall.row = (float)atof(exit->Attribute("row")) + mapOffsetZ;
+		tempWall.col = (float)atof(exit->Attribute("col")) + mapOffsetX;
+		tempWall.xLength = (float)atof(exit->Attribute("xLength"));
+		tempWall.zLength = (float)atof(exit->Attribute("zLength"));
+		tempWall.centerX = (float)atof(exit->Attribute("centerX")) + mapOffsetX;
+		tempWall.centerY = (float)atof(exit->Attribute("centerY"));
+		tempWall.centerZ = (float)atof(exit->Attribute("centerZ")) + mapOffsetZ;
+		tempWall.file = fullFile;
+
+		exits.push_back(tempWall);
+	}
+
+	XMLElement* floorList = level->FirstChildElement("floors");
+	for (XMLElement* floor = floorList->FirstChildElement("floor"); floor != NULL; floor = floor->NextSiblingElement("floor"))
+	{
+		Wall tempWall = Wall();
+
+		tempWall.row = (float)atof(floor->Attribute("row")) + mapOffsetZ;
+		tempWall.col = (float)atof(floor->Attribute("col")) + mapOffsetX;
+		tempWall.xLength = (float)atof(floor->Attribute("xLength"));
+		tempWall.zLength = (float)atof(floor->Attribute("zLength"));
+		tempWall.centerX = (float)atof(floor->Attribute("centerX")) + mapOffsetX;
+		tempWall.centerY = (float)atof(floor->Attribute("centerY"));
+		tempWall.centerZ = (float)atof(floor->Attribute("centerZ")) + mapOffsetZ;
+		tempWall.texture = floor->Attribute("texture");
+
+		floors.push_back(tempWall);
+	}
+
+	XMLElement* spawnList = level->FirstChildElement("spawns");
+	for (XMLElement* spawn = spawnList->FirstChildElement("spawn"); spawn != NULL; spawn = spawn->NextSiblingElement("spawn"))
+	{
+		Wall tempWall = Wall();
+
+		tempWall.row = (float)atof(spawn->Attribute("row")) + mapOffsetZ;
+		tempWall.col = (float)atof(spawn->Attribute("col")) + mapOffsetX;
+		tempWall.xLength = (float)atof(spawn->Attribute("xLength"));
+		tempWall.zLength = (float)atof(spawn->Attribute("zLength"));
+		tempWall.centerX = (float)atof(spawn->Attribute("centerX")) + mapOffsetX;
+		tempWall.centerY = (float)atof(spawn->Attribute("centerY"));
+		tempWall.centerZ = (float)atof(spawn->Attribute("centerZ")) + mapOffsetZ;
+		tempWall.direction = spawn->Attribute("dir");
+
+		spawns.push_back(tempWall);
+	}
+
+	XMLElement* cubeList = level->FirstChildElement("cubes");
+	for (XMLElement* cube = cubeList->FirstChildElement("cube"); cube != NULL; cube = cube->NextSiblingElement("cube"))
+	{
+		Cube tempCube = Cube();
+
+		tempCube.row = (float)atof(cube->Attribute("row")) + mapOffsetZ;
+		tempCube.col = (float)atof(cube->Attribute("col")) + mapOffsetX;
+		tempCube.xLength = (float)atof(cube->Attribute("xLength"));
+		tempCube.yLength = (float)atof(cube->Attribute("yLength"));
+		tempCube.zLength = (float)atof(cube->Attribute("zLength"));
+		tempCube.centerX = (float)atof(cube->Attribute("centerX")) + mapOffsetX;
+		tempCube.centerY = (float)atof(cube->Attribute("centerY"));
+		tempCube.centerZ = (float)atof(cube->Attribute("centerZ")) + mapOffsetZ;
+		tempCube.translateX = (float)atof(cube->Attribute("translateX"));
+		tempCube.translateY = (float)atof(cube->Attribute("translateY"));
+		tempCube.translateZ = (float)atof(cube->Attribute("translateZ"));
+		tempCube.texture = cube->Attribute("texture");
+
+		cubes.push_back(tempCube);
+	}
+
+	XMLElement* crestList = level->FirstChildElement("crests");
+	for (XMLElement* crest = crestList->FirstChildElement("crest"); crest != NULL; crest = crest->NextSiblingElement("crest"))
+		parseCrest(crest);
+
+	return true;
+}
+
+/* readBinary()
+ *
+ * Maps a level compiled by writeBinary() and copies its records out.
+ *
+ * params: binaryFile - the compiled level
+ *         sourceFile - the xml it was compiled from, if that has changed since the binary is stale
+ * returns: false if the binary is missing, stale or not one this build can read
+ */
+bool LevelDescription::readBinary(const string& binaryFile, const string& sourceFile)
+{
+	PROFILE("Level Map");
+	WIN32_FILE_ATTRIBUTE_DATA source;
+	if(!GetFileAttributesExA(sourceFile.c_str(), GetFileExInfoStandard, &source))
+		return false;
+
+	HANDLE fileHandle = CreateFileA(binaryFile.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(fileHandle == INVALID_HANDLE_VALUE)
+		return false;
+
+	DWORD size = GetFileSize(fileHandle, NULL);
+	HANDLE mapping = NULL;
+	const char* data = NULL;
+	if(size != INVALID_FILE_SIZE && size >= sizeof(LevelFileHeader))
+		mapping = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if(mapping != NULL)
+		data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+
+	file = sourceFile;
+	loaded = data != NULL && readRecords(data, size, source);
+
+	if(data != NULL)
+		UnmapViewOfFile(data);
+	if(mapping != NULL)
+		CloseHandle(mapping);
+	CloseHandle(fileHandle);
+	return loaded;
+}
+
+bool LevelDescription::readRecords(const char* data, unsigned int size, const WIN32_FILE_ATTRIBUTE_DATA& source)
+{
+	const LevelFileHeader* header = (const LevelFileHeader*)data;
+	if(header->magic != LEVEL_FILE_MAGIC || header->version != LEVEL_FILE_VERSION)
+		return false;
+	if(header->sourceTimeLow != source.ftLastWriteTime.dwLowDateTime || header->sourceTimeHigh != source.ftLastWriteTime.dwHighDateTime ||
+		header->sourceSize != source.nFileSizeLow)
+		return false;
+
+	unsigned int recordCount = header->wallCount + header->floorCount + header->exitCount + header->spawnCount + header->cubeCount + header->crestCount;
+	if(size != sizeof(LevelFileHeader) + recordCount * sizeof(LevelRecord) + header->stringBytes || header->stringBytes == 0)
+		return false;
+
+	const LevelRecord* records = (const LevelRecord*)(data + sizeof(LevelFileHeader));
+	const char* strings = (const char*)(records + recordCount);
+	if(strings[header->stringBytes - 1] != '\0')
+		return false;
+
+	//Every string offset has to land inside the table
+	for(unsigned int i = 0; i < recordCount; i++)
+	{
+		if(records[i].direction >= header->stringBytes || records[i].file >= header->stringBytes ||
+			records[i].target >= header->stringBytes || records[i].texture >= header->stringBytes)
+			return false;
+	}
+
+	width = header->width;
+	depth = header->depth;
+	mapOffsetX = header->mapOffsetX;
+	mapOffsetZ = header->mapOffsetZ;
+
+	records = ReadRecords(records, header->wallCount, strings, walls);
+	records = ReadRecords(records, header->floorCount, strings, floors);
+	records = ReadRecords(records, header->exitCount, strings, exits);
+	records = ReadRecords(records, header->spawnCount, strings, spawns);
+
+	cubes.resize(header->cubeCount);
+	for(unsigned int i = 0; i < header->cubeCount; i++)
+	{
+		FromRecord(records[i], strings, cubes[i]);
+		cubes[i].translateX = records[i].translateX;
+		cubes[i].translateY = records[i].translateY;
+		cubes[i].translateZ = records[i].translateZ;
+	}
+	records += header->cubeCount;
+
+	ReadRecords(records, header->crestCount, strings, crests);
+	return true;
+}
+
+//Compiles this description to binaryFile, stamped with sourceFile's time and size so changes to it are noticed
+bool LevelDescription::writeBinary(const string& binaryFile, const string& sourceFile) const
+{
+	WIN32_FILE_ATTRIBUTE_DATA source;
+	if(!loaded || !GetFileAttributesExA(sourceFile.c_str(), GetFileExInfoStandard, &source))
+		return false;
+
+	ofstream out(binaryFile.c_str(), ios::out | ios::binary | ios::trunc);
+	if(!out)
+		return false;
+
+	LevelFileHeader header;
+	header.magic = LEVEL_FILE_MAGIC;
+	header.version = LEVEL_FILE_VERSION;
+	header.sourceTimeLow = source.ftLastWriteTime.dwLowDateTime;
+	header.sourceTimeHigh = source.ftLastWriteTime.dwHighDateTime;
+	header.sourceSize = source.nFileSizeLow;
+	header.width = width;
+	header.depth = depth;
+	header.mapOffsetX = mapOffsetX;
+	header.mapOffsetZ = mapOffsetZ;
+	header.wallCount = walls.size();
+	header.floorCount = floors.size();
+	header.exitCount = exits.size();
+	header.spawnCount = spawns.size();
+	header.cubeCount = cubes.size();
+	header.crestCount = crests.size();
+
+	//The string table goes last, so it's filled in while the records are written and the header patched after
+	LevelStringTable strings;
+	out.write((const char*)&header, sizeof(LevelFileHeader));
+	WriteRecords(out, walls, strings);
+	WriteRecords(out, floors, strings);
+	WriteRecords(out, exits, strings);
+	WriteRecords(out, spawns, strings);
+	for(unsigned int i = 0; i < cubes.size(); i++)
+	{
+		LevelRecord record = ToRecord(cubes[i], strings);
+		record.translateX = cubes[i].translateX;
+		record.translateY = cubes[i].translateY;
+		record.translateZ = cubes[i].translateZ;
+		out.write((const char*)&record, sizeof(LevelRecord));
+	}
+	WriteRecords(out, crests, strings);
+	out.write(&strings.bytes[0], strings.bytes.size());
+
+	header.stringBytes = strings.bytes.size();
+	out.seekp(0);
+	out.write((const char*)&header, sizeof(LevelFileHeader));
+	return !out.fail();
+}
+
+/* parseWalls()
+ *
+ * Works out the map offset and the room's size, then reads the walls in row order. The
+ * offset comes from the first wall's row and the smallest column, and is applied as it
+ * changes while the size is worked out.
+ */
+void LevelDescription::parseWalls(XMLElement* wallList)
+{
+	bool isFirst = true;
+	for (XMLElement* wall = wallList->FirstChildElement("wall"); wall != NULL; wall = wall->NextSiblingElement("wall"))
+	{
+		float row = (float)atof(wall->Attribute("row"));
+		float col = (float)atof(wall->Attribute("col"));
+		float xLength = (float)atof(wall->Attribute("xLength"));
+		float zLength = (float)atof(wall->Attribute("zLength"));
+
+		if (isFirst)
+		{
+			mapOffsetX = -col;
+			mapOffsetZ = -row;
+			isFirst = false;
+		}
+		else if (col < -mapOffsetX)
+			mapOffsetX = -col;
+
+		// increase room dimensions if necessary
+		if (col + xLength + 1 + mapOffsetX > width)
+			width = col + xLength + mapOffsetX;
+		if (row + zLength + 1 + mapOffsetZ > depth)
+			depth = row + zLength + mapOffsetZ;
+	}
+
+	vector<vector<Wall>> wallRows;
+	for (XMLElement* wall = wallList->FirstChildElement("wall"); wall != NULL; wall = wall->NextSiblingElement("wall"))
+	{
+		Wall tempWall = Wall();
+
+		tempWall.row = (float)atof(wall->Attribute("row")) + mapOffsetZ;
+		tempWall.col = (float)atof(wall->Attribute("col")) + mapOffsetX;
+		tempWall.xLength = (float)atof(wall->Attribute("xLength"));
+		tempWall.yLength = (float)atof(wall->Attribute("yLength")) + WALL_LOWERED;
+		tempWall.zLength = (float)atof(wall->Attribute("zLength"));
+		tempWall.centerX = (float)atof(wall->Attribute("centerX")) + mapOffsetX;
+		tempWall.centerY = (float)atof(wall->Attribute("centerY")) - WALL_LOWERED;
+		tempWall.centerZ = (float)atof(wall->Attribute("centerZ")) + mapOffsetZ;
+		tempWall.texture = wall->Attribute("texture");
+
+		unsigned int rowIndex = (unsigned int)atof(wall->Attribute("row")) + (unsigned int)mapOffsetZ;
+		if (rowIndex >= wallRows.size())
+			wallRows.resize(rowIndex + 1);
+		wallRows[rowIndex].push_back(tempWall);
+	}
+
+	for (unsigned int i = 0; i < wallRows.size(); i++)
+		walls.insert(walls.end(), wallRows[i].begin(), wallRows[i].end());
+}
+
+//Reads a crest and moves it onto the floor, platform or wall its placement says
+void LevelDescription::parseCrest(XMLElement* crest)
+{
+	Wall tempWall = Wall();
+
+	const char* dir = crest->Attribute("dir");
+	const char* placement = crest->Attribute("placement");
+
+	tempWall.row = (float)atof(crest->Attribute("row")) + mapOffsetZ;
+	tempWall.col = (float)atof(crest->Attribute("col")) + mapOffsetX;
+	tempWall.xLength = (float)atof(crest->Attribute("xLength"));
+	tempWall.yLength = (float)atof(crest->Attribute("yLength"));
+	tempWall.zLength = (float)atof(crest->Attribute("zLength"));
+	tempWall.centerX = (float)atof(crest->Attribute("centerX")) + mapOffsetX;
+	tempWall.centerY = (float)atof(crest->Attribute("centerY"));
+	tempWall.centerZ = (float)atof(crest->Attribute("centerZ")) + mapOffsetZ;
+	tempWall.xRotation = 0.0f;
+	tempWall.yRotation = 0.0f;
+	tempWall.zRotation = 0.0f;
+	tempWall.direction = dir;
+	tempWall.effect = static_cast<CREST_TYPE>(atoi(crest->Attribute("effect")));
+	tempWall.target = crest->Attribute("target");
+
+	if (strcmp(placement, "platform") == 0)
+		tempWall.yLength *= 0.5f;
+
+	if (strcmp(dir, "up") == 0)
+	{
+		if (strcmp(placement, "") == 0)
+			tempWall.centerZ -= 0.4f;
+
+		if (strcmp(placement, "wall") == 0)
+			tempWall.zLength *= 0.1f;
+	}
+
+	if (strcmp(dir, "down") == 0)
+	{
+		if (strcmp(placement, "") == 0)
+			tempWall.centerZ += 0.4f;
+
+		if (strcmp(placement, "wall") == 0)
+			tempWall.zLength *= 0.1f;
+	}
+
+	if (strcmp(dir, "right") == 0)
+	{
+		if (strcmp(placement, "") == 0)
+		{
+			tempWall.centerX -= 0.4f;
+			tempWall.xRotation = 3.14f / 2.0f;
+		}
+
+		if (strcmp(placement, "wall") == 0)
+			tempWall.xLength *= 0.1f;
+	}
+
+	if (strcmp(dir, "left") == 0)
+	{
+		if (strcmp(placement, "") == 0)
+		{
+			tempWall.centerX += 0.4f;
+			tempWall.xRotation = -3.14f / 2.0f;
+		}
+
+		if (strcmp(placement, "wall") == 0)
+			tempWall.xLength *= 0.1f;
+	}
+
+	tempWall.centerY = tempWall.centerY + tempWall.yLength / 2;
+
+	crests.push_back(tempWall);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <Windows.h>
+#include "Constants.h"
+#include "tinyxml2.h"
+
+/* LevelDescription
+ *
+ * Everything a level file says, read from the xml in a single parse. Positions are already
+ * shifted by the map offset, so they're relative to the room but not yet placed in the world.
+ * Walls come ordered by row, which is the order the room builds them in.
+ *
+ * load() reads a file the first time it's asked for and hands back the same description
+ * every time after, so however many rooms use a level it's only read once a session.
+ *
+ * With CACHE_LEVELS on, each level is also compiled to a <name>.lvl: fixed size records for
+ * every wall, floor, exit, spawn, cube and crest followed by one table of all their strings.
+ * compileAll() writes them to Assets/Cache ahead of time. load() maps the one there, or the
+ * one in the CacheDirectory, and copies the records out with no parsing. It only falls back
+ * to the xml when neither binary is there, from an older format, or compiled from a different
+ * version of the xml, and then compiles it into the CacheDirectory for next time.
+ */
+class LevelDescription
+{
+	public:
+		string file;
+		bool loaded; //False if the file couldn't be read, everything else is empty then
+
+		float width;
+		float depth;
+		float mapOffsetX;
+		float mapOffsetZ;
+
+		vector<Wall> walls;
+		vector<Wall> floors;
+		vector<Wall> exits;
+		vector<Wall> spawns;
+		vector<Cube> cubes;
+		vector<Wall> crests;
+
+		//Never NULL, and stays valid for the rest of the session. Safe to call from any thread.
+		static const LevelDescription* load(const string& fileName);
+
+		//Compiles every Assets/level*.xml to its binary, returns how many were written
+		static int compileAll();
+		static vector<string> findLevelFiles();
+		//Where compileAll() puts fileName's binary
+		static string binaryFileFor(const string& fileName);
+
+		bool readXml(const string& fileName);
+		bool readBinary(const string& binaryFile, const string& sourceFile);
+		bool writeBinary(const string& binaryFile, const string& sourceFile) const;
+
+	private:
+		void parseWalls(tinyxml2::XMLElement* walls);
+		void parseCrest(tinyxml2::XMLElement* crest);
+		bool readRecords(const char* data, unsigned int size, const WIN32_FILE_ATTRIBUTE_DATA& source);
+
+		static map<string, LevelDescription> levels;
+};
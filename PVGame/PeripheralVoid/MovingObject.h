@@ -1,6 +1,10 @@
 #pragma once
 #include "GameObject.h"
+#if HEADLESS
+#include "Player.h"
+#else
 #include "PVGame.h"
+#endif
 class MovingObject : public GameObject
 {
 public:
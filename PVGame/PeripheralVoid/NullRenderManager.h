@@ -0,0 +1,51 @@
+#ifndef RENDER_MANAGER
+#define RENDER_MANAGER
+
+#include "Constants.h"
+#include "PhysicsManager.h"
+
+/* RenderManager
+ *
+ * Stands in for the Direct3D RenderManager in the headless build. Only the calls the game
+ * logic makes are here, lights are counted so crests get the same indices they would in
+ * the game but nothing is ever drawn.
+ */
+class RenderManager
+{
+	public:
+		static RenderManager& getInstance()
+		{
+			static RenderManager instance;
+			return instance;
+		}
+
+		float AspectRatio() const
+		{
+			return 1280.0f / 800.0f;
+		}
+
+		//Returns the index of the newly created light for crests to manage.
+		int CreateLight(XMFLOAT4 ambientLight, XMFLOAT4 diffuseLight, XMFLOAT4 specularLight, float range, XMFLOAT3 pos, XMFLOAT3 attenuation)
+		{
+			if(numLights < MAX_LIGHTS)
+				return numLights++;
+			return -1;
+		}
+
+		int getNumLights()
+		{
+			return numLights;
+		}
+
+		void EnableLight(int index) {}
+		void DisableLight(int index) {}
+		void SetLightPosition(int index, btVector3* targetV3) {}
+
+	private:
+		RenderManager() : numLights(0) {}
+		RenderManager(RenderManager const&);
+		void operator=(RenderManager const&);
+
+		int numLights;
+};
+#endif
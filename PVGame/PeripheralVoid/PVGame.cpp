@@ -1,7 +1,100 @@
 #include "PVGame.h"
+#include "PhysicsBenchmark.h"
+#include "AllocationTracker.h"
+#include <algorithm>
 
 map<string, MeshData>MeshMaps::MESH_MAPS = MeshMaps::create_map();
 
+//Returns the word after flag on the command line, or an empty string if flag isn't there
+static string GetArgument(const char* args, const char* flag)
+{
+	const char* found = strstr(args, flag);
+	if(found == NULL)
+		return "";
+
+	found += strlen(flag);
+	while(*found == ' ')
+		found++;
+
+	const char* end = found;
+	while(*end != ' ' && *end != '\0')
+		end++;
+	return string(found, end);
+}
+
+/* RunInstanceBenchmark()
+ *
+ * Draws a grid of cubes and spheres through the instanced renderer from the player's camera
+ * and writes how long each DrawScene takes as csv, along with how many allocations it made
+ * when TRACK_ALLOCATIONS is on. Only call it after Init(), and in place of Run(), the instance
+ * buffers are left holding the grid.
+ *
+ * param: objectCount - how many instances make up the grid
+ * param: frames      - how many frames to draw
+ * param: fileName    - where the csv goes
+ */
+void PVGame::RunInstanceBenchmark(int objectCount, int frames, string fileName)
+{
+	Camera* camera = player->GetCamera();
+
+	ofstream csv(fileName.c_str());
+	#if TRACK_ALLOCATIONS
+	csv << "frame,instances,ms,allocations" << endl;
+	#else
+	csv << "frame,instances,ms" << endl;
+	#endif
+
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+
+	vector<GameObject*> objects;
+	objects.reserve(objectCount);
+	int side = (int)sqrt((float)objectCount) + 1;
+	for(int i = 0; i < objectCount; i++)
+	{
+		XMMATRIX world = XMMatrixTranslation((float)(i % side) * 2.0f, 0.0f, (float)(i / side) * 2.0f);
+		objects.push_back(new GameObject(i % 2 ? "Sphere" : "Cube", i % 2 ? "Wood" : "Wall", &world, NULL));
+	}
+	SortByMesh(objects);
+	renderMan->BuildInstancedBuffer(objects);
+
+	//Draw once first so map entries and buffers that are made on first use aren't counted
+	renderMan->DrawScene(camera, objects);
+	#if TRACK_ALLOCATIONS
+	AllocationTracker::endFrame();
+	#endif
+
+	double totalMs = 0.0;
+	double totalAllocations = 0.0;
+	for(int frame = 0; frame < frames; frame++)
+	{
+		LARGE_INTEGER start, end;
+		QueryPerformanceCounter(&start);
+		renderMan->DrawScene(camera, objects);
+		QueryPerformanceCounter(&end);
+
+		double ms = (double)(end.QuadPart - start.QuadPart) * 1000.0 / (double)frequency.QuadPart;
+		csv << frame << "," << objectCount << "," << ms;
+		totalMs += ms;
+
+		#if TRACK_ALLOCATIONS
+		AllocationTracker::endFrame();
+		int allocations = AllocationTracker::getLastFrameAllocations();
+		csv << "," << allocations;
+		totalAllocations += allocations;
+		#endif
+		csv << endl;
+	}
+	#if TRACK_ALLOCATIONS
+	DBOUT("Instance benchmark: " << objectCount << " instances, " << totalMs / frames << " ms and " << totalAllocations / frames << " allocations per frame");
+	#else
+	DBOUT("Instance benchmark: " << objectCount << " instances, " << totalMs / frames << " ms per frame");
+	#endif
+
+	for(unsigned int i = 0; i < objects.size(); i++)
+		delete objects[i];
+}
+
 PVGame::PVGame(HINSTANCE hInstance)
 	: D3DApp(hInstance)
 {
@@ -18,6 +111,7 @@ PVGame::PVGame(HINSTANCE hInstance)
 
 PVGame::~PVGame(void)
 {
+	physicsMan->syncStep();
 	delete player;
 	
 	for (unsigned int i = 0; i < proceduralGameObjects.size(); ++i)
@@ -28,11 +122,12 @@ PVGame::~PVGame(void)
 	gameObjects.clear();
 	proceduralGameObjects.clear();
 	
-	ClearRooms();	
+	delete rooms;
 
 	alcDestroyContext(audioContext);
     alcCloseDevice(audioDevice);
 	delete physicsMan;
+	delete culler;
 	delete audioSource;
 	delete audioWin;
 	//OCULUS RIFT
@@ -81,6 +176,8 @@ bool PVGame::Init(char * args)
 	const enum GAME_STATE { MENU, OPTION, PLAYING, END, INSTRUCTIONS };
 
 	physicsMan = new PhysicsManager();
+	culler = new FrustumCuller();
+	rooms = new RoomSet(physicsMan, &gameObjects, this);
 	player = new Player(physicsMan, renderMan, riftMan);
 	
 	//Test load a cube.obj
@@ -120,6 +217,7 @@ bool PVGame::Init(char * args)
 	SortGameObjects();
 
 	renderMan->BuildInstancedBuffer(gameObjects);
+	culler->build(gameObjects);
 
 	audioSource = new AudioSource();
 	audioSource->initialize("Audio\\HomeSweetHome.wav", AudioSource::WAV);
@@ -131,6 +229,54 @@ bool PVGame::Init(char * args)
 	ReadOptions();
 	ApplyOptions();
 
+	//-record file saves every frame's input, -replay file plays it back and times each frame.
+	//Replays step at the fixed physics rate unless -variabledt asks for the recorded timesteps
+	string inputLog = GetArgument(args, "-record");
+	if(!inputLog.empty())
+	{
+		inputRecorder = new InputRecorder();
+		if(!inputRecorder->record(inputLog))
+		{
+			DBOUT("Could not record to " << inputLog.c_str());
+			delete inputRecorder;
+			inputRecorder = NULL;
+		}
+	}
+	inputLog = GetArgument(args, "-replay");
+	if(!inputLog.empty() && inputRecorder == NULL)
+	{
+		inputRecorder = new InputRecorder();
+		float fixedDt = strstr(args, "-variabledt") != NULL ? 0.0f : 1.0f / PHYSICS_STEP_RATE;
+		if(!inputRecorder->replay(inputLog, fixedDt))
+		{
+			DBOUT("Could not replay " << inputLog.c_str());
+			delete inputRecorder;
+			inputRecorder = NULL;
+		}
+	}
+
+	//Rooms have to stream in on the same frames in a recording and its replay
+	if(inputRecorder != NULL)
+		rooms->getStreamer()->setBlocking(true);
+
+	#if USE_PROFILER
+	string profileFile = GetArgument(args, "-profile");
+	if(!profileFile.empty() && !Profiler::open(profileFile))
+		DBOUT("Could not open " << profileFile.c_str());
+	#endif
+
+	string streamReport = GetArgument(args, "-streamreport");
+	if(!streamReport.empty() && !rooms->getStreamer()->openReport(streamReport))
+		DBOUT("Could not open " << streamReport.c_str());
+
+	#if TRACK_ALLOCATIONS
+	string allocationReport = GetArgument(args, "-allocreport");
+	if(!allocationReport.empty() && !AllocationTracker::openReport(allocationReport))
+		DBOUT("Could not open " << allocationReport.c_str());
+	if(strstr(args, "-allocassert") != NULL)
+		AllocationTracker::setBudget(ALLOC_FRAME_BUDGET);
+	#endif
+
 	return true;
 }
 
@@ -213,12 +359,8 @@ bool PVGame::LoadXML()
 
 	#pragma region Map Loading
 
-	Room* startRoom = new Room(MAP_LEVEL_1, physicsMan, 0, 0);
-	startRoom->loadRoom();
-	currentRoom = startRoom;
-
 	//Get the filename from constants, hand it into tinyxml
-	BuildRooms(currentRoom, "NOLOAD");
+	rooms->load(MAP_LEVEL_1, 0, 0, "NOLOAD");
 
 	SpawnPlayer();
 	#pragma endregion
@@ -255,6 +397,7 @@ bool PVGame::LoadXML()
 void PVGame::OnResize()
 {
 	D3DApp::OnResize();
+	physicsMan->syncStep(); //The camera rebuilds its frustum object in the world
 	player->OnResize(AspectRatio());
 
 	//For menu stuff
@@ -274,18 +417,7 @@ void PVGame::OnResize()
 
 void PVGame::SpawnPlayer()
 {
-	if(currentRoom)
-	{
-		player->setPosition((currentRoom->getX() + currentRoom->getSpawn()->centerX), currentRoom->getSpawn()->centerY + 4, (currentRoom->getZ() + currentRoom->getSpawn()->centerZ));
-		if(currentRoom->getSpawn()->direction.compare("up") == 0)
-			player->setRotation(3.14f/2.0f);
-		else if(currentRoom->getSpawn()->direction.compare("left") == 0)
-			player->setRotation(3.14f);
-		else if(currentRoom->getSpawn()->direction.compare("down") == 0)
-			player->setRotation((3.0f*3.14f)/2.0f);
-		else if(currentRoom->getSpawn()->direction.compare("right") == 0)
-			player->setRotation(3.14f *2.0f);
-	}
+	rooms->spawnPlayer(player);
 }
 #pragma region Awful use of variables courtesy of Jason
 bool is1Up = true;
@@ -295,6 +427,19 @@ bool isEUp = true;
 #pragma endregion
 void PVGame::UpdateScene(float dt)
 {
+	PROFILE("Update Scene");
+	#if TRACK_ALLOCATIONS
+	AllocationTracker::setSteadyState(gameState == PLAYING);
+	#endif
+
+	//Wait for the physics thread, if there is one, before anything touches the world
+	physicsMan->syncStep();
+
+	#if STREAM_ROOMS
+	if(rooms->stream())
+		culler->build(gameObjects);
+	#endif
+
 	#pragma region General Controls
 	if(input->wasKeyPressed('P') || input->wasKeyPressed('p'))
 	{
@@ -351,8 +496,8 @@ void PVGame::UpdateScene(float dt)
 	#pragma region Playing
 	case PLAYING:
 
-		if(currentRoom)
-			curRoomStr = currentRoom->getMapFile();
+		if(rooms->getCurrentRoom())
+			curRoomStr = rooms->getCurrentRoom()->getMapFile();
 
 		if(audioSource->isPlaying())
 		{
@@ -365,24 +510,25 @@ void PVGame::UpdateScene(float dt)
 		if (player->getWinPercent() >= 0.99f)
 		{
 			player->resetWinPercent();
+			Room* currentRoom = rooms->getCurrentRoom();
 			
 			if(currentRoom->getExits().size() == 1)
 			{
-				currentRoom = loadedRooms[0];
+				rooms->setCurrentRoom(rooms->getStartRoom());
 				SpawnPlayer();
 				gameState = END;
 			}
 			else if(currentRoom->getExits().size() == 2) //Go to Next Area
 			{
 				//Load Last room
-				char* map = (char*)malloc(sizeof(char) * (currentRoom->getExits()[0]->file.length()) + 1);
-				strcpy(map, currentRoom->getExits()[0]->file.c_str());
+				char* map = (char*)malloc(sizeof(char) * (currentRoom->getExits()[0].file.length()) + 1);
+				strcpy(map, currentRoom->getExits()[0].file.c_str());
 				int index = 0;
 				for(int i = 0; i < currentRoom->getExits().size(); i++)
 				{
-					if(strcmp(map, currentRoom->getExits()[i]->file.c_str()) < 0)
+					if(strcmp(map, currentRoom->getExits()[i].file.c_str()) < 0)
 					{
-						strcpy(map, currentRoom->getExits()[i]->file.c_str());
+						strcpy(map, currentRoom->getExits()[i].file.c_str());
 						index = i;
 					}
 				}
@@ -390,11 +536,10 @@ void PVGame::UpdateScene(float dt)
 				char* curRoom = (char*)malloc(sizeof(char) * (strlen(currentRoom->getMapFile()) + 1));
 				strcpy(curRoom, currentRoom->getMapFile());
 
-				int xOffset = currentRoom->getExits()[index]->centerX;
-				int zOffset = currentRoom->getExits()[index]->centerZ;
+				int xOffset = currentRoom->getExits()[index].centerX;
+				int zOffset = currentRoom->getExits()[index].centerZ;
 
-				ClearRooms();	
-				loadedRooms.clear();
+				rooms->clear();
 	
 				for (unsigned int i = 0; i < proceduralGameObjects.size(); ++i)
 				{
@@ -404,16 +549,14 @@ void PVGame::UpdateScene(float dt)
 				gameObjects.clear();
 				proceduralGameObjects.clear();
 				
-				Room* startRoom = new Room(map, physicsMan, xOffset, zOffset);
-				startRoom->loadRoom();
-				currentRoom = startRoom;
-				BuildRooms(currentRoom, curRoom);
+				rooms->load(map, xOffset, zOffset, curRoom);
 
 				SpawnPlayer();
 
 				delete[] curRoom;
 				SortGameObjects();
 				renderMan->BuildInstancedBuffer(gameObjects);
+				culler->build(gameObjects);
 			}
 			return;
 		}
@@ -456,37 +599,18 @@ void PVGame::UpdateScene(float dt)
 		#pragma endregion
 
 		#pragma region Physics for Worlds Game Objects
-		// If physics updated, tell the game objects to update their world matrix.
-		if (physicsMan->update(dt))
-		{
-			for (unsigned int i = 0; i < gameObjects.size(); ++i)
-			{
-				gameObjects[i]->Update();
-				/* //Should delete objects below -20. Doesn't work 'well' or 'at all'
-				if(gameObjects[i]->getRigidBody()->getWorldTransform().getOrigin().getY() < -20)
-				{
-				gameObjects.erase(gameObjects.begin() += i);
-
-				SortGameObjects();
-				}*/
-			}
-		}
+		// Motion states of awake bodies are interpolated every frame, even when no step was taken.
+		// Only the game objects whose motion state changed update their world matrix.
+		physicsMan->update(dt);
+		physicsMan->updateMovedObjects();
 		#pragma endregion
 
 		#if USE_FRUSTUM_CULLING
-			player->GetCamera()->frustumCull();
+			player->GetCamera()->frustumCull(culler);
 		#endif
 
 		#pragma region Player Room Tracking and Resetting to Checkpoints
-		for (unsigned int i = 0; i < loadedRooms.size(); i++)
-		{
-			if ((player->getPosition().x > loadedRooms[i]->getX()) && (player->getPosition().x < (loadedRooms[i]->getX() + loadedRooms[i]->getWidth())) &&
-				(player->getPosition().z > loadedRooms[i]->getZ()) && (player->getPosition().z < (loadedRooms[i]->getZ() + loadedRooms[i]->getDepth())))
-			{
-					currentRoom = loadedRooms[i];
-					break;
-			}
-		}
+		rooms->trackPlayer(player);
 
 		//If the player falls of the edge of the world, respawn in current room
 		if(devMode)
@@ -517,74 +641,7 @@ void PVGame::UpdateScene(float dt)
 		// Reset blur, we only do it if a single Medusa is in sight.
 		renderMan->RemovePostProcessingEffect(BlurEffect);
 
-		for(unsigned int i = 0; i < gameObjects.size(); i++)
-		{
-			if(gameObjects[i]->GetVisionAffected())
-			{	
-				//If it is a crest
-					//And if it is colliding
-				if(MovingObject* currentMovObj = dynamic_cast<MovingObject*>(gameObjects[i]))
-				{
-					currentMovObj->Update();
-				}
-
-				if(Crest* currentCrest = dynamic_cast<Crest*>(gameObjects[i]))
-				{
-					if(physicsMan->broadPhase(player->GetCamera(), gameObjects[i]) && physicsMan->narrowPhase(player->GetCamera(), gameObjects[i]))
-					{
-						currentCrest->ChangeView(true);
-
-						// For now, only Medusa causes blur effect.
-						if (currentCrest->GetCrestType() == MEDUSA && player->getController()->onGround())
-						{
-							renderMan->SetBlurColor(XMFLOAT4(0.0f, 0.25f, 0.0f, 1.0f));
-							renderMan->AddPostProcessingEffect(BlurEffect);
-						}
-
-						if (currentCrest->GetCrestType() == WIN)
-						{
-							audioWin->setPosition(player->getPosition().x, player->getPosition().y, player->getPosition().z);
-							if(!audioWin->isPlaying())
-								audioWin->play();
-							renderMan->SetBlurColor(XMFLOAT4(0.99f * player->getWinPercent(), 0.99f * player->getWinPercent(), 0.0f, 1.0f));
-							renderMan->AddPostProcessingEffect(BlurEffect);
-						}
-
-					}
-					else
-					{
-						currentCrest->ChangeView(false);
-
-						// If Medusa is out of sight, remove blur. Overrides manual blur add - comment out to require manual toggle on/off.
-						if (currentCrest->GetCrestType() == MEDUSA)
-						{
-							//renderMan->RemovePostProcessingEffect(BlurEffect);
-						}
-
-						if (currentCrest->GetCrestType() == WIN)
-						{
-							//renderMan->RemovePostProcessingEffect(BlurEffect);
-						}
-					}
-					currentCrest->Update(player);
-				}
-
-				/*if(Turret* currentTurret = dynamic_cast<Turret*>(gameObjects[i]))
-				{
-					//btVector3 turretPos = gameObjects[i]->getRigidBody()->getCenterOfMassPosition();
-
-					if(physicsMan->broadPhase(player->GetCamera(), gameObjects[i]) && physicsMan->narrowPhase(player->GetCamera(), gameObjects[i]))
-					{
-						currentTurret->ChangeView(true);
-					}
-					else
-					{
-						currentTurret->ChangeView(false);
-					}
-					currentTurret->Update(player);
-				}*/
-			}
-		}
+		rooms->updateVisionAffected(player);
 		#pragma endregion
 
 		if(devMode)
@@ -601,8 +658,9 @@ void PVGame::UpdateScene(float dt)
 				crestObj->SetTexScale(0.0f, 0.0f, 0.0f, 0.0f);
 				gameObjects.push_back(crestObj);
 				proceduralGameObjects.push_back(crestObj);
-				SortGameObjects();
-				renderMan->BuildInstancedBuffer(gameObjects);
+				renderMan->AddInstance(crestObj);
+				if(!culler->add(crestObj))
+					culler->build(gameObjects);
 			}
 			if(input->wasKeyPressed('4'))
 			{
@@ -614,8 +672,9 @@ void PVGame::UpdateScene(float dt)
 				crestObj->setLinearVelocity(look.x * speed, look.y * speed, look.z * speed);
 				gameObjects.push_back(crestObj);
 				proceduralGameObjects.push_back(crestObj);
-				SortGameObjects();
-				renderMan->BuildInstancedBuffer(gameObjects);
+				renderMan->AddInstance(crestObj);
+				if(!culler->add(crestObj))
+					culler->build(gameObjects);
 			}
 			if(input->wasKeyPressed('5'))
 			{
@@ -628,8 +687,9 @@ void PVGame::UpdateScene(float dt)
 				crestObj->SetTexScale(2.0f, 2.0f, 0.0f, 1.0f);
 				crestObj->setLinearVelocity(look.x * speed, look.y * speed, look.z * speed);
 				gameObjects.push_back(crestObj);
-				SortGameObjects();
-				renderMan->BuildInstancedBuffer(gameObjects);
+				renderMan->AddInstance(crestObj);
+				if(!culler->add(crestObj))
+					culler->build(gameObjects);
 			}
 			if(input->wasKeyPressed('9'))
 			{
@@ -642,8 +702,9 @@ void PVGame::UpdateScene(float dt)
 				crestObj->SetTexScale(0.0f, 0.0f, 0.0f, 0.0f);
 				gameObjects.push_back(crestObj);
 				proceduralGameObjects.push_back(crestObj);
-				SortGameObjects();
-				renderMan->BuildInstancedBuffer(gameObjects);
+				renderMan->AddInstance(crestObj);
+				if(!culler->add(crestObj))
+					culler->build(gameObjects);
 			}
 			#pragma endregion
 
@@ -663,8 +724,9 @@ void PVGame::UpdateScene(float dt)
 				testSphere->playAudio();
 				gameObjects.push_back(testSphere);
 				proceduralGameObjects.push_back(testSphere);
-				SortGameObjects();
-				renderMan->BuildInstancedBuffer(gameObjects);
+				renderMan->AddInstance(testSphere);
+				if(!culler->add(testSphere))
+					culler->build(gameObjects);
 				is1Up = false;
 			}
 			else if(!input->isKeyDown('1') && !input->getGamepadLeftTrigger(0))
@@ -685,8 +747,9 @@ void PVGame::UpdateScene(float dt)
 				//testSphere->playAudio();
 				gameObjects.push_back(testSphere);
 				proceduralGameObjects.push_back(testSphere);
-				SortGameObjects();
-				renderMan->BuildInstancedBuffer(gameObjects);
+				renderMan->AddInstance(testSphere);
+				if(!culler->add(testSphere))
+					culler->build(gameObjects);
 				is2Up = false;
 			}
 			else if(!input->isKeyDown('2') && !input->getGamepadRightTrigger(0))
@@ -707,8 +770,9 @@ void PVGame::UpdateScene(float dt)
 				//testSphere->playAudio();
 				gameObjects.push_back(testSphere);
 				proceduralGameObjects.push_back(testSphere);
-				SortGameObjects();
-				renderMan->BuildInstancedBuffer(gameObjects);
+				renderMan->AddInstance(testSphere);
+				if(!culler->add(testSphere))
+					culler->build(gameObjects);
 				is8Up = false;
 			}
 			else if(!input->isKeyDown('8'))
@@ -729,8 +793,9 @@ void PVGame::UpdateScene(float dt)
 				testSphere->playAudio();
 				gameObjects.push_back(testSphere);
 				proceduralGameObjects.push_back(testSphere);
-				SortGameObjects();
-				renderMan->BuildInstancedBuffer(gameObjects);
+				renderMan->AddInstance(testSphere);
+				if(!culler->add(testSphere))
+					culler->build(gameObjects);
 				isEUp = false;
 			}
 			else if(!input->isKeyDown('E'))
@@ -740,14 +805,15 @@ void PVGame::UpdateScene(float dt)
 			#pragma region Level Controls U and I
 			if (input->wasKeyPressed('U'))
 			{
+				const vector<Room*>& loadedRooms = rooms->getLoadedRooms();
 				for (unsigned int i = 0; i < loadedRooms.size(); i++)
 				{
-					if (strcmp(currentRoom->getFile(), loadedRooms[i]->getFile()) == 0)
+					if (strcmp(rooms->getCurrentRoom()->getFile(), loadedRooms[i]->getFile()) == 0)
 					{
 						if (i > 0)
-							currentRoom = loadedRooms[i - 1];
+							rooms->setCurrentRoom(loadedRooms[i - 1]);
 						else
-							currentRoom = loadedRooms[loadedRooms.size() - 1];
+							rooms->setCurrentRoom(loadedRooms[loadedRooms.size() - 1]);
 
 						SpawnPlayer();
 						break;
@@ -756,14 +822,15 @@ void PVGame::UpdateScene(float dt)
 			}
 			if (input->wasKeyPressed('I'))
 			{
+				const vector<Room*>& loadedRooms = rooms->getLoadedRooms();
 				for (unsigned int i = 0; i < loadedRooms.size(); i++)
 				{
-					if (strcmp(currentRoom->getFile(), loadedRooms[i]->getFile()) == 0)
+					if (strcmp(rooms->getCurrentRoom()->getFile(), loadedRooms[i]->getFile()) == 0)
 					{
 						if (i < (loadedRooms.size() - 1))
-							currentRoom = loadedRooms[i + 1];
+							rooms->setCurrentRoom(loadedRooms[i + 1]);
 						else
-							currentRoom = loadedRooms[0];
+							rooms->setCurrentRoom(loadedRooms[0]);
 
 						SpawnPlayer();
 						break;
@@ -773,7 +840,7 @@ void PVGame::UpdateScene(float dt)
 			#pragma endregion
 		}
 		#if USE_FRUSTUM_CULLING
-		player->GetCamera()->frustumCull();
+		player->GetCamera()->frustumCull(culler);
 		#endif
 		break;
 	#pragma endregion
@@ -1060,6 +1127,7 @@ void PVGame::ResetRoomToStart()
 //////////////////////////////////////////////////////
 void PVGame::SaveCurrentRoom()
 {
+	Room* currentRoom = rooms->getCurrentRoom();
 	if(currentRoom)
 	{
 		tinyxml2::XMLDocument doc;
@@ -1101,8 +1169,7 @@ void PVGame::ReadCurrentRoom()
 	if(strcmp( std::string(map).substr(0, 6).c_str(), "Assets") != 0)
 		map = "Assets/level1.xml";
 
-	ClearRooms();	
-	loadedRooms.clear();
+	rooms->clear();
 	
 	for (unsigned int i = 0; i < proceduralGameObjects.size(); ++i)
 	{
@@ -1112,14 +1179,12 @@ void PVGame::ReadCurrentRoom()
 	gameObjects.clear();
 	proceduralGameObjects.clear();
 				
-	Room* startRoom = new Room(map, physicsMan, 0, 0);
-	startRoom->loadRoom();
-	currentRoom = startRoom;
-	BuildRooms(currentRoom, "LOADALL");
+	rooms->load(map, 0, 0, "LOADALL");
 				
 	SpawnPlayer();
 	SortGameObjects();
 	renderMan->BuildInstancedBuffer(gameObjects);
+	culler->build(gameObjects);
 }
 
 ////////////////////////////////////////////////////////////
@@ -1303,6 +1368,11 @@ void PVGame::SetMenuColors()
 
 void PVGame::DrawScene()
 {	
+	PROFILE("Draw Scene");
+
+	//The game is done with the world for this frame, let the physics thread step while we draw
+	physicsMan->startStep();
+
 	switch(gameState)
 	{
 	#pragma region MENU
@@ -1607,55 +1677,42 @@ void PVGame::BuildVertexLayout()
 	renderMan->BuildVertexLayout();
 }
 
-void PVGame::BuildRooms(Room* startRoom, const char* dontLoadRoom)
+// Streamed rooms only, the ones RoomSet::load() adds go in with the rest of the scene
+void PVGame::roomLoaded(Room* room)
 {
-	bool isLoaded = false;
-
-	for (unsigned int i = 0; i < loadedRooms.size(); i++)
-	{
-		if (strcmp(loadedRooms[i]->getFile(), startRoom->getFile()) == 0)
-		{
-			isLoaded = true;
-		}
-	}
-
-	if (!isLoaded && strcmp(startRoom->getMapFile(), dontLoadRoom) != 0)
-	{
-		for (unsigned int i = 0; i < startRoom->getGameObjs().size(); i++)
-		{
-			gameObjects.push_back(startRoom->getGameObjs()[i]);
-		}
-		
-		if(!startRoom->hasWinCrest())
-			startRoom->loadNeighbors(loadedRooms);
-
-		loadedRooms.push_back(startRoom);
+	for (unsigned int i = 0; i < room->getGameObjs().size(); i++)
+		renderMan->AddInstance(room->getGameObjs()[i]);
+}
 
-		for (unsigned int i = 0; i < startRoom->getNeighbors().size(); i++)
-		{
-			BuildRooms(startRoom->getNeighbors()[i], dontLoadRoom);
-		}
-	}
+void PVGame::roomUnloading(Room* room)
+{
+	for (unsigned int i = 0; i < room->getGameObjs().size(); i++)
+		renderMan->RemoveInstance(room->getGameObjs()[i]);
 }
 
-void PVGame::ClearRooms()
+void PVGame::crestInView(Crest* crest)
 {
-	for (unsigned int i = 0; i < loadedRooms.size(); i++)
+	// For now, only Medusa causes blur effect.
+	if (crest->GetCrestType() == MEDUSA && player->getController()->onGround())
 	{
-		for (unsigned int j = 0; j < loadedRooms[i]->getNeighbors().size(); j++)
-		{
-			loadedRooms[i]->getNeighbors()[j] = NULL;
-		}
+		renderMan->SetBlurColor(XMFLOAT4(0.0f, 0.25f, 0.0f, 1.0f));
+		renderMan->AddPostProcessingEffect(BlurEffect);
+	}
 
-		delete loadedRooms[i];
+	if (crest->GetCrestType() == WIN)
+	{
+		audioWin->setPosition(player->getPosition().x, player->getPosition().y, player->getPosition().z);
+		if(!audioWin->isPlaying())
+			audioWin->play();
+		renderMan->SetBlurColor(XMFLOAT4(0.99f * player->getWinPercent(), 0.99f * player->getWinPercent(), 0.0f, 1.0f));
+		renderMan->AddPostProcessingEffect(BlurEffect);
 	}
 }
 
-// Sorts game objects based on mesh key. Should only be called after a batch of GameObjects are added.
+// Sorts game objects based on mesh handle, so DrawScene fills in each mesh's instances together. Only worth it after a whole scene is loaded.
 void PVGame::SortGameObjects()
 {
-	// GameObjectCompaper() is defined in GameObject.h for now. It's a boolean operator.
-	sort(gameObjects.begin(), gameObjects.end(), GameObjectComparer());
+	SortByMesh(gameObjects);
 }
 
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance, PSTR cmdLine, int showCmd)
@@ -1665,10 +1722,59 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE prevInstance, PSTR cmdLine, in
 		_CrtSetDbgFlag( _CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF );
 	#endif
 
+	#if TRACK_ALLOCATIONS
+	AllocationTracker::install();
+	#endif
+
+	//Time the physics alone without opening a window
+	if(strstr(cmdLine, "-physicsbenchmark") != NULL)
+	{
+		RunPhysicsBenchmark(PHYSICS_WORKER_COUNT, 500, 600, "physics_benchmark.csv");
+		return 0;
+	}
+	if(strstr(cmdLine, "-cullingbenchmark") != NULL)
+	{
+		RunCullingBenchmark(2500, 600, "culling_benchmark.csv");
+		return 0;
+	}
+	if(strstr(cmdLine, "-visibilitybenchmark") != NULL)
+	{
+		RunVisibilityBenchmark(1024, 600, "visibility_benchmark.csv");
+		return 0;
+	}
+	if(strstr(cmdLine, "-levelbenchmark") != NULL)
+	{
+		RunLevelBenchmark(20, "level_benchmark.csv");
+		return 0;
+	}
+	if(strstr(cmdLine, "-spawnbenchmark") != NULL)
+	{
+		return RunSpawnBenchmark(5000, 200, "spawn_benchmark.csv") ? 0 : 1;
+	}
+
+	//Rebuild Assets/Cache/*.lvl from the level xml, say before shipping
+	if(strstr(cmdLine, "-compilelevels") != NULL)
+	{
+		LevelDescription::compileAll();
+		return 0;
+	}
+
 	PVGame theApp(hInstance);
 
 	if (!theApp.Init(cmdLine))
 		return 0;
 
+	//The models and the renderer only exist once the game is set up, so these run instead of the game loop
+	if(strstr(cmdLine, "-hullbenchmark") != NULL)
+	{
+		RunHullBenchmark("boat", 300, 600, "hull_benchmark.csv");
+		return 0;
+	}
+	if(strstr(cmdLine, "-instancebenchmark") != NULL)
+	{
+		theApp.RunInstanceBenchmark(2000, 600, "instance_benchmark.csv");
+		return 0;
+	}
+
 	return theApp.Run();
 }
\ No newline at end of file
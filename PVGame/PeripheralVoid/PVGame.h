@@ -11,7 +11,8 @@
 #include "tinyxml2.h"
 #include "FileLoader.h"
 #include "GameObject.h"
-#include "Room.h"
+#include "RoomSet.h"
+#include "FrustumCuller.h"
 #include "Audio/AL/al.h"
 #include "Audio/AL/alc.h"
 #include <vector>
@@ -19,13 +20,14 @@
 
 using namespace tinyxml2;
 
-class PVGame : public D3DApp
+class PVGame : public D3DApp, public RoomSetListener
 {
 public:
 		PVGame(HINSTANCE hInstance);
 		virtual ~PVGame(void);
 
 		bool Init(char* args);
+		void RunInstanceBenchmark(int objectCount, int frames, string fileName);
 		bool LoadContent();
 		bool LoadXML();
 		void OnResize();
@@ -47,16 +49,17 @@ public:
 		void ResetRoomToStart();
 
 		void SpawnPlayer();
+
+		void roomLoaded(Room* room);
+		void roomUnloading(Room* room);
+		void crestInView(Crest* crest);
 	private:
 		void BuildFX();
 		void BuildVertexLayout();
-		void BuildRooms(Room* startRoom, const char* dontLoadRoom);
-		void ClearRooms();
 		void SortGameObjects();
 
 		bool devMode;
 		Player*	player;
-		Room* currentRoom;
 		int selector;
 
 		float mTheta;
@@ -80,9 +83,10 @@ public:
 
 		unsigned int gameState;
 		PhysicsManager* physicsMan;
+		FrustumCuller* culler;
 		vector<GameObject*> gameObjects;
 		vector<GameObject*> proceduralGameObjects;
-		vector<Room*> loadedRooms;
+		RoomSet* rooms;
 
 		ALCdevice* audioDevice;
 		ALCcontext* audioContext;
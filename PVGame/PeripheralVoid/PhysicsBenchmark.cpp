@@ -0,0 +1,539 @@
+#include "PhysicsBenchmark.h"
+#include <fstream>
+
+//Widest a body of handle gets along any axis at this scale, measured off the shape the manager really makes for it
+static btScalar BodySize(PhysicsManager* physicsMan, string handle, float scale)
+{
+	btRigidBody* probe = physicsMan->createRigidBody(handle, 0.0f, 0.0f, 0.0f, scale, scale, scale, 1.0f);
+	btTransform identity;
+	identity.setIdentity();
+	btVector3 min, max;
+	probe->getCollisionShape()->getAabb(identity, min, max);
+
+	physicsMan->addRigidBodyToWorld(probe, COL_DEFAULT);
+	physicsMan->removeRigidBodyFromWorld(probe);
+
+	btVector3 size = max - min;
+	return size[size.maxAxis()];
+}
+
+void RunPhysicsBenchmark(int maxWorkers, int bodyCount, int frames, string fileName)
+{
+	ofstream csv(fileName.c_str());
+	csv << "workers,bodies,frames,total ms,ms per frame,peak bodies,body chunks,peak motion states,motion state chunks,peak shapes,shape chunks" << endl;
+
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+
+	#if !USE_PARALLEL_PHYSICS
+	//Every worker count steps sequentially without the parallel dispatcher, so one row says it all
+	maxWorkers = 1;
+	#endif
+
+	for(int workers = 1; workers <= maxWorkers; workers++)
+	{
+		PhysicsManager* physicsMan = new PhysicsManager(workers);
+
+		//Only the shapes the scene uses need cooking
+		physicsMan->addTriangleMesh("Cube", MeshMaps::MESH_MAPS["Cube"]);
+		physicsMan->addTriangleMesh("Sphere", MeshMaps::MESH_MAPS["Sphere"]);
+
+		vector<btRigidBody*> bodies;
+		btRigidBody* floor = physicsMan->createRigidBody("Cube", 0.0f, -0.5f, 0.0f, 200.0f, 1.0f, 200.0f);
+		physicsMan->addRigidBodyToWorld(floor, COL_DEFAULT);
+		bodies.push_back(floor);
+
+		//Far enough apart that no two bodies start out touching
+		btScalar spacing = btMax(BodySize(physicsMan, "Cube", 0.5f), BodySize(physicsMan, "Sphere", 0.3f)) + 0.1f;
+
+		//Same seed every run so each worker count steps the same scene
+		srand(1337);
+		for(int i = 0; i < bodyCount; i++)
+		{
+			float x = ((float)(i % 20) - 10.0f) * spacing;
+			float y = spacing + (float)(i / 400) * spacing;
+			float z = ((float)((i / 20) % 20) - 10.0f) * spacing;
+
+			btRigidBody* body;
+			if(i % 2 == 0)
+				body = physicsMan->createRigidBody("Cube", x, y, z, 0.5f, 0.5f, 0.5f, 1.0f);
+			else
+				body = physicsMan->createRigidBody("Sphere", x, y, z, 0.3f, 0.3f, 0.3f, 1.0f);
+
+			body->setLinearVelocity(btVector3((float)(rand() % 200 - 100) * 0.05f, (float)(rand() % 100) * 0.1f, (float)(rand() % 200 - 100) * 0.05f));
+			physicsMan->addRigidBodyToWorld(body, COL_DEFAULT);
+			bodies.push_back(body);
+		}
+
+		LARGE_INTEGER start, end;
+		QueryPerformanceCounter(&start);
+		for(int frame = 0; frame < frames; frame++)
+		{
+			physicsMan->syncStep();
+			physicsMan->update(1.0f / 60.0f);
+			physicsMan->startStep();
+		}
+		physicsMan->syncStep();
+		QueryPerformanceCounter(&end);
+
+		double totalMs = (double)(end.QuadPart - start.QuadPart) * 1000.0 / (double)frequency.QuadPart;
+		csv << physicsMan->getWorkerCount() << "," << bodyCount << "," << frames << "," << totalMs << "," << totalMs / frames << ",";
+		physicsMan->writePoolStats(csv);
+		csv << endl;
+		DBOUT("Physics benchmark: " << physicsMan->getWorkerCount() << " workers, " << totalMs / frames << " ms per frame");
+
+		for(unsigned int i = 0; i < bodies.size(); i++)
+			physicsMan->removeRigidBodyFromWorld(bodies[i]);
+		delete physicsMan;
+	}
+}
+
+void RunCullingBenchmark(int objectCount, int frames, string fileName)
+{
+	ofstream csv(fileName.c_str());
+	csv << "culler,objects,frames,total ms,ms per frame,average seen" << endl;
+
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+
+	const float fovY = 0.25f * XM_PI;
+	const float aspect = 16.0f / 9.0f;
+	const float nearZ = 0.01f;
+	const float farZ = 100.0f;
+	XMMATRIX proj = XMMatrixPerspectiveFovLH(fovY, aspect, nearZ, farZ);
+
+	for(int usePlanes = 0; usePlanes < 2; usePlanes++)
+	{
+		PhysicsManager* physicsMan = new PhysicsManager(1);
+		physicsMan->addTriangleMesh("Cube", MeshMaps::MESH_MAPS["Cube"]);
+
+		//Square grid of cubes around the camera
+		vector<GameObject*> gameObjects;
+		int side = (int)sqrtf((float)objectCount);
+		for(int i = 0; i < objectCount; i++)
+		{
+			float x = ((float)(i % side) - side * 0.5f) * 3.0f;
+			float z = ((float)(i / side) - side * 0.5f) * 3.0f;
+			gameObjects.push_back(new GameObject("Cube", "Wall", physicsMan->createRigidBody("Cube", x, 0.0f, z), physicsMan, VISION_AFFECTED_COLLISION, 0.0f, true));
+		}
+
+		FrustumCuller* culler = NULL;
+		btPairCachingGhostObject* ghost = NULL;
+		if(usePlanes)
+		{
+			culler = new FrustumCuller();
+			culler->build(gameObjects);
+		}
+		else
+		{
+			//Hull of the same frustum the planes come from, looking down +z
+			float nearHeight = nearZ * tanf(0.5f * fovY);
+			float farHeight = farZ * tanf(0.5f * fovY);
+			btVector3 points[8];
+			points[0] = btVector3( nearHeight * aspect,  nearHeight, nearZ);
+			points[1] = btVector3(-nearHeight * aspect,  nearHeight, nearZ);
+			points[2] = btVector3( nearHeight * aspect, -nearHeight, nearZ);
+			points[3] = btVector3(-nearHeight * aspect, -nearHeight, nearZ);
+			points[4] = btVector3( farHeight * aspect,  farHeight, farZ);
+			points[5] = btVector3(-farHeight * aspect,  farHeight, farZ);
+			points[6] = btVector3( farHeight * aspect, -farHeight, farZ);
+			points[7] = btVector3(-farHeight * aspect, -farHeight, farZ);
+			ghost = physicsMan->makeCameraFrustumObject(points, 8);
+			physicsMan->addGhostObjectToWorld(ghost);
+		}
+
+		double totalMs = 0.0;
+		int totalSeen = 0;
+		for(int frame = 0; frame < frames; frame++)
+		{
+			float yaw = (float)frame * 0.01f;
+			XMVECTOR eye = XMVectorSet(0.0f, 1.0f, 0.0f, 1.0f);
+			XMVECTOR target = XMVectorSet(sinf(yaw), 1.0f, cosf(yaw), 1.0f);
+			XMMATRIX view = XMMatrixLookAtLH(eye, target, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+
+			LARGE_INTEGER start, end;
+			QueryPerformanceCounter(&start);
+			if(usePlanes)
+			{
+				physicsMan->update(1.0f / 60.0f);
+				culler->cull(XMMatrixMultiply(view, proj));
+			}
+			else
+			{
+				btTransform t;
+				t.setIdentity();
+				t.setOrigin(btVector3(0.0f, 1.0f, 0.0f));
+				t.setRotation(btQuaternion(btVector3(0.0f, 1.0f, 0.0f), yaw));
+				ghost->setWorldTransform(t);
+
+				physicsMan->update(1.0f / 60.0f);
+				physicsMan->frustumCulling(ghost);
+			}
+			QueryPerformanceCounter(&end);
+			totalMs += (double)(end.QuadPart - start.QuadPart) * 1000.0 / (double)frequency.QuadPart;
+
+			for(unsigned int i = 0; i < gameObjects.size(); i++)
+			{
+				if(gameObjects[i]->isSeen())
+					totalSeen++;
+			}
+		}
+
+		string name = usePlanes ? "planes" : "ghost";
+		csv << name << "," << objectCount << "," << frames << "," << totalMs << "," << totalMs / frames << "," << totalSeen / frames << endl;
+		DBOUT("Culling benchmark: " << name.c_str() << ", " << totalMs / frames << " ms per frame");
+
+		physicsMan->removeGhostObjectFromWorld(ghost); //Deletes it too, does nothing for NULL
+		delete culler;
+		for(unsigned int i = 0; i < gameObjects.size(); i++)
+			delete gameObjects[i];
+		delete physicsMan;
+	}
+}
+
+void RunHullBenchmark(string handle, int bodyCount, int frames, string fileName)
+{
+	ofstream csv(fileName.c_str());
+	csv << "hull,points,bodies,frames,collision ms per frame,step ms per frame" << endl;
+
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+
+	//Space the copies by the model's size so the pile actually touches
+	const MeshData& meshData = MeshMaps::MESH_MAPS[handle];
+	float size = 0.0f;
+	for(unsigned int i = 0; i < meshData.vertices.size(); i++)
+	{
+		size = max(size, fabs(meshData.vertices[i].Pos.x));
+		size = max(size, fabs(meshData.vertices[i].Pos.y));
+		size = max(size, fabs(meshData.vertices[i].Pos.z));
+	}
+	float spacing = size * 2.0f * GAME_SCALE * 1.05f;
+
+	for(int cooked = 0; cooked < 2; cooked++)
+	{
+		PhysicsManager* physicsMan = new PhysicsManager(1);
+		physicsMan->setHullCooking(cooked ? HULL_VERTEX_BUDGET : 0, HULL_MARGIN);
+		physicsMan->addTriangleMesh("Cube", MeshMaps::MESH_MAPS["Cube"]);
+		physicsMan->addTriangleMesh(handle, meshData);
+
+		vector<btRigidBody*> bodies;
+		btRigidBody* floor = physicsMan->createRigidBody("Cube", 0.0f, -0.5f, 0.0f, 200.0f, 1.0f, 200.0f);
+		physicsMan->addRigidBodyToWorld(floor, COL_DEFAULT);
+		bodies.push_back(floor);
+
+		//Layers of 10 by 10, kept awake so every frame runs the narrow phase
+		for(int i = 0; i < bodyCount; i++)
+		{
+			float x = ((float)(i % 10) - 5.0f) * spacing;
+			float y = spacing + (float)(i / 100) * spacing;
+			float z = ((float)((i / 10) % 10) - 5.0f) * spacing;
+
+			btRigidBody* body = physicsMan->createRigidBody(handle, x, y, z, GAME_SCALE, GAME_SCALE, GAME_SCALE, 1.0f);
+			body->setActivationState(DISABLE_DEACTIVATION);
+			physicsMan->addRigidBodyToWorld(body, COL_DEFAULT);
+			bodies.push_back(body);
+		}
+
+		//Let the pile land before timing
+		for(int frame = 0; frame < 120; frame++)
+		{
+			physicsMan->syncStep();
+			physicsMan->update(1.0f / 60.0f);
+			physicsMan->startStep();
+		}
+		physicsMan->syncStep();
+
+		double collisionMs = 0.0;
+		double stepMs = 0.0;
+		for(int frame = 0; frame < frames; frame++)
+		{
+			LARGE_INTEGER start, middle, end;
+			QueryPerformanceCounter(&start);
+			physicsMan->getWorld()->performDiscreteCollisionDetection();
+			QueryPerformanceCounter(&middle);
+			physicsMan->update(1.0f / 60.0f);
+			physicsMan->startStep();
+			physicsMan->syncStep();
+			QueryPerformanceCounter(&end);
+
+			collisionMs += (double)(middle.QuadPart - start.QuadPart) * 1000.0 / (double)frequency.QuadPart;
+			stepMs += (double)(end.QuadPart - middle.QuadPart) * 1000.0 / (double)frequency.QuadPart;
+		}
+
+		string name = cooked ? "cooked" : "triangle mesh";
+		int points = cooked ? physicsMan->getHullVertexCount(handle) : meshData.vertices.size();
+		csv << name << "," << points << "," << bodyCount << "," << frames << "," << collisionMs / frames << "," << stepMs / frames << endl;
+		DBOUT("Hull benchmark: " << name.c_str() << ", " << points << " points, " << collisionMs / frames << " ms collision per frame");
+
+		for(unsigned int i = 0; i < bodies.size(); i++)
+			physicsMan->removeRigidBodyFromWorld(bodies[i]);
+		delete physicsMan;
+	}
+}
+
+void RunLevelBenchmark(int repeats, string fileName)
+{
+	ofstream csv(fileName.c_str());
+	csv << "level,objects,xml ms,binary ms" << endl;
+
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+
+	LevelDescription::compileAll();
+	vector<string> levelFiles = LevelDescription::findLevelFiles();
+	double totalXmlMs = 0.0;
+	double totalBinaryMs = 0.0;
+	for(unsigned int i = 0; i < levelFiles.size(); i++)
+	{
+		string binaryFile = LevelDescription::binaryFileFor(levelFiles[i]);
+		int objects = 0;
+		double xmlMs = 0.0;
+		double binaryMs = 0.0;
+		for(int repeat = 0; repeat < repeats; repeat++)
+		{
+			LARGE_INTEGER start, middle, end;
+			LevelDescription fromXml, fromBinary;
+			QueryPerformanceCounter(&start);
+			fromXml.readXml(levelFiles[i]);
+			QueryPerformanceCounter(&middle);
+			fromBinary.readBinary(binaryFile, levelFiles[i]);
+			QueryPerformanceCounter(&end);
+
+			xmlMs += (double)(middle.QuadPart - start.QuadPart) * 1000.0 / (double)frequency.QuadPart;
+			binaryMs += (double)(end.QuadPart - middle.QuadPart) * 1000.0 / (double)frequency.QuadPart;
+			objects = fromBinary.walls.size() + fromBinary.floors.size() + fromBinary.exits.size() +
+				fromBinary.spawns.size() + fromBinary.cubes.size() + fromBinary.crests.size();
+		}
+
+		csv << levelFiles[i] << "," << objects << "," << xmlMs / repeats << "," << binaryMs / repeats << endl;
+		totalXmlMs += xmlMs / repeats;
+		totalBinaryMs += binaryMs / repeats;
+	}
+
+	csv << "all," << levelFiles.size() << "," << totalXmlMs << "," << totalBinaryMs << endl;
+	DBOUT("Level benchmark: " << levelFiles.size() << " levels, " << totalXmlMs << " ms from xml, " << totalBinaryMs << " ms from binary");
+}
+
+//Same lookups RenderManager::AddInstance makes, in this file's copy of the material maps
+static InstancedData MakeInstance(const GameObject* object, map<string, XMFLOAT2>& atlasCoords)
+{
+	const GameMaterial& material = GAME_MATERIALS[object->GetMaterialKey()];
+	return InstanceRegistry::makeInstance(object, material, SURFACE_MATERIALS[material.SurfaceKey], atlasCoords[material.DiffuseKey]);
+}
+
+//What a spawn cost before, sort the scene and give every object in it a new instance
+static void RebuildInstances(InstanceRegistry& registry, vector<GameObject*>& objects, map<string, XMFLOAT2>& atlasCoords)
+{
+	SortByMesh(objects);
+	registry.clear();
+	for(unsigned int i = 0; i < objects.size(); i++)
+		objects[i]->SetInstanceSlot(registry.add(objects[i]->GetMeshHandle(), MakeInstance(objects[i], atlasCoords)));
+}
+
+static GameObject* MakeSpawnObject(int i, int side)
+{
+	XMMATRIX world = XMMatrixTranslation((float)(i % side) * 2.0f, 0.0f, (float)(i / side) * 2.0f);
+	return new GameObject(i % 2 ? "Sphere" : "Cube", i % 2 ? "Wood" : "Wall", &world, NULL);
+}
+
+bool RunSpawnBenchmark(int objectCount, int spawns, string fileName)
+{
+	ofstream csv(fileName.c_str());
+	csv << "spawn,instances,rebuild ms,incremental ms,capacity grew" << endl;
+
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+
+	//Only the two materials the scene uses, the renderer would have read them from Assets
+	map<string, XMFLOAT2> atlasCoords;
+	const char* materials[2] = { "Wall", "Wood" };
+	for(int i = 0; i < 2; i++)
+	{
+		GAME_MATERIALS[materials[i]].SurfaceKey = materials[i];
+		GAME_MATERIALS[materials[i]].DiffuseKey = materials[i];
+		GAME_MATERIALS[materials[i]].GlowColor = XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f);
+		atlasCoords[materials[i]] = XMFLOAT2(0.0f, 0.0f);
+	}
+
+	int side = (int)sqrt((float)(objectCount + spawns)) + 1;
+	vector<GameObject*> scene;
+	scene.reserve(objectCount + spawns);
+	for(int i = 0; i < objectCount; i++)
+		scene.push_back(MakeSpawnObject(i, side));
+
+	vector<GameObject*> spawned;
+	for(int i = 0; i < spawns; i++)
+		spawned.push_back(MakeSpawnObject(objectCount + i, side));
+
+	InstanceRegistry registry;
+	vector<double> rebuildMs(spawns);
+	vector<double> incrementalMs(spawns);
+	vector<bool> grew(spawns);
+
+	//Rebuilding everything for each spawn
+	vector<GameObject*> objects(scene);
+	RebuildInstances(registry, objects, atlasCoords);
+	for(int i = 0; i < spawns; i++)
+	{
+		LARGE_INTEGER start, end;
+		QueryPerformanceCounter(&start);
+		objects.push_back(spawned[i]);
+		RebuildInstances(registry, objects, atlasCoords);
+		QueryPerformanceCounter(&end);
+		rebuildMs[i] = (double)(end.QuadPart - start.QuadPart) * 1000.0 / (double)frequency.QuadPart;
+	}
+
+	//Adding only the new object
+	objects = scene;
+	RebuildInstances(registry, objects, atlasCoords);
+	for(int i = 0; i < spawns; i++)
+	{
+		GameObject* object = spawned[i];
+		int capacity = registry.getCapacity(object->GetMeshHandle());
+
+		LARGE_INTEGER start, end;
+		QueryPerformanceCounter(&start);
+		objects.push_back(object);
+		object->SetInstanceSlot(registry.add(object->GetMeshHandle(), MakeInstance(object, atlasCoords)));
+		QueryPerformanceCounter(&end);
+		incrementalMs[i] = (double)(end.QuadPart - start.QuadPart) * 1000.0 / (double)frequency.QuadPart;
+		grew[i] = registry.getCapacity(object->GetMeshHandle()) != capacity;
+	}
+
+	double totalRebuildMs = 0.0;
+	double totalIncrementalMs = 0.0;
+	int grows = 0;
+	for(int i = 0; i < spawns; i++)
+	{
+		csv << i << "," << objectCount + i + 1 << "," << rebuildMs[i] << "," << incrementalMs[i] << "," << (grew[i] ? 1 : 0) << endl;
+		totalRebuildMs += rebuildMs[i];
+		totalIncrementalMs += incrementalMs[i];
+		grows += grew[i] ? 1 : 0;
+	}
+	DBOUT("Spawn benchmark: " << objectCount << " objects, " << totalRebuildMs / spawns << " ms a spawn rebuilding, " <<
+		totalIncrementalMs / spawns << " ms adding, capacity grew " << grows << " times");
+
+	//Despawning and spawning the same objects again should only reuse the freed slots
+	int meshCount = registry.getMeshCount();
+	vector<int> capacities(meshCount);
+	vector<int> liveCounts(meshCount);
+	for(int mesh = 0; mesh < meshCount; mesh++)
+	{
+		capacities[mesh] = registry.getCapacity(mesh);
+		liveCounts[mesh] = registry.getLiveCount(mesh);
+	}
+	for(int i = 0; i < spawns; i++)
+	{
+		registry.remove(spawned[i]->GetMeshHandle(), spawned[i]->GetInstanceSlot());
+		spawned[i]->SetInstanceSlot(-1);
+	}
+	for(int i = spawns - 1; i >= 0; i--)
+		spawned[i]->SetInstanceSlot(registry.add(spawned[i]->GetMeshHandle(), MakeInstance(spawned[i], atlasCoords)));
+	bool reused = true;
+	for(int mesh = 0; mesh < meshCount; mesh++)
+	{
+		if(registry.getCapacity(mesh) != capacities[mesh])
+		{
+			DBOUT("Spawn benchmark: mesh " << mesh << " grew from " << capacities[mesh] << " to " << registry.getCapacity(mesh) << " reusing freed slots");
+			reused = false;
+		}
+		if(registry.getLiveCount(mesh) != liveCounts[mesh])
+		{
+			DBOUT("Spawn benchmark: mesh " << mesh << " has " << registry.getLiveCount(mesh) << " live slots after respawning, expected " << liveCounts[mesh]);
+			reused = false;
+		}
+		if((int)registry.getInstances(mesh).size() > registry.getCapacity(mesh))
+		{
+			DBOUT("Spawn benchmark: mesh " << mesh << " handed out more slots than its capacity");
+			reused = false;
+		}
+	}
+
+	for(unsigned int i = 0; i < scene.size(); i++)
+		delete scene[i];
+	for(unsigned int i = 0; i < spawned.size(); i++)
+		delete spawned[i];
+
+	return reused;
+}
+
+void RunVisibilityBenchmark(int maxCrests, int frames, string fileName)
+{
+	ofstream csv(fileName.c_str());
+	csv << "crests,frames,batched ms per frame,one at a time ms per frame,mismatches" << endl;
+
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+
+	PhysicsManager* physicsMan = new PhysicsManager(1);
+	physicsMan->addTriangleMesh("Cube", MeshMaps::MESH_MAPS["Cube"]);
+
+	//Pillars for the rays to get blocked by, every third spot left open so some crests stay in view
+	vector<btRigidBody*> pillars;
+	const int side = 32;
+	for(int i = 0; i < side * side; i++)
+	{
+		if(i % 3 == 0)
+			continue;
+		float x = ((float)(i % side) - side * 0.5f) * 4.0f;
+		float z = ((float)(i / side) - side * 0.5f) * 4.0f;
+		btRigidBody* pillar = physicsMan->createRigidBody("Cube", x, 1.5f, z, 1.0f, 3.0f, 1.0f);
+		physicsMan->addRigidBodyToWorld(pillar, WORLD);
+		pillars.push_back(pillar);
+	}
+
+	btAlignedObjectArray<btVector3> rayTos;
+	btAlignedObjectArray<const btCollisionObject*> hits;
+	for(int crestCount = 8; crestCount <= maxCrests; crestCount *= 2)
+	{
+		//Same seed every run so each count scatters its crests the same way
+		srand(1337);
+		vector<btRigidBody*> crests;
+		rayTos.resize(0);
+		for(int i = 0; i < crestCount; i++)
+		{
+			float x = (float)(rand() % (side * 40) - side * 20) * 0.1f;
+			float z = (float)(rand() % (side * 40) - side * 20) * 0.1f;
+			btRigidBody* crest = physicsMan->createRigidBody("Cube", x, 1.0f, z, 0.5f, 0.5f, 0.5f);
+			physicsMan->addRigidBodyToWorld(crest, VISION_AFFECTED_NOCOLLISION);
+			crests.push_back(crest);
+			rayTos.push_back(btVector3(x, 1.0f, z));
+		}
+		physicsMan->update(1.0f / 60.0f);
+
+		double batchedMs = 0.0;
+		double singleMs = 0.0;
+		int mismatches = 0;
+		for(int frame = 0; frame < frames; frame++)
+		{
+			float angle = (float)frame * 0.01f;
+			btVector3 rayFrom(sinf(angle) * side, 1.5f, cosf(angle) * side);
+
+			LARGE_INTEGER start, end;
+			QueryPerformanceCounter(&start);
+			physicsMan->closestRayHits(rayFrom, rayTos, hits);
+			QueryPerformanceCounter(&end);
+			batchedMs += (double)(end.QuadPart - start.QuadPart) * 1000.0 / (double)frequency.QuadPart;
+
+			QueryPerformanceCounter(&start);
+			for(int i = 0; i < rayTos.size(); i++)
+			{
+				if(physicsMan->closestRayHit(rayFrom, rayTos[i]) != hits[i])
+					mismatches++;
+			}
+			QueryPerformanceCounter(&end);
+			singleMs += (double)(end.QuadPart - start.QuadPart) * 1000.0 / (double)frequency.QuadPart;
+		}
+
+		csv << crestCount << "," << frames << "," << batchedMs / frames << "," << singleMs / frames << "," << mismatches << endl;
+		DBOUT("Visibility benchmark: " << crestCount << " crests, " << batchedMs / frames << " ms batched, " << singleMs / frames << " ms one at a time");
+
+		for(unsigned int i = 0; i < crests.size(); i++)
+			physicsMan->removeRigidBodyFromWorld(crests[i]);
+	}
+
+	for(unsigned int i = 0; i < pillars.size(); i++)
+		physicsMan->removeRigidBodyFromWorld(pillars[i]);
+	delete physicsMan;
+}
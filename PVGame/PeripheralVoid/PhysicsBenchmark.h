@@ -0,0 +1,85 @@
+#pragma once
+
+#include "PhysicsManager.h"
+#include "FrustumCuller.h"
+#include "LevelDescription.h"
+#include "GameObject.h"
+#include "InstanceRegistry.h"
+
+/* RunPhysicsBenchmark()
+ *
+ * Steps a scene of thrown cubes and spheres with no window or renderer, once for
+ * every worker count from 1 to maxWorkers, and writes the timings and how far the
+ * physics pools grew as csv. Without USE_PARALLEL_PHYSICS there's only the sequential
+ * step, so it's timed once.
+ *
+ * param: maxWorkers - highest worker count to time
+ * param: bodyCount  - how many dynamic bodies get thrown into the scene
+ * param: frames     - how many 60hz frames to step for each worker count
+ * param: fileName   - where the csv goes
+ */
+void RunPhysicsBenchmark(int maxWorkers, int bodyCount, int frames, string fileName);
+
+/* RunCullingBenchmark()
+ *
+ * Culls a grid of static vision affected cubes from a camera spinning in the middle of it,
+ * once with a ghost object in the physics world and once with the FrustumCuller, and writes
+ * the timings as csv. Physics is stepped every frame in both, since the ghost path pays for
+ * its contacts during the step.
+ *
+ * param: objectCount - how many cubes make up the grid
+ * param: frames      - how many 60hz frames to run each culler for
+ * param: fileName    - where the csv goes
+ */
+void RunCullingBenchmark(int objectCount, int frames, string fileName);
+
+/* RunVisibilityBenchmark()
+ *
+ * Casts a ray from a camera circling a field of pillars to every crest scattered among them,
+ * once as a closestRayHits() batch and once a ray at a time, for 8 crests and then double that
+ * up to maxCrests. Writes the timings and how often the two disagreed as csv, which should be
+ * never.
+ *
+ * param: maxCrests - most crests to time
+ * param: frames    - how many camera positions to cast from for each crest count
+ * param: fileName  - where the csv goes
+ */
+void RunVisibilityBenchmark(int maxCrests, int frames, string fileName);
+
+/* RunHullBenchmark()
+ *
+ * Piles copies of one model onto a floor, once with the whole triangle mesh as its hull and
+ * once with the cooked hull, and writes how long collision detection and stepping take as csv.
+ * Needs the model already loaded into MeshMaps::MESH_MAPS.
+ *
+ * param: handle    - the model to pile up
+ * param: bodyCount - how many copies of it get dropped
+ * param: frames    - how many 60hz frames to time for each hull
+ * param: fileName  - where the csv goes
+ */
+void RunHullBenchmark(string handle, int bodyCount, int frames, string fileName);
+
+/* RunLevelBenchmark()
+ *
+ * Reads every Assets/level*.xml from the xml and then from its compiled binary, compiling
+ * it first if need be, and writes how long each took as csv.
+ *
+ * param: repeats  - how many times each level is read each way, the times are averaged
+ * param: fileName - where the csv goes
+ */
+void RunLevelBenchmark(int repeats, string fileName);
+
+/* RunSpawnBenchmark()
+ *
+ * Spawns objects one at a time into a scene that already has objectCount of them, once
+ * rebuilding every instance for each spawn the way BuildInstancedBuffer does and once adding
+ * just the new one to an InstanceRegistry, and writes how long each spawn took as csv. Then
+ * checks the registry reuses freed slots without growing. Only the CPU side is timed, the
+ * capacity column says when the renderer would have had to remake an instance buffer.
+ *
+ * param: objectCount - how many objects are in the scene before the first spawn
+ * param: spawns      - how many objects get spawned each way
+ * param: fileName    - where the csv goes
+ * returns: false if respawning grew the registry or lost a slot
+ */
+bool RunSpawnBenchmark(int objectCount, int spawns, string fileName);
@@ -1,12 +1,90 @@
 #include "PhysicsManager.h"
+#include "bullet-2.81-rev2613\src\LinearMath\btConvexHullComputer.h"
+#include "bullet-2.81-rev2613\src\LinearMath\btConvexHull.h"
+#include <fstream>
+#include "Profiler.h"
+#include "AllocationTracker.h"
 
-PhysicsManager::PhysicsManager(void)
+#if USE_PARALLEL_PHYSICS
+#include "BulletMultiThreaded/SpuGatheringCollisionDispatcher.h"
+#include "BulletMultiThreaded/SpuCollisionTaskProcess.h"
+#include "BulletMultiThreaded/btParallelConstraintSolver.h"
+#include "BulletCollision/CollisionDispatch/btSimulationIslandManager.h"
+#ifdef _WIN32
+#include "BulletMultiThreaded/Win32ThreadSupport.h"
+#else
+#include "BulletMultiThreaded/PosixThreadSupport.h"
+#endif
+
+#if defined(DEBUG) | defined(_DEBUG)
+	#pragma comment (lib, "BulletMultiThreaded_vs2010_debug.lib")
+#else
+	#pragma comment (lib, "BulletMultiThreaded_vs2010.lib")
+#endif
+#endif
+
+/* PhysicsManager()
+ *
+ * param: workerCount - threads for collision dispatch and constraint solving. Only used
+ *                      when USE_PARALLEL_PHYSICS is on, 1 or less uses the sequential
+ *                      dispatcher and solver.
+ */
+PhysicsManager::PhysicsManager(int workerCount)
+	: bodyPool(sizeof(btRigidBody), PHYSICS_POOL_CHUNK),
+	  motionStatePool(sizeof(BufferedMotionState), PHYSICS_POOL_CHUNK),
+	  shapePool(largestShapeSize(), PHYSICS_POOL_CHUNK)
 {
-	collisionConfig		= new btDefaultCollisionConfiguration();
-    dispatcher			= new btCollisionDispatcher(collisionConfig);
-    broadphase			= new btDbvtBroadphase();
-    solver				= new btSequentialImpulseConstraintSolver();
-    world				= new btDiscreteDynamicsWorld(dispatcher,broadphase,solver,collisionConfig);
+	collisionThreads	= NULL;
+	solverThreads		= NULL;
+	this->workerCount	= 1;
+	updateFrame			= 0;
+	hullVertexBudget	= HULL_VERTEX_BUDGET;
+	hullMargin			= HULL_MARGIN;
+
+	#if USE_PARALLEL_PHYSICS
+	if(workerCount > 1)
+	{
+		this->workerCount = workerCount;
+
+		//The parallel solver wants every contact in one pool, so make it big enough up front
+		btDefaultCollisionConstructionInfo constructionInfo;
+		constructionInfo.m_defaultMaxPersistentManifoldPoolSize = 32768;
+		collisionConfig = new btDefaultCollisionConfiguration(constructionInfo);
+
+		#ifdef _WIN32
+		Win32ThreadSupport::Win32ThreadConstructionInfo collisionInfo("collision", processCollisionTask, createCollisionLocalStoreMemory, workerCount);
+		Win32ThreadSupport::Win32ThreadConstructionInfo solverInfo("solver", SolverThreadFunc, SolverlsMemoryFunc, workerCount);
+		collisionThreads = new Win32ThreadSupport(collisionInfo);
+		solverThreads = new Win32ThreadSupport(solverInfo);
+		#else
+		PosixThreadSupport::ThreadConstructionInfo collisionInfo("collision", processCollisionTask, createCollisionLocalStoreMemory, workerCount);
+		PosixThreadSupport::ThreadConstructionInfo solverInfo("solver", SolverThreadFunc, SolverlsMemoryFunc, workerCount);
+		collisionThreads = new PosixThreadSupport(collisionInfo);
+		solverThreads = new PosixThreadSupport(solverInfo);
+		#endif
+
+		SpuGatheringCollisionDispatcher* parallelDispatcher = new SpuGatheringCollisionDispatcher(collisionThreads, workerCount, collisionConfig);
+		parallelDispatcher->setDispatcherFlags(btCollisionDispatcher::CD_DISABLE_CONTACTPOOL_DYNAMIC_ALLOCATION);
+		dispatcher = parallelDispatcher;
+		broadphase = new btDbvtBroadphase();
+		solver = new btParallelConstraintSolver(solverThreads);
+
+		btDiscreteDynamicsWorld* parallelWorld = new btDiscreteDynamicsWorld(dispatcher,broadphase,solver,collisionConfig);
+		parallelWorld->getSimulationIslandManager()->setSplitIslands(false);
+		parallelWorld->getSolverInfo().m_numIterations = 4;
+		parallelWorld->getSolverInfo().m_solverMode = SOLVER_SIMD | SOLVER_USE_WARMSTARTING;
+		parallelWorld->getDispatchInfo().m_enableSPU = true;
+		world = parallelWorld;
+	}
+	else
+	#endif
+	{
+		collisionConfig		= new btDefaultCollisionConfiguration();
+		dispatcher			= new btCollisionDispatcher(collisionConfig);
+		broadphase			= new btDbvtBroadphase();
+		solver				= new btSequentialImpulseConstraintSolver();
+		world				= new btDiscreteDynamicsWorld(dispatcher,broadphase,solver,collisionConfig);
+	}
 	ghostPairCallback	= new btGhostPairCallback();
 	filterCallback		= new CustomFilterCallback(); //Set up custom collision filter
 
@@ -17,13 +95,51 @@ PhysicsManager::PhysicsManager(void)
 	broadphase->getOverlappingPairCache()->setInternalGhostPairCallback(ghostPairCallback);
 	world->setGravity(btVector3(0.0f,-9.81f,0.0f));
 
-	pStepSize = 1.0f / 30.0f; //Update at 60 fps
-	pAccumulator = 0.0f;
+	pStepSize = 1.0f / PHYSICS_STEP_RATE;
+	pMaxSubSteps = PHYSICS_MAX_SUBSTEPS;
+
+	snapshot.stepping = false;
+	stepThread = NULL;
+	stepRequested = NULL;
+	stepDone = NULL;
+	stopThread = false;
+	queuedTime = 0.0f;
+	stepTime = 0.0f;
+	lastStepCount = 0;
+
+	#if USE_PHYSICS_THREAD
+	stepRequested = CreateEvent(NULL, FALSE, FALSE, NULL);
+	stepDone = CreateEvent(NULL, FALSE, FALSE, NULL);
+	stepThread = CreateThread(NULL, 0, stepThreadProc, this, 0, NULL);
+	#endif
 }
 
 PhysicsManager::~PhysicsManager()
 {
+	if(stepThread != NULL)
+	{
+		syncStep();
+		stopThread = true;
+		SetEvent(stepRequested);
+		WaitForSingleObject(stepThread, INFINITE);
+		CloseHandle(stepThread);
+		CloseHandle(stepRequested);
+		CloseHandle(stepDone);
+	}
+
 	delete world;
+
+	//Shapes still in the cache belong to bodies that were never removed. The bodies and
+	//motion states go away with their pools, but shapes can own memory of their own.
+	map<ShapeKey, CachedShape>::iterator shape;
+	for(shape = shapeCache.begin(); shape != shapeCache.end(); shape++)
+		destroyPooled(shapePool, shape->second.shape);
+	shapeCache.clear();
+	cachedShapeKeys.clear();
+
+	while(!staticMeshes.empty())
+		destroyStaticMesh(staticMeshes.begin());
+
     delete solver;
     delete collisionConfig;
     delete dispatcher;
@@ -31,7 +147,13 @@ PhysicsManager::~PhysicsManager()
     delete filterCallback;
     delete broadphase;
 
-	std::map<string, btTriangleMesh*>::iterator itr = TRIANGLE_MESHES.begin();
+	//The parallel dispatcher and solver use these, so they go last
+	if(collisionThreads != NULL)
+		delete collisionThreads;
+	if(solverThreads != NULL)
+		delete solverThreads;
+
+	std::map<string, btTriangleIndexVertexArray*>::iterator itr = TRIANGLE_MESHES.begin();
 	while (itr != TRIANGLE_MESHES.end())
 	{
 		delete itr->second;
@@ -44,6 +166,20 @@ float PhysicsManager::getStepSize()
 	return pStepSize;
 }
 
+//Sets how many fixed steps the simulation takes per second of game time
+void PhysicsManager::setStepRate(float stepsPerSecond)
+{
+	if(stepsPerSecond > 0.0f)
+		pStepSize = 1.0f / stepsPerSecond;
+}
+
+//Sets how many steps one update can take to catch up after a slow frame
+void PhysicsManager::setMaxSubSteps(int maxSubSteps)
+{
+	if(maxSubSteps > 0)
+		pMaxSubSteps = maxSubSteps;
+}
+
 btDynamicsWorld* PhysicsManager::getWorld()
 {
 	return world;
@@ -51,22 +187,147 @@ btDynamicsWorld* PhysicsManager::getWorld()
 
 /* update()
  *
- * steps the simulation at a rate of 60 fps
+ * steps the simulation in fixed steps of pStepSize. The world accumulates dt and takes
+ * as many steps as have built up, at most pMaxSubSteps, and drops any time past that so
+ * a long frame can't snowball. Motion states of moving bodies are then pushed forward
+ * by the time left in the accumulator, so world matrices read from them move smoothly
+ * at any frame rate without stepping more often.
+ *
+ * param: the time passed in the game in seconds
  *
- * param: the time passed in the game in milliseconds
+ * returns true if at least one step was taken
  */
 bool PhysicsManager::update(float dt)
 {
-	 pAccumulator += dt;
+	PROFILE("Physics Step");
+	ALLOC_SCOPE(ALLOC_PHYSICS);
+	updateFrame++;
+
+	//On the physics thread the step happens in startStep(), once the game is done with the world
+	if(stepThread != NULL)
+	{
+		queuedTime += dt;
+		return lastStepCount > 0;
+	}
+
+	bool stepped = world->stepSimulation(dt, pMaxSubSteps, pStepSize) > 0;
+	PROFILE_BULLET();
+	return stepped;
+}
+
+/* startStep()
+ *
+ * hands the game time queued by update() to the physics thread and lets it step the world.
+ * Nothing but addRigidBodyToWorld() and removeRigidBodyFromWorld() may touch the world
+ * until syncStep() is called. Does nothing if the world is stepped on the game thread.
+ */
+void PhysicsManager::startStep()
+{
+	if(stepThread == NULL || snapshot.stepping || queuedTime <= 0.0f)
+		return;
+
+	stepTime = queuedTime;
+	queuedTime = 0.0f;
+	snapshot.stepping = true;
+	SetEvent(stepRequested);
+}
+
+/* syncStep()
+ *
+ * waits for the physics thread to finish its step, publishes the transforms it wrote and
+ * applies any bodies that were added or removed in the meantime. After this the game owns
+ * the world again.
+ */
+void PhysicsManager::syncStep()
+{
+	PROFILE("Physics Sync");
+	ALLOC_SCOPE(ALLOC_PHYSICS);
+	if(snapshot.stepping)
+	{
+		WaitForSingleObject(stepDone, INFINITE);
+		snapshot.stepping = false;
+		PROFILE_BULLET(); //The physics thread is idle, its step's zones can be read
+
+		for(int i = 0; i < snapshot.written.size(); i++)
+			snapshot.written[i]->publish();
+		snapshot.written.clear();
+	}
+
+	for(unsigned int i = 0; i < bodyQueue.size(); i++)
+		applyBodyChange(bodyQueue[i]);
+	bodyQueue.clear();
+}
+
+bool PhysicsManager::isThreaded()
+{
+	return stepThread != NULL;
+}
+
+//Returns how many threads the dispatcher and solver use, 1 when they are sequential
+int PhysicsManager::getWorkerCount()
+{
+	return workerCount;
+}
+
+/* updateMovedObjects()
+ *
+ * calls Update() on the GameObject of every rigid body whose motion state changed since
+ * the last call, then empties the moved list. Sleeping and static bodies never get
+ * their motion state written, so they are skipped without being looked at. Where the
+ * moved bodies ended up is kept for the visibility cache until the next call, along with
+ * the bodies added or rescaled since the last one.
+ */
+void PhysicsManager::updateMovedObjects()
+{
+	PROFILE("Moved Objects");
+	ALLOC_SCOPE(ALLOC_PHYSICS);
+	movedAabbs.resize(0);
+	for(int i = 0; i < changedAabbs.size(); i++)
+		movedAabbs.push_back(changedAabbs[i]);
+	changedAabbs.resize(0);
+	for(int i = 0; i < snapshot.moved.size(); i++)
+	{
+		BufferedMotionState* motionState = snapshot.moved[i];
+		motionState->moved = false;
+
+		//Kept so cached visibility can tell if something moved across a ray
+		btVector3 min, max;
+		motionState->body->getAabb(min, max);
+		movedAabbs.push_back(min);
+		movedAabbs.push_back(max);
+
+		GameObject* aGO = (GameObject*)(motionState->body->getUserPointer());
+		if(aGO)
+			aGO->Update();
+	}
+	snapshot.moved.clear();
+}
+
+//Returns how many times update() has been called, used to tell if an object was seen this frame
+unsigned int PhysicsManager::getUpdateFrame()
+{
+	return updateFrame;
+}
+
+DWORD WINAPI PhysicsManager::stepThreadProc(LPVOID param)
+{
+	((PhysicsManager*)param)->runStepThread();
+	return 0;
+}
 
-	 if(pAccumulator >= pStepSize)
-	 {
-		 world->stepSimulation(pStepSize);
-		 pAccumulator-= pStepSize;
-		 return true;
-	 }
+//Physics thread loop, steps the world every time startStep() asks for it
+void PhysicsManager::runStepThread()
+{
+	ALLOC_SCOPE(ALLOC_PHYSICS);
+	while(true)
+	{
+		WaitForSingleObject(stepRequested, INFINITE);
+		if(stopThread)
+			break;
 
-	 return false;
+		lastStepCount = world->stepSimulation(stepTime, pMaxSubSteps, pStepSize);
+		SetEvent(stepDone);
+	}
 }
 
 /* createPlane()
@@ -82,10 +343,11 @@ btRigidBody* PhysicsManager::createPlane(float x, float y, float z)
 	btTransform t;
     t.setIdentity();
     t.setOrigin(btVector3(x,y,z));
-	btCollisionShape* plane = new btStaticPlaneShape(btVector3(0,1,0),0);
-    btMotionState* motion=new btDefaultMotionState(t);
+	btCollisionShape* plane = new (shapePool.allocate()) btStaticPlaneShape(btVector3(0,1,0),0);
+    BufferedMotionState* motion=new (motionStatePool.allocate()) BufferedMotionState(t, &snapshot);
     btRigidBody::btRigidBodyConstructionInfo info(0.0,motion, plane); //0 Mass means that this is a static object
-    btRigidBody* body=new btRigidBody(info);
+    btRigidBody* body=new (bodyPool.allocate()) btRigidBody(info);
+	motion->body = body;
 	return body;
 }
 
@@ -98,33 +360,7 @@ btRigidBody* PhysicsManager::createPlane(float x, float y, float z)
  */
 btRigidBody* PhysicsManager::createRigidBody(string handle, float mass)
 {
-	map<string, btTriangleMesh*>::const_iterator ptr = TRIANGLE_MESHES.find(handle);
-	if(ptr != TRIANGLE_MESHES.end())
-	{
-		btTransform t;
-		t.setIdentity();
-		t.setOrigin(btVector3(0, 0, 0));
-
-		btCollisionShape* triMeshShape;
-		if(handle.compare("Cube") == 0)
-			triMeshShape = new btBoxShape(btVector3(0.5, 0.5, 0.5));
-		else if(handle.compare("Sphere") == 0)
-			triMeshShape = new btSphereShape(3);
-		else
-			triMeshShape = new btConvexTriangleMeshShape(ptr->second);
-
-		triMeshShape->setLocalScaling(btVector3(1,1,1));
-		btDefaultMotionState* motionState = new btDefaultMotionState(t);
-
-		btVector3 inertia(0,0,0);
-		if(mass != 0.0)
-			triMeshShape->calculateLocalInertia(mass, inertia);
-
-		btRigidBody::btRigidBodyConstructionInfo rbInfo(mass, motionState, triMeshShape, inertia);
-		btRigidBody* rigidBody = new btRigidBody(rbInfo);
-		return rigidBody;
-	}
-	return NULL;
+	return createRigidBody(handle, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f, mass);
 }
 
 /* createRigidBody()
@@ -137,75 +373,622 @@ btRigidBody* PhysicsManager::createRigidBody(string handle, float mass)
  */
 btRigidBody* PhysicsManager::createRigidBody(string handle, float xPos, float yPos, float zPos, float mass)
 {
-	map<string, btTriangleMesh*>::const_iterator ptr = TRIANGLE_MESHES.find(handle);
-	if(ptr != TRIANGLE_MESHES.end())
+	return createRigidBody(handle, xPos, yPos, zPos, 1.0f, 1.0f, 1.0f, mass);
+}
+
+/* createRigidBody()
+ *
+ * Creates a rigid body from saved Triangle Mesh Data at position (xPos,yPos,zPos) with scale (xScale, yScale, zScale)
+ * The collision shape comes from the shape cache, so bodies with the same mesh and scale share one shape.
+ *
+ * params: handle   - the string that will be used to access the the mesh data
+ *         Pos      - the position the rigid body will start atd
+ *         Scale    - the scaling of the rigid bodys
+ *         mass     - the mass of the rigid body. 0 mass means that the rigid body is static
+ */
+btRigidBody* PhysicsManager::createRigidBody(string handle, float xPos, float yPos, float zPos, float xScale, float yScale, float zScale, float mass)
+{
+	btCollisionShape* shape = acquireShape(handle, xScale, yScale, zScale);
+	if(shape == NULL)
+		return NULL;
+
+	btTransform t;
+	t.setIdentity();
+	t.setOrigin(btVector3(xPos, yPos, zPos));
+
+	BufferedMotionState* motionState = new (motionStatePool.allocate()) BufferedMotionState(t, &snapshot);
+
+	btVector3 inertia(0,0,0);
+	if(mass != 0.0)
+		shape->calculateLocalInertia(mass, inertia);
+
+	btRigidBody::btRigidBodyConstructionInfo rbInfo(mass, motionState, shape, inertia);
+	btRigidBody* rigidBody = new (bodyPool.allocate()) btRigidBody(rbInfo);
+	motionState->body = rigidBody;
+	return rigidBody;
+}
+
+/* createStaticBoxMesh()
+ *
+ * Merges a bunch of boxes into one static btBvhTriangleMeshShape, so a whole room of
+ * walls and floors is one broadphase proxy instead of hundreds. Rays and the character
+ * controller's sweeps go through the shape's own BVH to find the boxes they touch.
+ * The body isn't added to the world and its shape is cleaned up when it is removed.
+ *
+ * params: boxes - the boxes to merge, relative to the body's position
+ *         Pos   - where the body goes in the world
+ * returns: the static rigid body, NULL if there were no boxes
+ */
+btRigidBody* PhysicsManager::createStaticBoxMesh(const vector<StaticBox>& boxes, float xPos, float yPos, float zPos)
+{
+	StaticMesh* mesh = cookStaticBoxMesh(boxes);
+	if(mesh == NULL)
+		return NULL;
+	return createStaticMeshBody(mesh, xPos, yPos, zPos);
+}
+
+/* cookStaticBoxMesh()
+ *
+ * Does the slow part of createStaticBoxMesh(), turning the boxes into triangles and
+ * building their BVH. Touches nothing the manager owns, so it can run on any thread.
+ *
+ * params: boxes - the boxes to merge
+ * returns: the mesh for createStaticMeshBody(), NULL if there were no boxes
+ */
+StaticMesh* PhysicsManager::cookStaticBoxMesh(const vector<StaticBox>& boxes)
+{
+	if(boxes.empty())
+		return NULL;
+
+	//Corners go -/+ on x, then y, then z, so bit 0 is x, bit 1 is y and bit 2 is z
+	static const int boxIndices[36] =
+	{
+		0, 2, 6,  0, 6, 4, //-x
+		1, 5, 7,  1, 7, 3, //+x
+		0, 4, 5,  0, 5, 1, //-y
+		2, 3, 7,  2, 7, 6, //+y
+		0, 1, 3,  0, 3, 2, //-z
+		4, 6, 7,  4, 7, 5  //+z
+	};
+
+	StaticMesh* mesh = new StaticMesh();
+	mesh->bvhBuffer = NULL;
+	mesh->vertices.reserve(boxes.size() * 8 * 3);
+	mesh->indices.reserve(boxes.size() * 36);
+
+	for(unsigned int i = 0; i < boxes.size(); i++)
 	{
-		btTransform t;
-		t.setIdentity();
-		t.setOrigin(btVector3(xPos, yPos, zPos));
+		const StaticBox& box = boxes[i];
+		int firstVertex = mesh->vertices.size() / 3;
+
+		for(int corner = 0; corner < 8; corner++)
+		{
+			mesh->vertices.push_back(box.centerX + ((corner & 1) ? 0.5f : -0.5f) * box.xLength);
+			mesh->vertices.push_back(box.centerY + ((corner & 2) ? 0.5f : -0.5f) * box.yLength);
+			mesh->vertices.push_back(box.centerZ + ((corner & 4) ? 0.5f : -0.5f) * box.zLength);
+		}
+
+		for(int j = 0; j < 36; j++)
+			mesh->indices.push_back(firstVertex + boxIndices[j]);
+	}
+
+	createStaticMeshShape(mesh, NULL);
+	return mesh;
+}
+
+//Wraps a StaticMesh's triangles in a shape. Builds the BVH unless one is passed in.
+void PhysicsManager::createStaticMeshShape(StaticMesh* mesh, btOptimizedBvh* bvh)
+{
+	btIndexedMesh indexedMesh;
+	indexedMesh.m_numTriangles        = mesh->indices.size() / 3;
+	indexedMesh.m_triangleIndexBase   = (const unsigned char*)&mesh->indices[0];
+	indexedMesh.m_triangleIndexStride = 3 * sizeof(int);
+	indexedMesh.m_numVertices         = mesh->vertices.size() / 3;
+	indexedMesh.m_vertexBase          = (const unsigned char*)&mesh->vertices[0];
+	indexedMesh.m_vertexStride        = 3 * sizeof(float);
+	indexedMesh.m_indexType           = PHY_INTEGER;
+	indexedMesh.m_vertexType          = PHY_FLOAT;
+
+	mesh->meshInterface = new btTriangleIndexVertexArray();
+	mesh->meshInterface->addIndexedMesh(indexedMesh, PHY_INTEGER);
+
+	mesh->shape = new btBvhTriangleMeshShape(mesh->meshInterface, true, bvh == NULL);
+	if(bvh != NULL)
+		mesh->shape->setOptimizedBvh(bvh);
+}
+
+/* createStaticMeshBody()
+ *
+ * Makes a static body out of a cooked mesh. The manager takes the mesh over and deletes
+ * it when the body is removed. Game thread only.
+ *
+ * params: mesh - from cookStaticBoxMesh() or loadStaticBoxMesh()
+ *         Pos  - where the body goes in the world
+ */
+btRigidBody* PhysicsManager::createStaticMeshBody(StaticMesh* mesh, float xPos, float yPos, float zPos)
+{
+	staticMeshes.insert(map<btCollisionShape*, StaticMesh*>::value_type(mesh->shape, mesh));
+
+	btTransform t;
+	t.setIdentity();
+	t.setOrigin(btVector3(xPos, yPos, zPos));
+	BufferedMotionState* motionState = new (motionStatePool.allocate()) BufferedMotionState(t, &snapshot);
+
+	btRigidBody::btRigidBodyConstructionInfo rbInfo(0.0f, motionState, mesh->shape, btVector3(0,0,0));
+	btRigidBody* rigidBody = new (bodyPool.allocate()) btRigidBody(rbInfo);
+	motionState->body = rigidBody;
+	return rigidBody;
+}
+
+//Deletes a createStaticBoxMesh() shape along with the triangles and BVH it points into
+void PhysicsManager::destroyStaticMesh(map<btCollisionShape*, StaticMesh*>::iterator mesh)
+{
+	deleteStaticMesh(mesh->second);
+	staticMeshes.erase(mesh);
+}
+
+//Deletes a cooked mesh that never got a body, or whose body is gone
+void PhysicsManager::deleteStaticMesh(StaticMesh* mesh)
+{
+	delete mesh->shape;
+	delete mesh->meshInterface;
+	if(mesh->bvhBuffer != NULL)
+		btAlignedFree(mesh->bvhBuffer);
+	delete mesh;
+}
+
+//Start of a static mesh cache file, followed by the vertices, the indices and the BVH
+struct StaticMeshFileHeader
+{
+	unsigned int version;
+	unsigned int pointerSize; //serializeInPlace() writes the BVH as it sits in memory, so an x86 file won't load on x64
+	unsigned int scalarSize;  //Same for single and double precision Bullet
+	unsigned int boxHash;
+	unsigned int vertexCount;
+	unsigned int indexCount;
+	unsigned int bvhSize;
+};
+
+//Bump this whenever the way boxes are turned into triangles changes, so old cache files get rebuilt
+const unsigned int STATIC_MESH_CACHE_VERSION = 2;
+
+//FNV-1a over the boxes, so a cache file is only used for the exact boxes it was cooked from
+unsigned int PhysicsManager::hashStaticBoxes(const vector<StaticBox>& boxes)
+{
+	unsigned int hash = 2166136261u;
+	if(boxes.empty())
+		return hash;
+
+	const unsigned char* bytes = (const unsigned char*)&boxes[0];
+	unsigned int byteCount = boxes.size() * sizeof(StaticBox);
+	for(unsigned int i = 0; i < byteCount; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+/* loadStaticBoxMesh()
+ *
+ * Restores a static mesh saved by saveStaticBoxMesh(). The triangles are read straight
+ * into place and the BVH is used right out of the file's bytes, so nothing gets rebuilt.
+ * Like cookStaticBoxMesh() it can run on any thread.
+ *
+ * params: cacheFile - the file saveStaticBoxMesh() wrote
+ *         boxHash   - hashStaticBoxes() of the boxes the mesh should be made of
+ * returns: the mesh for createStaticMeshBody(), NULL if the file is missing, old, truncated,
+ *          from another platform or for other boxes
+ */
+StaticMesh* PhysicsManager::loadStaticBoxMesh(string cacheFile, unsigned int boxHash)
+{
+	ifstream file(cacheFile.c_str(), ios::binary);
+	if(!file)
+		return NULL;
+
+	file.seekg(0, ios::end);
+	unsigned long long fileSize = (unsigned long long)file.tellg();
+	file.seekg(0, ios::beg);
+
+	StaticMeshFileHeader header;
+	if(!file.read((char*)&header, sizeof(header)))
+		return NULL;
+	if(header.version != STATIC_MESH_CACHE_VERSION || header.pointerSize != sizeof(void*) || header.scalarSize != sizeof(btScalar) ||
+		header.boxHash != boxHash || header.vertexCount == 0 || header.indexCount == 0)
+		return NULL;
+
+	// The counts come from the file, don't allocate anything for them unless the file really is that long
+	unsigned long long expectedSize = sizeof(header) + (unsigned long long)header.vertexCount * sizeof(float) +
+		(unsigned long long)header.indexCount * sizeof(int) + header.bvhSize;
+	if(header.bvhSize == 0 || expectedSize != fileSize)
+		return NULL;
+
+	StaticMesh* mesh = new StaticMesh();
+	mesh->vertices.resize(header.vertexCount);
+	mesh->indices.resize(header.indexCount);
+	mesh->bvhBuffer = btAlignedAlloc(header.bvhSize, 16);
+
+	file.read((char*)&mesh->vertices[0], header.vertexCount * sizeof(float));
+	file.read((char*)&mesh->indices[0], header.indexCount * sizeof(int));
+	file.read((char*)mesh->bvhBuffer, header.bvhSize);
+
+	btOptimizedBvh* bvh = NULL;
+	if(file)
+		bvh = btOptimizedBvh::deSerializeInPlace(mesh->bvhBuffer, header.bvhSize, false);
+
+	if(bvh == NULL)
+	{
+		btAlignedFree(mesh->bvhBuffer);
+		delete mesh;
+		return NULL;
+	}
+
+	createStaticMeshShape(mesh, bvh);
+	return mesh;
+}
+
+/* saveStaticBoxMesh()
+ *
+ * Writes a cooked mesh's triangles and BVH to a file so the next load of the same boxes
+ * can skip building them.
+ *
+ * params: mesh      - from cookStaticBoxMesh()
+ *         cacheFile - where to write it
+ *         boxHash   - hashStaticBoxes() of the boxes it was made from
+ * returns: false if the file couldn't be written, nothing is left behind then
+ */
+bool PhysicsManager::saveStaticBoxMesh(const StaticMesh* mesh, string cacheFile, unsigned int boxHash)
+{
+	if(mesh == NULL)
+		return false;
+
+	btOptimizedBvh* bvh = mesh->shape->getOptimizedBvh();
+	unsigned int bvhSize = bvh->calculateSerializeBufferSize();
+	void* bvhBuffer = btAlignedAlloc(bvhSize, 16);
+	bool serialized = bvh->serializeInPlace(bvhBuffer, bvhSize, false);
+
+	StaticMeshFileHeader header;
+	header.version = STATIC_MESH_CACHE_VERSION;
+	header.pointerSize = sizeof(void*);
+	header.scalarSize = sizeof(btScalar);
+	header.boxHash = boxHash;
+	header.vertexCount = mesh->vertices.size();
+	header.indexCount = mesh->indices.size();
+	header.bvhSize = bvhSize;
+
+	bool written = false;
+	if(serialized)
+	{
+		ofstream file(cacheFile.c_str(), ios::binary | ios::trunc);
+		file.write((const char*)&header, sizeof(header));
+		file.write((const char*)&mesh->vertices[0], header.vertexCount * sizeof(float));
+		file.write((const char*)&mesh->indices[0], header.indexCount * sizeof(int));
+		file.write((const char*)bvhBuffer, bvhSize);
+		written = file.good();
+	}
+	if(!written)
+		DeleteFileA(cacheFile.c_str());
+
+	btAlignedFree(bvhBuffer);
+	return written;
+}
+
+/* scaleRigidBody()
+ *
+ * Rescales a rigid body without taking it out of the world. If the body is the only
+ * user of its shape the shape is rescaled in place, otherwise the body is moved over
+ * to the cached shape for the new scale. Inertia and the body's broadphase proxy are
+ * refreshed afterwards.
+ *
+ * params: rigidBody - the rigid body to rescale
+ *         Scale     - the new scaling of the rigid body
+ *         mass      - the mass of the rigid body. 0 mass means that the rigid body is static
+ */
+void PhysicsManager::scaleRigidBody(btRigidBody* rigidBody, float xScale, float yScale, float zScale, float mass)
+{
+	if(rigidBody == NULL)
+		return;
 
-		btCollisionShape* triMeshShape;
-		if(handle.compare("Cube") == 0)
-			triMeshShape = new btBoxShape(btVector3(0.5, 0.5, 0.5));
-		else if(handle.compare("Sphere") == 0)
-			triMeshShape = new btSphereShape(3);
+	//Shrinking can uncover a ray the body used to block, growing can block one
+	if(rigidBody->getBroadphaseHandle() != NULL)
+		noteChangedAabb(rigidBody);
+
+	btCollisionShape* shape = rigidBody->getCollisionShape();
+	map<btCollisionShape*, ShapeKey>::iterator keyItr = cachedShapeKeys.find(shape);
+	if(keyItr == cachedShapeKeys.end())
+	{
+		//Not from the cache, so nothing else can be using it
+		shape->setLocalScaling(btVector3(xScale, yScale, zScale));
+	}
+	else
+	{
+		string handle = keyItr->second.handle;
+		ShapeKey key = makeShapeKey(handle, xScale, yScale, zScale);
+		map<ShapeKey, CachedShape>::iterator cached = shapeCache.find(keyItr->second);
+
+		if(key == keyItr->second)
+		{
+			//Already at this scale, only the mass might have changed
+		}
+		else if(cached->second.refCount == 1 && cached->second.child == NULL && shapeCache.find(key) == shapeCache.end())
+		{
+			CachedShape entry = cached->second;
+			entry.xScale = xScale;
+			entry.yScale = yScale;
+			entry.zScale = zScale;
+			shapeCache.erase(cached);
+			shapeCache.insert(map<ShapeKey, CachedShape>::value_type(key, entry));
+			keyItr->second = key;
+
+			shape->setLocalScaling(btVector3(xScale, yScale, zScale));
+		}
 		else
-			triMeshShape = new btConvexTriangleMeshShape(ptr->second);
+		{
+			btCollisionShape* scaledShape = acquireShape(handle, xScale, yScale, zScale);
+			rigidBody->setCollisionShape(scaledShape);
+			releaseShape(shape);
+			shape = scaledShape;
+		}
+	}
+
+	btVector3 inertia(0,0,0);
+	if(mass != 0.0)
+		shape->calculateLocalInertia(mass, inertia);
+	rigidBody->setMassProps(mass, inertia);
+	rigidBody->updateInertiaTensor();
+
+	//Refresh the existing proxy instead of removing and re-inserting the body
+	if(rigidBody->getBroadphaseHandle() != NULL)
+	{
+		world->updateSingleAabb(rigidBody);
+		world->getPairCache()->cleanProxyFromPairs(rigidBody->getBroadphaseHandle(), dispatcher);
+		noteChangedAabb(rigidBody);
+	}
+	rigidBody->activate();
+}
+
+/* getShapeScale()
+ *
+ * Returns the scale a collision shape was built with. Cached shapes remember the
+ * exact scale they were asked for, anything else reports its local scaling.
+ */
+btVector3 PhysicsManager::getShapeScale(btCollisionShape* shape)
+{
+	map<btCollisionShape*, ShapeKey>::iterator keyItr = cachedShapeKeys.find(shape);
+	if(keyItr == cachedShapeKeys.end())
+		return shape->getLocalScaling();
+
+	CachedShape& entry = shapeCache.find(keyItr->second)->second;
+	return btVector3(entry.xScale, entry.yScale, entry.zScale);
+}
 
-		triMeshShape->setLocalScaling(btVector3(1,1,1));
-		btDefaultMotionState* motionState = new btDefaultMotionState(t);
+/* makeShapeKey()
+ *
+ * Builds the shape cache key for a mesh at a scale
+ */
+ShapeKey PhysicsManager::makeShapeKey(string handle, float xScale, float yScale, float zScale)
+{
+	ShapeKey key;
+	key.handle = handle;
+	key.xScale = (int)floor(xScale * SHAPE_SCALE_PRECISION + 0.5f);
+	key.yScale = (int)floor(yScale * SHAPE_SCALE_PRECISION + 0.5f);
+	key.zScale = (int)floor(zScale * SHAPE_SCALE_PRECISION + 0.5f);
+	return key;
+}
 
-		btVector3 inertia(0,0,0);
-		if(mass != 0.0)
-			triMeshShape->calculateLocalInertia(mass, inertia);
+/* createShape()
+ *
+ * Builds a new unscaled collision shape for a mesh. Cubes and spheres use Bullet's
+ * primitives, meshes with a cooked hull use that, and anything else gets a convex
+ * hull around its whole triangle mesh.
+ */
+btCollisionShape* PhysicsManager::createShape(string handle, btStridingMeshInterface* tMesh)
+{
+	if(handle.compare("Cube") == 0)
+		return new (shapePool.allocate()) btBoxShape(btVector3(0.5, 0.5, 0.5));
+	else if(handle.compare("Sphere") == 0)
+		return new (shapePool.allocate()) btSphereShape(3.14f);
 
-		btRigidBody::btRigidBodyConstructionInfo rbInfo(mass, motionState, triMeshShape, inertia);
-		btRigidBody* rigidBody = new btRigidBody(rbInfo);
-		//rigidBody->setCollisionFlags(btCollisionObject::CollisionFlags::CF_NO_CONTACT_RESPONSE); // Commented out because boxes (but not spheres?) would fall through walls.
-		return rigidBody;
+	map<string, CookedHull>::iterator hull = cookedHulls.find(handle);
+	if(hull != cookedHulls.end())
+	{
+		btConvexHullShape* hullShape = new (shapePool.allocate()) btConvexHullShape(&hull->second.points[0].getX(), hull->second.points.size());
+		hullShape->setMargin(hull->second.margin);
+		return hullShape;
 	}
-	return NULL;
+	return new (shapePool.allocate()) btConvexTriangleMeshShape(tMesh);
 }
 
-/* createRigidBody()
+//Size of the biggest shape the shape pool has to hold
+int PhysicsManager::largestShapeSize()
+{
+	int size = sizeof(btBoxShape);
+	size = btMax(size, (int)sizeof(btSphereShape));
+	size = btMax(size, (int)sizeof(btConvexTriangleMeshShape));
+	size = btMax(size, (int)sizeof(btConvexHullShape));
+	size = btMax(size, (int)sizeof(btUniformScalingShape));
+	size = btMax(size, (int)sizeof(btStaticPlaneShape));
+	return size;
+}
+
+/* acquireShape()
  *
- * Creates a rigid body from saved Triangle Mesh Data at position (xPos,yPos,zPos) with scale (xScale, yScale, zScale)
+ * Returns the shared collision shape for a mesh at a scale, creating it on first use.
+ * Every call must be matched by a releaseShape() once the rigid body using it is gone.
  *
  * params: handle   - the string that will be used to access the the mesh data
- *         Pos      - the position the rigid body will start atd
- *         Scale    - the scaling of the rigid bodys
- *         mass     - the mass of the rigid body. 0 mass means that the rigid body is static
+ *         Scale    - the scaling of the shape
  */
-btRigidBody* PhysicsManager::createRigidBody(string handle, float xPos, float yPos, float zPos, float xScale, float yScale, float zScale, float mass)
+btCollisionShape* PhysicsManager::acquireShape(string handle, float xScale, float yScale, float zScale)
 {
-	map<string, btTriangleMesh*>::const_iterator ptr = TRIANGLE_MESHES.find(handle);
-	if(ptr != TRIANGLE_MESHES.end())
+	ShapeKey key = makeShapeKey(handle, xScale, yScale, zScale);
+
+	map<ShapeKey, CachedShape>::iterator cached = shapeCache.find(key);
+	if(cached != shapeCache.end())
 	{
-		btTransform t;
-		t.setIdentity();
-		t.setOrigin(btVector3(xPos, yPos, zPos));
+		cached->second.refCount++;
+		return cached->second.shape;
+	}
+
+	map<string, btTriangleIndexVertexArray*>::const_iterator ptr = TRIANGLE_MESHES.find(handle);
+	if(ptr == TRIANGLE_MESHES.end())
+		return NULL;
+
+	CachedShape entry;
+	entry.child = NULL;
+	entry.refCount = 1;
+	entry.xScale = xScale;
+	entry.yScale = yScale;
+	entry.zScale = zScale;
 
-		btCollisionShape* triMeshShape;
-		if(handle.compare("Cube") == 0)
-			triMeshShape = new btBoxShape(btVector3(0.5, 0.5, 0.5));
-		else if(handle.compare("Sphere") == 0)
-			triMeshShape = new btSphereShape(3.14f);
+	bool isPrimitive = handle.compare("Cube") == 0 || handle.compare("Sphere") == 0;
+	bool isUnitScale = key.xScale == (int)SHAPE_SCALE_PRECISION && key.yScale == (int)SHAPE_SCALE_PRECISION && key.zScale == (int)SHAPE_SCALE_PRECISION;
+	bool isUniformScale = key.xScale == key.yScale && key.yScale == key.zScale;
+
+	if(!isPrimitive && !isUnitScale && isUniformScale)
+	{
+		//Wrap the unscaled triangle mesh hull instead of building another one
+		entry.child = acquireShape(handle, 1.0f, 1.0f, 1.0f);
+		entry.shape = new (shapePool.allocate()) btUniformScalingShape((btConvexShape*)entry.child, xScale);
+	}
+	else
+	{
+		entry.shape = createShape(handle, ptr->second);
+		entry.shape->setLocalScaling(btVector3(xScale, yScale, zScale));
+	}
+
+	shapeCache.insert(map<ShapeKey, CachedShape>::value_type(key, entry));
+	cachedShapeKeys.insert(map<btCollisionShape*, ShapeKey>::value_type(entry.shape, key));
+	return entry.shape;
+}
+
+/* releaseShape()
+ *
+ * Drops one reference to a collision shape. The shape is only deleted when the
+ * last rigid body using it goes away. Shapes that did not come from the cache
+ * are deleted right away.
+ */
+void PhysicsManager::releaseShape(btCollisionShape* shape)
+{
+	if(shape == NULL)
+		return;
+
+	map<btCollisionShape*, ShapeKey>::iterator keyItr = cachedShapeKeys.find(shape);
+	if(keyItr == cachedShapeKeys.end())
+	{
+		map<btCollisionShape*, StaticMesh*>::iterator mesh = staticMeshes.find(shape);
+		if(mesh != staticMeshes.end())
+			destroyStaticMesh(mesh);
+		else if(shapePool.owns(shape))
+			destroyPooled(shapePool, shape);
 		else
-			triMeshShape = new btConvexTriangleMeshShape(ptr->second);
+			delete shape;
+		return;
+	}
+
+	map<ShapeKey, CachedShape>::iterator cached = shapeCache.find(keyItr->second);
+	if(--cached->second.refCount > 0)
+		return;
 
-		triMeshShape->setLocalScaling(btVector3(xScale, yScale, zScale));
+	btCollisionShape* child = cached->second.child;
+	shapeCache.erase(cached);
+	cachedShapeKeys.erase(keyItr);
+	destroyPooled(shapePool, shape);
 
-		btDefaultMotionState* motionState = new btDefaultMotionState(t);
+	if(child != NULL)
+		releaseShape(child);
+}
+
+int PhysicsManager::getCachedShapeCount()
+{
+	return shapeCache.size();
+}
 
-		btVector3 inertia(0,0,0);
-		if(mass != 0.0)
-			triMeshShape->calculateLocalInertia(mass, inertia);
+/* reserveBodies()
+ *
+ * Makes room in the body and motion state pools for a batch of rigid bodies, so
+ * loading a room grows each pool at most once.
+ *
+ * param: count - how many rigid bodies are about to be created
+ */
+void PhysicsManager::reserveBodies(int count)
+{
+	bodyPool.reserve(count);
+	motionStatePool.reserve(count);
+}
 
-		btRigidBody::btRigidBodyConstructionInfo rbInfo(mass, motionState, triMeshShape, inertia);
-		btRigidBody* rigidBody = new btRigidBody(rbInfo);
-		return rigidBody;
+/* setHullCooking()
+ *
+ * Changes how meshes added after this are cooked. Meshes that were already added
+ * keep the hull they have.
+ *
+ * params: vertexBudget - most points a cooked hull keeps, 0 or less keeps the triangle mesh hull
+ *         margin       - collision margin of the cooked hulls
+ */
+void PhysicsManager::setHullCooking(int vertexBudget, float margin)
+{
+	hullVertexBudget = vertexBudget;
+	hullMargin = margin;
+}
+
+//Number of points in the hull cooked for a mesh, 0 if it wasn't cooked
+int PhysicsManager::getHullVertexCount(string handle)
+{
+	map<string, CookedHull>::iterator hull = cookedHulls.find(handle);
+	if(hull == cookedHulls.end())
+		return 0;
+	return hull->second.points.size();
+}
+
+/* cookHull()
+ *
+ * Cuts a mesh down to a convex hull of at most hullVertexBudget points. The exact hull
+ * is found first so vertices inside the model are thrown out, then HullLibrary (what
+ * btShapeHull uses) trims it to the budget. The hull is pulled in by the margin since
+ * Bullet puts the margin back around it, so the model doesn't get any bigger.
+ *
+ * params: handle   - the string the mesh was added under
+ *         meshData - the model's vertices
+ */
+void PhysicsManager::cookHull(string handle, const MeshData& meshData)
+{
+	if(hullVertexBudget <= 0 || meshData.vertices.size() < 4)
+		return;
+	if(handle.compare("Cube") == 0 || handle.compare("Sphere") == 0)
+		return;
+
+	btConvexHullComputer computer;
+	btScalar shrunk = computer.compute(&meshData.vertices[0].Pos.x, sizeof(Vertex), meshData.vertices.size(), hullMargin, 0.25f);
+	if(shrunk < 0 || computer.vertices.size() < 4)
+		return; //Flat meshes can't be shrunk, they keep the triangle mesh hull
+
+	CookedHull& hull = cookedHulls[handle];
+	hull.margin = shrunk; //Only what was really taken off, thin models get clamped to a smaller shrink and none at all can come back as 0
+
+	if(computer.vertices.size() <= hullVertexBudget)
+	{
+		hull.points.copyFromArray(computer.vertices);
+		return;
 	}
-	return NULL;
+
+	HullDesc desc(QF_TRIANGLES, computer.vertices.size(), &computer.vertices[0]);
+	desc.mMaxVertices = hullVertexBudget;
+
+	HullLibrary hullLibrary;
+	HullResult result;
+	if(hullLibrary.CreateConvexHull(desc, result) == QE_OK)
+		hull.points.copyFromArray(result.m_OutputVertices);
+	else
+		hull.points.copyFromArray(computer.vertices);
+	hullLibrary.ReleaseResult(result);
+}
+
+//Writes the peak use and chunk count of the body, motion state and shape pools as six csv columns
+void PhysicsManager::writePoolStats(ostream& out)
+{
+	out << bodyPool.getPeakCount() << "," << bodyPool.getChunkCount() << "," <<
+		motionStatePool.getPeakCount() << "," << motionStatePool.getChunkCount() << "," <<
+		shapePool.getPeakCount() << "," << shapePool.getChunkCount();
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////
@@ -316,55 +1099,94 @@ void PhysicsManager::frustumCulling(btPairCachingGhostObject* ghost)
 ////////////////////////////////////////////////////////////////////////////////////
 //	addTriangleMesh()
 //
-// Cooks a btTriangleMesh from a bunch of MeshData. This
+// Wraps a bunch of MeshData in a btTriangleIndexVertexArray. This
 // does not add it to the world, it just makes a kind of prefab
 // that can be used to build rigid bodies later much much faster.
+// Nothing is copied, Bullet reads the positions straight out of
+// our Vertex array and uses our index buffer, so the MeshData has
+// to stay alive and unchanged for as long as this PhysicsManager.
+// Models also get a reduced hull cooked for them, see cookHull().
 //
 // params: handle   - the string that will be used to access the rigid body later
-//         meshData - the data that will be used to create the btTriangleMesh
+//         meshData - the data the btTriangleIndexVertexArray points into
 ///////////////////////////////////////////////////////////////////////////////////
-void PhysicsManager::addTriangleMesh(string handle, MeshData meshData)
+void PhysicsManager::addTriangleMesh(string handle, const MeshData& meshData)
 {
-	btTriangleMesh* tMesh = new btTriangleMesh();
+	btIndexedMesh indexedMesh;
+	indexedMesh.m_numTriangles        = meshData.indices.size() / 3;
+	indexedMesh.m_triangleIndexBase   = meshData.indices.empty() ? NULL : (const unsigned char*)&meshData.indices[0];
+	indexedMesh.m_triangleIndexStride = 3 * sizeof(UINT);
+	indexedMesh.m_numVertices         = meshData.vertices.size();
+	indexedMesh.m_vertexBase          = meshData.vertices.empty() ? NULL : (const unsigned char*)&meshData.vertices[0].Pos;
+	indexedMesh.m_vertexStride        = sizeof(Vertex); //Pos is followed by the rest of the Vertex
+	indexedMesh.m_indexType           = PHY_INTEGER;
+	indexedMesh.m_vertexType          = PHY_FLOAT;
 
-	//OH GOD WHY
-	//Convert a mesh from our Vertex format to Bullet's btVector3 format
-	//This is what makes this method slow
-	for(UINT i = 0; i < meshData.indices.size(); i+=3)
-	{
-		 tMesh->addTriangle(btVector3(meshData.vertices[meshData.indices[i    ]].Pos.x, meshData.vertices[meshData.indices[i    ]].Pos.y, meshData.vertices[meshData.indices[i    ]].Pos.z), 
-							btVector3(meshData.vertices[meshData.indices[i + 1]].Pos.x, meshData.vertices[meshData.indices[i + 1]].Pos.y, meshData.vertices[meshData.indices[i + 1]].Pos.z),
-							btVector3(meshData.vertices[meshData.indices[i + 2]].Pos.x, meshData.vertices[meshData.indices[i + 2]].Pos.y, meshData.vertices[meshData.indices[i + 2]].Pos.z));
-	}
+	btTriangleIndexVertexArray* tMesh = new btTriangleIndexVertexArray();
+	tMesh->addIndexedMesh(indexedMesh, PHY_INTEGER);
 
-	TRIANGLE_MESHES.insert(map<string, btTriangleMesh*>::value_type(handle,tMesh));
+	TRIANGLE_MESHES.insert(map<string, btTriangleIndexVertexArray*>::value_type(handle,tMesh));
+	cookHull(handle, meshData);
 }
 
 /* addRigidBodyToWorld()
  *
- * adds a rigid body to the world so it can be updated in the simulation
+ * adds a rigid body to the world so it can be updated in the simulation.
+ * If the physics thread is stepping, the body is added once the step is synced.
  *
  * params: rigidBody - the rigid body to be added to the world
  */
 void PhysicsManager::addRigidBodyToWorld(btRigidBody* rigidBody, short collisionLayer)
 {
 	if(rigidBody != NULL)
-		world->addRigidBody(rigidBody, collisionLayer, collisionLayer);
+	{
+		QueuedBodyChange change = { rigidBody, collisionLayer, true };
+		if(snapshot.stepping)
+			bodyQueue.push_back(change);
+		else
+			applyBodyChange(change);
+	}
 }
 
 /* removeRigidBodyFromWorld()
  *
- * removes a rigid body from the world
+ * removes a rigid body from the world and deletes it. Its collision shape is
+ * only deleted if no other rigid body is sharing it. If the physics thread is
+ * stepping, the body is removed once the step is synced.
  */
 void PhysicsManager::removeRigidBodyFromWorld(btRigidBody* rigidBody)
 {
 	if(rigidBody != NULL)
 	{
-		world->removeRigidBody(rigidBody);
-		delete rigidBody->getCollisionShape();
-		delete rigidBody->getMotionState();
-		delete rigidBody;
-		rigidBody = NULL;
+		QueuedBodyChange change = { rigidBody, 0, false };
+		if(snapshot.stepping)
+			bodyQueue.push_back(change);
+		else
+			applyBodyChange(change);
+	}
+}
+
+//Adds or removes a body, only call this when the physics thread isn't stepping
+void PhysicsManager::applyBodyChange(QueuedBodyChange change)
+{
+	if(change.add)
+	{
+		world->addRigidBody(change.rigidBody, change.collisionLayer, change.collisionLayer);
+		noteChangedAabb(change.rigidBody);
+	}
+	else
+	{
+		world->removeRigidBody(change.rigidBody);
+		releaseShape(change.rigidBody->getCollisionShape());
+
+		forgetVisibility(change.rigidBody);
+
+		//Don't leave a deleted motion state on the moved list
+		BufferedMotionState* motionState = (BufferedMotionState*)change.rigidBody->getMotionState();
+		if(motionState->moved)
+			snapshot.moved.remove(motionState);
+		destroyPooled(motionStatePool, motionState);
+		destroyPooled(bodyPool, change.rigidBody);
 	}
 }
 
@@ -443,64 +1265,318 @@ bool PhysicsManager::broadPhase(Camera* playCamera, GameObject* target)
  */
 bool PhysicsManager::narrowPhase(Camera* playCamera, GameObject* target)
 {
-	//Set ray
+	singleTarget.assign(1, target);
+	narrowPhase(playCamera, singleTarget, singleResult);
+	return singleResult[0];
+}
+
+/* narrowPhase()
+ *
+ * Batched version of the narrow phase. Targets whose cached answer is still good are
+ * answered from the cache, and the rays for the rest go through closestRayHits() together,
+ * so the broadphase trees are walked once for all of them.
+ *
+ * params: playCamera - the camera the rays start at
+ *         targets    - the objects to check
+ *         results    - filled with whether the matching target is visible
+ */
+void PhysicsManager::narrowPhase(Camera* playCamera, const vector<GameObject*>& targets, vector<bool>& results)
+{
+	PROFILE("Visibility Rays");
+	ALLOC_SCOPE(ALLOC_PHYSICS);
+	forgetOccluders();
+	results.assign(targets.size(), false);
+	if(targets.empty())
+		return;
+
 	btVector3 rayFrom(playCamera->GetPosition().x, playCamera->GetPosition().y, playCamera->GetPosition().z);
-	btVector3 rayTo(target->getRigidBody()->getWorldTransform().getOrigin());
 
-	//Check for raycast from camera to center of target
-	btCollisionWorld::ClosestRayResultCallback callback(rayFrom, rayTo);
-	callback.m_collisionFilterGroup = COL_RAYCAST;
-	callback.m_collisionFilterMask = COL_RAYCAST;
-	world->rayTest(rayFrom, rayTo, callback);
+	pendingTargets.resize(0);
+	for(unsigned int i = 0; i < targets.size(); i++)
+	{
+		btRigidBody* targetBody = targets[i]->getRigidBody();
+		VisibilityEntry* entry = visibilityCache.find(btHashPtr(targetBody));
+		if(entry != NULL && isVisibilityCurrent(*entry, rayFrom, targetBody))
+		{
+			entry->checkedFrame = updateFrame;
+			results[i] = entry->visible;
+			continue;
+		}
+		pendingTargets.push_back(i);
+	}
+
+	//Check for raycast from camera to center of each target
+	pendingRays.resize(0);
+	for(int pending = 0; pending < pendingTargets.size(); pending++)
+		pendingRays.push_back(targets[pendingTargets[pending]]->getRigidBody()->getWorldTransform().getOrigin());
+	closestRayHits(rayFrom, pendingRays, pendingHits);
 
-	if(callback.hasHit())
+	//Compare the bodies themselves, collision shapes are shared between identical objects
+	for(int pending = 0; pending < pendingTargets.size(); pending++)
+		results[pendingTargets[pending]] = (pendingHits[pending] == targets[pendingTargets[pending]]->getRigidBody());
+
+	#if FINE_PHASE
+	//Generate an "octree" type thing and raycast to "areas" of every target the center ray was blocked from
+	fineRays.resize(0);
+	fineOwners.resize(0);
+	for(int pending = 0; pending < pendingTargets.size(); pending++)
+	{
+		int i = pendingTargets[pending];
+		if(results[i] || pendingHits[pending] == NULL)
+			continue;
+
+		btRigidBody* targetBody = targets[i]->getRigidBody();
+		btVector3 min, max;
+		targetBody->getCollisionShape()->getAabb(targetBody->getWorldTransform(), min, max);
+
+		float xStep = (max.getX() - min.getX()) / 3.0f;
+		float yStep = (max.getY() - min.getY()) / 3.0f;
+		float zStep = (max.getZ() - min.getZ()) / 3.0f;
+
+		for(float x = min.getX() + xStep; x < max.getX(); x += xStep)
+			for(float y = min.getY() + yStep; y < max.getY(); y += yStep)
+				for(float z = min.getZ() + zStep; z < max.getZ(); z += zStep)
+				{
+					fineRays.push_back(btVector3(x,y,z));
+					fineOwners.push_back(pending);
+				}
+	}
+	closestRayHits(rayFrom, fineRays, fineHits);
+	for(int fine = 0; fine < fineRays.size(); fine++)
 	{
-		if(callback.m_collisionObject->getCollisionShape() == target->getRigidBody()->getCollisionShape())
-			return true;
+		int i = pendingTargets[fineOwners[fine]];
+		if(fineHits[fine] == targets[i]->getRigidBody())
+			results[i] = true;
+	}
+	#endif
+
+	for(int pending = 0; pending < pendingTargets.size(); pending++)
+	{
+		int i = pendingTargets[pending];
+		btRigidBody* targetBody = targets[i]->getRigidBody();
+		const btCollisionObject* hit = pendingHits[pending];
+
 		#if FINE_PHASE
-		else //Generate an "octree" type thing and raycast to "areas"
+		//Any of the fine rays could have been blocked by something other than the occluder,
+		//so only keep answers where the target was seen
+		if(!results[i])
 		{
-			btVector3 min, max;
-			target->getRigidBody()->getCollisionShape()->getAabb(target->getRigidBody()->getWorldTransform(), min, max);
-
-			float xStep = (max.getX() - min.getX()) / 3.0f;
-			float yStep = (max.getY() - min.getY()) / 3.0f;
-			float zStep = (max.getZ() - min.getZ()) / 3.0f;
-
-			for(float x = min.getX() + xStep; x < max.getX(); x += xStep)
-				for(float y = min.getY() + yStep; y < max.getY(); y += yStep)
-					for(float z = min.getZ() + zStep; z < max.getZ(); z += zStep)
-					{
-						rayTo = btVector3(x,y,z);
-						callback = btCollisionWorld::ClosestRayResultCallback(rayFrom, rayTo);
-						callback.m_collisionFilterGroup = COL_RAYCAST;
-						callback.m_collisionFilterMask = COL_RAYCAST;
-						world->rayTest(rayFrom, rayTo, callback);
-						if(callback.hasHit() && callback.m_collisionObject->getCollisionShape() == target->getRigidBody()->getCollisionShape())
-							return true;
-					}
+			visibilityCache.remove(btHashPtr(targetBody));
+			continue;
 		}
 		#endif
-		//else // Loop through all vertices and raycast to them
-		//{
-		//	vector<Vertex> verticies = MeshMaps::MESH_MAPS.find(target->GetMeshKey())->second.vertices;
-		//	for(int i = 0; i < verticies.size(); i++)
-		//	{ 
-		//		//Translate from object space to world space
-		//		XMVECTOR result = XMVector4Transform(XMVectorSet(verticies[i].Pos.x,verticies[i].Pos.y, verticies[i].Pos.z, 1.0f), XMLoadFloat4x4(&target->GetWorldMatrix()));
-		//		XMFLOAT4 worldVertex;
-		//		XMStoreFloat4(&worldVertex, result);
-
-		//		//Raycast to vertex
-		//		rayTo = btVector3(worldVertex.x, worldVertex.y, worldVertex.z);
-		//		callback = btCollisionWorld::ClosestRayResultCallback(rayFrom, rayTo);
-		//		callback.m_collisionFilterGroup = COL_RAYCAST;
-		//		callback.m_collisionFilterMask = COL_RAYCAST;
-		//		world->rayTest(rayFrom, rayTo, callback);
-		//		if(callback.hasHit() && callback.m_collisionObject->getCollisionShape() == target->getRigidBody()->getCollisionShape())
-		//			return true;
-		//	}
-		//}
+
+		VisibilityEntry entry;
+		entry.target = targetBody;
+		entry.targetTransform = targetBody->getWorldTransform();
+		entry.occluder = results[i] ? NULL : hit;
+		if(entry.occluder != NULL)
+			entry.occluderTransform = entry.occluder->getWorldTransform();
+		entry.cameraPosition = rayFrom;
+		entry.checkedFrame = updateFrame;
+		entry.visible = results[i];
+		visibilityCache.insert(btHashPtr(targetBody), entry);
 	}
-	return false;
+}
+
+/* isVisibilityCurrent()
+ *
+ * returns true if a cached narrow phase answer can be used again. It has to have been
+ * checked last frame or this one, so nothing that moved in between went unseen, and the
+ * camera can't have drifted past VISIBILITY_CAMERA_THRESHOLD since the ray was cast.
+ * The target and the occluder must not have moved, and no body that moved, was added or
+ * was rescaled since the last updateMovedObjects() can overlap the ray.
+ */
+bool PhysicsManager::isVisibilityCurrent(const VisibilityEntry& entry, const btVector3& rayFrom, const btRigidBody* target)
+{
+	if(entry.checkedFrame + 1 < updateFrame)
+		return false;
+
+	if(entry.cameraPosition.distance2(rayFrom) > VISIBILITY_CAMERA_THRESHOLD * VISIBILITY_CAMERA_THRESHOLD)
+		return false;
+
+	if(!(target->getWorldTransform() == entry.targetTransform))
+		return false;
+
+	if(entry.occluder != NULL && !(entry.occluder->getWorldTransform() == entry.occluderTransform))
+		return false;
+
+	btVector3 rayTo = target->getWorldTransform().getOrigin();
+	for(int i = 0; i < movedAabbs.size(); i += 2)
+	{
+		btScalar hitFraction = btScalar(1.0);
+		btVector3 hitNormal;
+		if(btRayAabb(rayFrom, rayTo, movedAabbs[i], movedAabbs[i + 1], hitFraction, hitNormal))
+			return false;
+	}
+	return true;
+}
+
+/* forgetVisibility()
+ *
+ * Drops body's own cached answer, called before the body is deleted. Answers it occluded
+ * are left for forgetOccluders(), so unloading a room scans the cache once rather than
+ * once for every body in it.
+ */
+void PhysicsManager::forgetVisibility(const btCollisionObject* body)
+{
+	visibilityCache.remove(btHashPtr(body));
+	forgottenBodies.insert(btHashPtr(body), body);
+}
+
+//Drops every cached answer occluded by a body forgotten since the last call, before anything reads the cache
+void PhysicsManager::forgetOccluders()
+{
+	if(forgottenBodies.size() == 0)
+		return;
+
+	for(int i = visibilityCache.size() - 1; i >= 0; i--)
+	{
+		const VisibilityEntry* entry = visibilityCache.getAtIndex(i);
+		if(entry->occluder != NULL && forgottenBodies.find(btHashPtr(entry->occluder)) != NULL)
+			visibilityCache.remove(btHashPtr(entry->target));
+	}
+	forgottenBodies.clear();
+}
+
+/* noteChangedAabb()
+ *
+ * Makes cached visibility check its rays against body's aabb, for changes that don't go
+ * through its motion state. The aabb counts this frame and, since updateMovedObjects()
+ * starts the list over, the next one too.
+ */
+void PhysicsManager::noteChangedAabb(const btRigidBody* body)
+{
+	btVector3 min, max;
+	body->getAabb(min, max);
+	movedAabbs.push_back(min);
+	movedAabbs.push_back(max);
+	changedAabbs.push_back(min);
+	changedAabbs.push_back(max);
+}
+
+/* closestRayHit()
+ *
+ * Casts one ray through the world, only hitting raycastable objects.
+ *
+ * returns the closest object the ray hits, or NULL if it hits nothing
+ */
+const btCollisionObject* PhysicsManager::closestRayHit(const btVector3& rayFrom, const btVector3& rayTo)
+{
+	btCollisionWorld::ClosestRayResultCallback result(rayFrom, rayTo);
+	result.m_collisionFilterGroup = COL_RAYCAST;
+	result.m_collisionFilterMask = COL_RAYCAST;
+	world->rayTest(rayFrom, rayTo, result);
+	return result.hasHit() ? result.m_collisionObject : NULL;
+}
+
+/* closestRayHits()
+ *
+ * Casts a ray from rayFrom to each of rayTos, walking both broadphase trees once for the
+ * whole batch rather than once per ray. Every node carries the rays that reached it, each
+ * child only gets the ones that cross its aabb, and a leaf tests its object's shape against
+ * whatever rays are left. A hit shortens its ray, so the rest of the walk drops it from
+ * branches beyond that hit.
+ *
+ * params: rayFrom - where every ray starts
+ *         rayTos  - where each ray ends
+ *         hits    - filled with the closest raycastable object each ray hits, or NULL
+ */
+void PhysicsManager::closestRayHits(const btVector3& rayFrom, const btAlignedObjectArray<btVector3>& rayTos, btAlignedObjectArray<const btCollisionObject*>& hits)
+{
+	int rayCount = rayTos.size();
+	hits.resize(rayCount);
+	if(rayCount == 0)
+		return;
+
+	//Same setup as btCollisionWorld::rayTest gives a single ray
+	batchRays.resize(rayCount);
+	for(int i = 0; i < rayCount; i++)
+	{
+		BatchedRay& ray = batchRays[i];
+		ray.to = rayTos[i];
+		btVector3 rayDir = (rayTos[i] - rayFrom).normalized();
+		for(int axis = 0; axis < 3; axis++)
+		{
+			ray.directionInverse[axis] = rayDir[axis] == btScalar(0.0) ? btScalar(BT_LARGE_FLOAT) : btScalar(1.0) / rayDir[axis];
+			ray.signs[axis] = ray.directionInverse[axis] < btScalar(0.0);
+		}
+		ray.length = rayDir.dot(rayTos[i] - rayFrom);
+		ray.closestFraction = btScalar(1.0);
+		ray.hit = NULL;
+	}
+
+	btTransform rayFromTrans, rayToTrans;
+	rayFromTrans.setIdentity();
+	rayFromTrans.setOrigin(rayFrom);
+	rayToTrans.setIdentity();
+
+	//Bodies that moved lately and bodies that have settled live in separate trees
+	for(int set = 0; set < 2; set++)
+	{
+		const btDbvtNode* root = broadphase->m_sets[set].m_root;
+		if(root == NULL)
+			continue;
+
+		openRays.resize(0);
+		for(int i = 0; i < rayCount; i++)
+			openRays.push_back(i);
+		rayStack.resize(0);
+		RayBatchNode rootNode = { root, 0, rayCount };
+		rayStack.push_back(rootNode);
+
+		while(rayStack.size() > 0)
+		{
+			RayBatchNode current = rayStack[rayStack.size() - 1];
+			rayStack.pop_back();
+
+			//Anything past this node's rays belonged to branches that are already done
+			openRays.resize(current.first + current.count);
+
+			int first = openRays.size();
+			btVector3 bounds[2] = { current.node->volume.Mins(), current.node->volume.Maxs() };
+			for(int open = current.first; open < current.first + current.count; open++)
+			{
+				const BatchedRay& ray = batchRays[openRays[open]];
+				btScalar tmin;
+				if(ray.closestFraction > btScalar(0.0) &&
+					btRayAabb2(rayFrom, ray.directionInverse, ray.signs, bounds, tmin, btScalar(0.0), ray.length * ray.closestFraction))
+					openRays.push_back(openRays[open]);
+			}
+			int count = openRays.size() - first;
+			if(count == 0)
+				continue;
+
+			if(current.node->isinternal())
+			{
+				RayBatchNode child = { current.node->childs[0], first, count };
+				rayStack.push_back(child);
+				child.node = current.node->childs[1];
+				rayStack.push_back(child);
+				continue;
+			}
+
+			btDbvtProxy* proxy = (btDbvtProxy*)current.node->data;
+			if(!(proxy->m_collisionFilterGroup & COL_RAYCAST) || !(proxy->m_collisionFilterMask & COL_RAYCAST))
+				continue;
+
+			btCollisionObject* object = (btCollisionObject*)proxy->m_clientObject;
+			for(int open = first; open < first + count; open++)
+			{
+				BatchedRay& ray = batchRays[openRays[open]];
+				btCollisionWorld::ClosestRayResultCallback result(rayFrom, ray.to);
+				result.m_closestHitFraction = ray.closestFraction;
+				rayToTrans.setOrigin(ray.to);
+				btCollisionWorld::rayTestSingle(rayFromTrans, rayToTrans, object, object->getCollisionShape(), object->getWorldTransform(), result);
+				if(result.m_collisionObject != NULL)
+				{
+					ray.closestFraction = result.m_closestHitFraction;
+					ray.hit = result.m_collisionObject;
+				}
+			}
+		}
+	}
+
+	for(int i = 0; i < rayCount; i++)
+		hits[i] = batchRays[i].hit;
 }
\ No newline at end of file
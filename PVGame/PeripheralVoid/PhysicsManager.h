@@ -1,19 +1,25 @@
 #pragma once
 
+#include <Windows.h>
 #include <map>
 #include <string>
+#include <vector>
+#include <ostream>
 #include "bullet-2.81-rev2613\src\btBulletCollisionCommon.h"
 #include "bullet-2.81-rev2613\src\btBulletDynamicsCommon.h"
 #include "bullet-2.81-rev2613\src\Bullet-C-Api.h"
 #include "bullet-2.81-rev2613\src\BulletDynamics\Character\btKinematicCharacterController.h"
 #include "bullet-2.81-rev2613\src\BulletCollision\CollisionDispatch\btGhostObject.h"
+#include "bullet-2.81-rev2613\src\LinearMath\btHashMap.h"
 #include "GameObject.h"
+#include "PhysicsPool.h"
 #include "Common/Camera.h"
 
 using namespace std;
 
 class GameObject;
 class Camera;
+class btThreadSupportInterface;
 
 
 enum CollisionLayers {
@@ -43,6 +49,183 @@ struct CustomFilterCallback : public btOverlapFilterCallback
 	}
 };
 
+//One ray of a closestRayHits() batch. The distance it still checks shrinks to the closest hit so far.
+ATTRIBUTE_ALIGNED16(struct) BatchedRay
+{
+	btVector3 to;
+	btVector3 directionInverse;
+	unsigned int signs[3];
+	btScalar length;
+	btScalar closestFraction;
+	const btCollisionObject* hit;
+
+	BT_DECLARE_ALIGNED_ALLOCATOR();
+};
+
+//A broadphase tree node still to visit, with the rays of the batch that reached it
+struct RayBatchNode
+{
+	const btDbvtNode* node;
+	int first; //Where its rays start in openRays
+	int count;
+};
+
+//Last narrow phase answer for one target. It is reused while the camera, the target and whatever
+//blocked the ray stay put, and nothing else that moved is lying across the ray.
+ATTRIBUTE_ALIGNED16(struct) VisibilityEntry
+{
+	btTransform targetTransform;
+	btTransform occluderTransform;
+	btVector3 cameraPosition;
+	const btCollisionObject* target;
+	const btCollisionObject* occluder; //What the ray hit instead of the target, NULL if it was visible or hit nothing
+	unsigned int checkedFrame;         //The update frame the entry was last checked in
+	bool visible;
+
+	BT_DECLARE_ALIGNED_ALLOCATOR();
+};
+
+struct BufferedMotionState;
+
+//Shared between the PhysicsManager and its motion states so they know who owns the world
+struct TransformSnapshot
+{
+	volatile bool stepping;                             //True while the physics thread is stepping the world
+	btAlignedObjectArray<BufferedMotionState*> written; //Motion states the physics thread wrote this step
+	btAlignedObjectArray<BufferedMotionState*> moved;   //Motion states the game can see moved since the last updateMovedObjects()
+};
+
+//Double buffered motion state. While the physics thread steps, new transforms go into
+//pending and the game keeps reading the last published one until the step is synced.
+//Bullet only writes motion states of awake, non static bodies, so every published
+//transform also puts the state on the moved list.
+ATTRIBUTE_ALIGNED16(struct) BufferedMotionState : public btMotionState
+{
+	btTransform published;
+	btTransform pending;
+	bool written;
+	bool moved;
+	btRigidBody* body;
+	TransformSnapshot* snapshot;
+
+	BT_DECLARE_ALIGNED_ALLOCATOR();
+
+	BufferedMotionState(const btTransform& startTrans, TransformSnapshot* aSnapshot)
+		: published(startTrans), pending(startTrans), written(false), moved(false), body(NULL), snapshot(aSnapshot)
+	{
+	}
+
+	virtual void getWorldTransform(btTransform& worldTrans) const
+	{
+		worldTrans = published;
+	}
+
+	virtual void setWorldTransform(const btTransform& worldTrans)
+	{
+		pending = worldTrans;
+		if(!snapshot->stepping)
+		{
+			published = worldTrans;
+			markMoved();
+		}
+		else if(!written)
+		{
+			written = true;
+			snapshot->written.push_back(this);
+		}
+	}
+
+	void publish()
+	{
+		published = pending;
+		written = false;
+		markMoved();
+	}
+
+	void markMoved()
+	{
+		if(!moved)
+		{
+			moved = true;
+			snapshot->moved.push_back(this);
+		}
+	}
+};
+
+//A body waiting to be added to or removed from the world once the current step is done
+struct QueuedBodyChange
+{
+	btRigidBody* rigidBody;
+	short collisionLayer;
+	bool add;
+};
+
+//Collision shapes are shared between rigid bodies that use the same mesh at the same scale.
+//Scales are quantized so floating point noise from the level files doesn't split the cache.
+#define SHAPE_SCALE_PRECISION 1000.0f
+
+struct ShapeKey
+{
+	string handle;
+	int xScale;
+	int yScale;
+	int zScale;
+
+	bool operator<(const ShapeKey& other) const
+	{
+		if(xScale != other.xScale)
+			return xScale < other.xScale;
+		if(yScale != other.yScale)
+			return yScale < other.yScale;
+		if(zScale != other.zScale)
+			return zScale < other.zScale;
+		return handle.compare(other.handle) < 0;
+	}
+
+	bool operator==(const ShapeKey& other) const
+	{
+		return xScale == other.xScale && yScale == other.yScale && zScale == other.zScale && handle.compare(other.handle) == 0;
+	}
+};
+
+struct CachedShape
+{
+	btCollisionShape* shape;
+	btCollisionShape* child; //Unscaled shape wrapped by a btUniformScalingShape, NULL if not wrapped
+	int refCount;
+	float xScale;            //Exact scale the shape was built with, the key only keeps the quantized one
+	float yScale;
+	float zScale;
+};
+
+//Reduced convex hull cooked from a model's mesh, used instead of hulling every triangle
+struct CookedHull
+{
+	btAlignedObjectArray<btVector3> points;
+	float margin;
+};
+
+//An axis aligned box that gets merged into a static triangle mesh, see createStaticBoxMesh()
+struct StaticBox
+{
+	float centerX;
+	float centerY;
+	float centerZ;
+	float xLength;
+	float yLength;
+	float zLength;
+};
+
+//Triangles of a merged static mesh. Bullet only points at these, so they live as long as its shape.
+struct StaticMesh
+{
+	vector<float> vertices;
+	vector<int> indices;
+	btTriangleIndexVertexArray* meshInterface;
+	btBvhTriangleMeshShape* shape;
+	void* bvhBuffer; //BVH loaded from a cache file, NULL when the shape built its own
+};
+
 class PhysicsManager
 {
  
@@ -50,25 +233,111 @@ private:
 	btDynamicsWorld* world;                    //The world the physics simulation exists in
 	btDispatcher* dispatcher;                  //Event handling
 	btCollisionConfiguration* collisionConfig; //Collision Handling
-	btBroadphaseInterface* broadphase;         //Handles the Broad Phase of Collision Detections, aka determine pairs of objects that could possibly be colliding
+	btDbvtBroadphase* broadphase;              //Handles the Broad Phase of Collision Detections, aka determine pairs of objects that could possibly be colliding
 	btConstraintSolver* solver;                //Solves Constraints
 	btGhostPairCallback* ghostPairCallback;	   // Needs to be separate so it can be deallocated.
 	btOverlapFilterCallback* filterCallback;   // Needs to be separate so it can be deallocated.
+	btThreadSupportInterface* collisionThreads; //Worker threads for the parallel dispatcher, NULL when sequential
+	btThreadSupportInterface* solverThreads;    //Worker threads for the parallel solver, NULL when sequential
+	int workerCount;
+	unsigned int updateFrame; //Counts calls to update(), frustum culling marks objects seen for one of these
 	float pStepSize;
-	float pAccumulator;
+	int pMaxSubSteps;
+
+	TransformSnapshot snapshot;          //Lets motion states buffer what the physics thread writes
+	vector<QueuedBodyChange> bodyQueue;  //Adds and removes requested while the physics thread was stepping
+	HANDLE stepThread;                   //NULL when the world is stepped on the game thread
+	HANDLE stepRequested;
+	HANDLE stepDone;
+	volatile bool stopThread;
+	float queuedTime;                    //Game time waiting to be stepped by the physics thread
+	float stepTime;                      //Game time the physics thread is currently stepping
+	int lastStepCount;                   //Steps taken by the last finished threaded step
+
+	static DWORD WINAPI stepThreadProc(LPVOID param);
+	void runStepThread();
+	void applyBodyChange(QueuedBodyChange change);
+
+	PhysicsPool bodyPool;        //Memory for every btRigidBody this manager makes
+	PhysicsPool motionStatePool; //Memory for their BufferedMotionStates
+	PhysicsPool shapePool;       //Memory for every kind of collision shape the cache builds
+
+	static int largestShapeSize();
+
+	map<ShapeKey, CachedShape> shapeCache;            //Every shape currently used by a rigid body
+	map<btCollisionShape*, ShapeKey> cachedShapeKeys; //Reverse lookup so a body's shape can be released
+
+	ShapeKey makeShapeKey(string handle, float xScale, float yScale, float zScale);
+	btCollisionShape* createShape(string handle, btStridingMeshInterface* tMesh);
+	btCollisionShape* acquireShape(string handle, float xScale, float yScale, float zScale);
+	void releaseShape(btCollisionShape* shape);
+
+	int hullVertexBudget;                //Most points a cooked hull keeps, 0 turns cooking off
+	float hullMargin;
+	map<string, CookedHull> cookedHulls; //Hulls for every mesh that isn't a primitive
+
+	void cookHull(string handle, const MeshData& meshData);
+
+	map<btCollisionShape*, StaticMesh*> staticMeshes; //Triangle data behind every createStaticBoxMesh() shape
+	static void createStaticMeshShape(StaticMesh* mesh, btOptimizedBvh* bvh);
+	void destroyStaticMesh(map<btCollisionShape*, StaticMesh*>::iterator mesh);
+
+	btAlignedObjectArray<BatchedRay> batchRays;  //Scratch for closestRayHits()
+	btAlignedObjectArray<int> openRays;          //Indices into batchRays, one run per RayBatchNode
+	btAlignedObjectArray<RayBatchNode> rayStack;
+
+	btHashMap<btHashPtr, VisibilityEntry> visibilityCache; //Narrow phase answers keyed on the target's body
+	btAlignedObjectArray<btVector3> movedAabbs;            //Min and max of every body updateMovedObjects() saw move
+	btAlignedObjectArray<btVector3> changedAabbs;          //Same for bodies added or rescaled since, carried into the next movedAabbs
+	btAlignedObjectArray<int> pendingTargets;              //Targets the cache couldn't answer this batch
+	btAlignedObjectArray<btVector3> pendingRays;           //Where each pending target's ray ends
+	btAlignedObjectArray<const btCollisionObject*> pendingHits;
+	btAlignedObjectArray<btVector3> fineRays;              //FINE_PHASE rays into the targets the center ray missed
+	btAlignedObjectArray<const btCollisionObject*> fineHits;
+	btAlignedObjectArray<int> fineOwners;                  //Which pending target each fine ray belongs to
+	vector<GameObject*> singleTarget;                      //Lets the one target narrowPhase() use the batch without allocating
+	vector<bool> singleResult;
+	btHashMap<btHashPtr, const btCollisionObject*> forgottenBodies; //Deleted since forgetOccluders() last ran
+
+	bool isVisibilityCurrent(const VisibilityEntry& entry, const btVector3& rayFrom, const btRigidBody* target);
+	void forgetVisibility(const btCollisionObject* body);
+	void forgetOccluders();
+	void noteChangedAabb(const btRigidBody* body);
 
 public:
-	map<string, btTriangleMesh*> TRIANGLE_MESHES;
-	PhysicsManager(void);
+	map<string, btTriangleIndexVertexArray*> TRIANGLE_MESHES; //Views into the MeshData they were cooked from
+	PhysicsManager(int workerCount = PHYSICS_WORKER_COUNT);
 	~PhysicsManager(void);
 	float getStepSize();
+	void setStepRate(float stepsPerSecond);
+	void setMaxSubSteps(int maxSubSteps);
 	bool update(float dt);
+	void startStep();
+	void syncStep();
+	bool isThreaded();
+	int getWorkerCount();
+	void updateMovedObjects();
+	unsigned int getUpdateFrame();
 	btRigidBody* createPlane(float x, float y, float z);
 	btRigidBody* createRigidBody(string handle, float mass = 0.0);
 	btRigidBody* createRigidBody(string handle, float xPos, float yPos, float zPos, float mass = 0.0);
 	btRigidBody* createRigidBody(string handle, float xPos, float yPos, float zPos, float xScale, float yScale, float zScale, float mass = 0.0);
+	btRigidBody* createStaticBoxMesh(const vector<StaticBox>& boxes, float xPos, float yPos, float zPos);
+	btRigidBody* createStaticMeshBody(StaticMesh* mesh, float xPos, float yPos, float zPos);
+	static StaticMesh* cookStaticBoxMesh(const vector<StaticBox>& boxes);
+	static StaticMesh* loadStaticBoxMesh(string cacheFile, unsigned int boxHash);
+	static bool saveStaticBoxMesh(const StaticMesh* mesh, string cacheFile, unsigned int boxHash);
+	static void deleteStaticMesh(StaticMesh* mesh);
+	static unsigned int hashStaticBoxes(const vector<StaticBox>& boxes);
+	void scaleRigidBody(btRigidBody* rigidBody, float xScale, float yScale, float zScale, float mass = 0.0);
+	btVector3 getShapeScale(btCollisionShape* shape);
 
 	btDynamicsWorld* getWorld();
+	int getCachedShapeCount();
+	void reserveBodies(int count);
+	void writePoolStats(ostream& out);
+	void setHullCooking(int vertexBudget, float margin);
+	int getHullVertexCount(string handle);
 
 	btPairCachingGhostObject* makeCameraFrustumObject(btTriangleMesh* tMesh);
 	btPairCachingGhostObject* makeCameraFrustumObject(btVector3* points, int numPoints);
@@ -77,7 +346,7 @@ public:
 	void removeGhostObjectFromWorld(btPairCachingGhostObject* ghost);
 	void frustumCulling(btPairCachingGhostObject* ghost);
 
-	void addTriangleMesh(string handle, MeshData meshData);
+	void addTriangleMesh(string handle, const MeshData& meshData);
 	void addRigidBodyToWorld(btRigidBody* rigidBody, short collisionLayer);
 	void removeRigidBodyFromWorld(btRigidBody* rigidBody);
 	
@@ -86,5 +355,8 @@ public:
 	
 	bool broadPhase(Camera* playCamera, GameObject* target);
 	bool narrowPhase(Camera* playCamera, GameObject* target);
+	void narrowPhase(Camera* playCamera, const vector<GameObject*>& targets, vector<bool>& results);
+	const btCollisionObject* closestRayHit(const btVector3& rayFrom, const btVector3& rayTo);
+	void closestRayHits(const btVector3& rayFrom, const btAlignedObjectArray<btVector3>& rayTos, btAlignedObjectArray<const btCollisionObject*>& hits);
 };
 
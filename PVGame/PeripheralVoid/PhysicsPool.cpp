@@ -0,0 +1,103 @@
+#include "PhysicsPool.h"
+
+/* PhysicsPool()
+ *
+ * params: elementSize - size of the biggest object the pool will hold, rounded up to keep blocks 16 byte aligned
+ *         chunkSize   - how many blocks to add each time the pool runs out
+ */
+PhysicsPool::PhysicsPool(int elementSize, int chunkSize)
+{
+	this->elementSize = (elementSize + 15) & ~15;
+	this->chunkSize = chunkSize;
+	usedCount = 0;
+	peakCount = 0;
+}
+
+PhysicsPool::~PhysicsPool(void)
+{
+	for(int i = 0; i < chunks.size(); i++)
+		delete chunks[i];
+}
+
+//Returns a block big enough for one object, adding a chunk if every block is taken
+void* PhysicsPool::allocate()
+{
+	for(int i = chunks.size() - 1; i >= 0; i--)
+	{
+		if(chunks[i]->getFreeCount() > 0)
+		{
+			usedCount++;
+			peakCount = btMax(peakCount, usedCount);
+			return chunks[i]->allocate(elementSize);
+		}
+	}
+
+	addChunk(chunkSize);
+	usedCount++;
+	peakCount = btMax(peakCount, usedCount);
+	return chunks[chunks.size() - 1]->allocate(elementSize);
+}
+
+void PhysicsPool::release(void* ptr)
+{
+	for(int i = 0; i < chunks.size(); i++)
+	{
+		if(chunks[i]->validPtr(ptr))
+		{
+			chunks[i]->freeMemory(ptr);
+			usedCount--;
+			return;
+		}
+	}
+}
+
+//True if the block came from this pool
+bool PhysicsPool::owns(void* ptr)
+{
+	for(int i = 0; i < chunks.size(); i++)
+	{
+		if(chunks[i]->validPtr(ptr))
+			return true;
+	}
+	return false;
+}
+
+/* reserve()
+ *
+ * Makes sure count more objects fit without adding chunks on the way. Call it before
+ * building a batch of objects whose size is known, like a room.
+ */
+void PhysicsPool::reserve(int count)
+{
+	int freeCount = getCapacity() - usedCount;
+	if(count > freeCount)
+		addChunk(btMax(count - freeCount, chunkSize));
+}
+
+void PhysicsPool::addChunk(int count)
+{
+	chunks.push_back(new btPoolAllocator(elementSize, count));
+}
+
+int PhysicsPool::getUsedCount()
+{
+	return usedCount;
+}
+
+int PhysicsPool::getPeakCount()
+{
+	return peakCount;
+}
+
+int PhysicsPool::getCapacity()
+{
+	int capacity = 0;
+	for(int i = 0; i < chunks.size(); i++)
+		capacity += chunks[i]->getMaxCount();
+	return capacity;
+}
+
+int PhysicsPool::getChunkCount()
+{
+	return chunks.size();
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "bullet-2.81-rev2613\src\LinearMath\btPoolAllocator.h"
+#include "bullet-2.81-rev2613\src\LinearMath\btAlignedObjectArray.h"
+#include "bullet-2.81-rev2613\src\LinearMath\btMinMax.h"
+
+/* PhysicsPool
+ *
+ * Hands out fixed size blocks of memory for one kind of physics object. Blocks come from
+ * chunks of btPoolAllocator and a new chunk is added whenever they run out, so once a few
+ * rooms have been loaded, bodies being made and thrown away stop going to the global heap.
+ * Objects are built in a block with placement new and given back with destroyPooled().
+ */
+class PhysicsPool
+{
+	public:
+		PhysicsPool(int elementSize, int chunkSize);
+		~PhysicsPool(void);
+
+		void* allocate();
+		void release(void* ptr);
+		bool owns(void* ptr);
+		void reserve(int count);
+
+		int getUsedCount();
+		int getPeakCount();
+		int getCapacity();
+		int getChunkCount();
+
+	private:
+		btAlignedObjectArray<btPoolAllocator*> chunks;
+		int elementSize;
+		int chunkSize;   //Blocks in a chunk added when the pool runs dry
+		int usedCount;
+		int peakCount;   //Most blocks that were ever in use at once
+
+		void addChunk(int count);
+};
+
+//Runs an object's destructor and gives its block back to the pool it was built in
+template<class T>
+void destroyPooled(PhysicsPool& pool, T* object)
+{
+	if(object != NULL)
+	{
+		object->~T();
+		pool.release(object);
+	}
+}
@@ -1,4 +1,6 @@
 #include "Player.h"
+#include "Profiler.h"
+#include "AllocationTracker.h"
 
 Player::Player(PhysicsManager* pm, RenderManager* rm, RiftManager* riftM) 
 	: PIXELS_PER_SEC(1.4f), LOOK_SPEED(3.5f)
@@ -91,6 +93,7 @@ void Player::setRotation(float rotRad)
 ///////////////////////////////////////////////////
 void Player::Update(float dt, Input* input)
 {
+	PROFILE("Player");
 	if(controller->onGround())
 	{
 		if(leapStatus)
@@ -375,8 +378,12 @@ void Player::HandleInput(Input* input)
 	#pragma endregion
 	
 	#pragma region Audio
-	listener->setPosition(cPos.x, cPos.y, cPos.z);
-	listener->setOrientation(-playerCamera->GetLook().x, -playerCamera->GetLook().y, -playerCamera->GetLook().z, playerCamera->GetUp().x, playerCamera->GetUp().y, playerCamera->GetUp().z);
+	{
+		PROFILE("Audio");
+		ALLOC_SCOPE(ALLOC_AUDIO);
+		listener->setPosition(cPos.x, cPos.y, cPos.z);
+		listener->setOrientation(-playerCamera->GetLook().x, -playerCamera->GetLook().y, -playerCamera->GetLook().z, playerCamera->GetUp().x, playerCamera->GetUp().y, playerCamera->GetUp().z);
+	}
 	#pragma endregion
 
 	#pragma region HEAD MODELING
@@ -1,7 +1,11 @@
 #pragma once
 
 #include "PhysicsManager.h"
+#if HEADLESS
+#include "NullRenderManager.h"
+#else
 #include "RenderManager.h"
+#endif
 #include "Common\Camera.h"
 #include "Common\xnacollision.h"
 #include "Input.h"
@@ -0,0 +1,198 @@
+#include "Profiler.h"
+
+vector<Profiler::ProfileNode> Profiler::nodes;
+DWORD Profiler::gameThread = 0;
+int Profiler::current = 0;
+int Profiler::frame = 0;
+double Profiler::msPerTick = 0.0;
+ofstream Profiler::out;
+bool Profiler::json = false;
+
+/* open()
+ *
+ * Starts saving every frame's zones to fileName. Names ending in .json get json, anything
+ * else gets csv. Call it from the game thread, it's the only one timed from then on.
+ */
+bool Profiler::open(string fileName)
+{
+	close();
+	out.open(fileName.c_str());
+	if(!out.is_open())
+		return false;
+
+	gameThread = GetCurrentThreadId();
+	json = fileName.size() >= 5 && fileName.compare(fileName.size() - 5, 5, ".json") == 0;
+	if(json)
+		out << "[" << endl;
+	else
+		out << "frame,zone,depth,calls,ms" << endl;
+	frame = 0;
+	return true;
+}
+
+void Profiler::close()
+{
+	gameThread = 0;
+	if(!out.is_open())
+		return;
+	if(json)
+		out << endl << "]" << endl;
+	out.close();
+}
+
+void Profiler::begin(const char* name)
+{
+	if(GetCurrentThreadId() != gameThread)
+		return;
+
+	int node = getChild(current, name);
+	nodes[node].calls++;
+	QueryPerformanceCounter(&nodes[node].start);
+	current = node;
+}
+
+void Profiler::end()
+{
+	if(GetCurrentThreadId() != gameThread)
+		return;
+
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	ProfileNode& node = nodes[current];
+	node.ms += (double)(now.QuadPart - node.start.QuadPart) * msPerTick;
+	current = node.parent;
+}
+
+//Copies the zones of Bullet's last stepSimulation under the open zone
+void Profiler::addBulletZones()
+{
+	if(GetCurrentThreadId() != gameThread)
+		return;
+
+	CProfileIterator* iterator = CProfileManager::Get_Iterator();
+	addBulletZones(iterator, current);
+	CProfileManager::Release_Iterator(iterator);
+}
+
+void Profiler::addBulletZones(CProfileIterator* iterator, int parent)
+{
+	//Entering a child moves the iterator, so count them first and go in by index
+	int count = 0;
+	for(iterator->First(); !iterator->Is_Done(); iterator->Next())
+		count++;
+
+	for(int i = 0; i < count; i++)
+	{
+		iterator->First();
+		for(int j = 0; j < i; j++)
+			iterator->Next();
+		if(iterator->Get_Current_Total_Calls() == 0)
+			continue;
+
+		int node = getChild(parent, iterator->Get_Current_Name());
+		nodes[node].calls += iterator->Get_Current_Total_Calls();
+		nodes[node].ms += iterator->Get_Current_Total_Time(); //Bullet already counts in ms
+
+		iterator->Enter_Child(i);
+		addBulletZones(iterator, node);
+		iterator->Enter_Parent();
+	}
+}
+
+/* endFrame()
+ *
+ * Writes out every zone that was opened this frame and zeroes them for the next one.
+ * Zones stay in the tree once made, so after the first few frames nothing is allocated.
+ */
+void Profiler::endFrame()
+{
+	if(nodes.empty())
+		return;
+
+	if(out.is_open())
+	{
+		nodes[0].calls = 1;
+		nodes[0].ms = 0.0;
+		for(int child = nodes[0].child; child != -1; child = nodes[child].sibling)
+			nodes[0].ms += nodes[child].ms;
+
+		if(json)
+		{
+			if(frame > 0)
+				out << "," << endl;
+			out << "{\"frame\":" << frame << ",\"zones\":";
+			writeJson(0);
+			out << "}";
+		}
+		else
+			writeCsv(0, nodes[0].name, 0);
+	}
+
+	for(unsigned int i = 0; i < nodes.size(); i++)
+	{
+		nodes[i].calls = 0;
+		nodes[i].ms = 0.0;
+	}
+	current = 0;
+	frame++;
+}
+
+//Finds the child of parent with that name, adding it if this is the first time it was opened
+int Profiler::getChild(int parent, const char* name)
+{
+	if(nodes.empty())
+	{
+		LARGE_INTEGER frequency;
+		QueryPerformanceFrequency(&frequency);
+		msPerTick = 1000.0 / (double)frequency.QuadPart;
+
+		ProfileNode root = { "Frame", -1, -1, -1, 0, 0.0 };
+		nodes.push_back(root);
+	}
+
+	int last = -1;
+	for(int child = nodes[parent].child; child != -1; child = nodes[child].sibling)
+	{
+		//Zone names are string literals, so the pointer almost always matches
+		if(nodes[child].name == name || strcmp(nodes[child].name, name) == 0)
+			return child;
+		last = child;
+	}
+
+	ProfileNode node = { name, parent, -1, -1, 0, 0.0 };
+	nodes.push_back(node);
+	int index = nodes.size() - 1;
+	if(last == -1)
+		nodes[parent].child = index;
+	else
+		nodes[last].sibling = index;
+	return index;
+}
+
+void Profiler::writeCsv(int node, const string& path, int depth)
+{
+	out << frame << "," << path << "," << depth << "," << nodes[node].calls << "," << nodes[node].ms << endl;
+	for(int child = nodes[node].child; child != -1; child = nodes[child].sibling)
+	{
+		if(nodes[child].calls > 0)
+			writeCsv(child, path + "/" + nodes[child].name, depth + 1);
+	}
+}
+
+void Profiler::writeJson(int node)
+{
+	out << "{\"name\":\"" << nodes[node].name << "\",\"calls\":" << nodes[node].calls << ",\"ms\":" << nodes[node].ms;
+
+	bool first = true;
+	for(int child = nodes[node].child; child != -1; child = nodes[child].sibling)
+	{
+		if(nodes[child].calls == 0)
+			continue;
+		out << (first ? ",\"children\":[" : ",");
+		writeJson(child);
+		first = false;
+	}
+	if(!first)
+		out << "]";
+	out << "}";
+}
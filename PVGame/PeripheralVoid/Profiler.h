@@ -0,0 +1,78 @@
+#pragma once
+
+#include <Windows.h>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "Constants.h"
+#include "bullet-2.81-rev2613\src\LinearMath\btQuickprof.h"
+
+using namespace std;
+
+//Zone timing compiles away completely unless USE_PROFILER is on
+#if USE_PROFILER
+#define PROFILE(name) ProfileScope profileScope(name)
+#define PROFILE_BULLET() Profiler::addBulletZones()
+#define PROFILE_END_FRAME() Profiler::endFrame()
+#else
+#define PROFILE(name)
+#define PROFILE_BULLET()
+#define PROFILE_END_FRAME()
+#endif
+
+/* Profiler
+ *
+ * Times nested zones of the game thread every frame. A zone is opened with PROFILE("name")
+ * and closed at the end of the scope, zones opened inside it become its children. Bullet
+ * keeps its own tree in CProfileManager and resets it on every stepSimulation, so right
+ * after a step PROFILE_BULLET() copies that tree under whatever zone is open.
+ *
+ * PROFILE_END_FRAME() writes the frame's zones to the file given to open(), as csv rows
+ * or, if the name ends in .json, one json object per frame, and starts the next frame.
+ * Only the thread that called open() is timed, zones opened on any other thread, or before
+ * open(), are ignored.
+ */
+class Profiler
+{
+	public:
+		static bool open(string fileName);
+		static void close();
+
+		static void begin(const char* name);
+		static void end();
+		static void addBulletZones();
+		static void endFrame();
+
+	private:
+		struct ProfileNode
+		{
+			const char* name;
+			int parent;
+			int child;    //First child, -1 if none
+			int sibling;  //Next child of the same parent, -1 if last
+			int calls;
+			double ms;
+			LARGE_INTEGER start;
+		};
+
+		static int getChild(int parent, const char* name);
+		static void addBulletZones(CProfileIterator* iterator, int parent);
+		static void writeCsv(int node, const string& path, int depth);
+		static void writeJson(int node);
+
+		static vector<ProfileNode> nodes; //nodes[0] is the frame itself
+		static DWORD gameThread;          //The thread that called open(), 0 while closed
+		static int current;
+		static int frame;
+		static double msPerTick;
+		static ofstream out;
+		static bool json;
+};
+
+//Opens a zone for the rest of the scope, use PROFILE() rather than this
+class ProfileScope
+{
+	public:
+		ProfileScope(const char* name) { Profiler::begin(name); }
+		~ProfileScope() { Profiler::end(); }
+};
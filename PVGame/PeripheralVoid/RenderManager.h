@@ -13,6 +13,9 @@
 #include "FW1FontWrapper\FW1FontWrapper.h"
 #include "Common\Sky.h"
 #include "RiftManager.h"
+#include "Profiler.h"
+#include "AllocationTracker.h"
+#include "InstanceRegistry.h"
 
 class FileLoader;
 
@@ -350,8 +353,9 @@ class RenderManager
 		}
 
 		// Loop through all the buffers, drawing each instance for the game objects.
-		void DrawGameObjects(string aTechniqueKey)
+		void DrawGameObjects(const string& aTechniqueKey)
 		{
+			PROFILE("Draw Game Objects");
 			D3DX11_TECHNIQUE_DESC techDesc;
 			techniqueMap[aTechniqueKey]->GetDesc( &techDesc );
 
@@ -361,23 +365,25 @@ class RenderManager
 			// This will be each mesh's vertex and instance buffer.
 			ID3D11Buffer* vbs[2] = {nullptr, nullptr};
 			
-			map<string, BufferPair>::iterator bufferItr = bufferPairs.begin();
-			while (bufferItr != bufferPairs.end())
+			const unsigned int meshCount = min((unsigned int)bufferPairs.size(), (unsigned int)instances.getMeshCount());
+			for (unsigned int meshHandle = 0; meshHandle < meshCount; ++meshHandle)
 			{
-				// Only draw if there is data to draw!
-				if(mInstancedDataMap[bufferItr->first].size() >= 1)
+				BufferPair& buffers = bufferPairs[meshHandle];
+				const vector<InstancedData>& instanceVector = instances.getInstances(meshHandle);
+
+				// Only draw if there is data to draw, and a mesh to draw it with!
+				if(instances.getLiveCount(meshHandle) >= 1 && buffers.vertexBuffer && buffers.instanceBuffer)
 				{
 					// Get the data from the GPU, put correct data inside a container and only draw that.
 					D3D11_MAPPED_SUBRESOURCE mappedData; 
-					md3dImmediateContext->Map(bufferItr->second.instanceBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedData);
+					md3dImmediateContext->Map(buffers.instanceBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mappedData);
 
 					InstancedData* dataView = reinterpret_cast<InstancedData*>(mappedData.pData);
 					UINT mVisibleObjectCount = 0;
 
-					vector<InstancedData> instanceVector = mInstancedDataMap[bufferItr->first];
 					const UINT instanceSize = instanceVector.size();
 
-					// This actually sets the instance data to draw by filling up dataView.
+					// This actually sets the instance data to draw by filling up dataView. Free slots are never rendered.
 					for(UINT i = 0; i < instanceSize; ++i)
 					{
 						// If check goes here - only add in if we can see it / at least is inside frustum.
@@ -385,18 +391,18 @@ class RenderManager
 							dataView[mVisibleObjectCount++] = instanceVector[i];
 					}
 
-					md3dImmediateContext->Unmap(bufferItr->second.instanceBuffer, 0);
+					md3dImmediateContext->Unmap(buffers.instanceBuffer, 0);
 
-					vbs[0] = bufferItr->second.vertexBuffer;
-					vbs[1] = bufferItr->second.instanceBuffer;
+					vbs[0] = buffers.vertexBuffer;
+					vbs[1] = buffers.instanceBuffer;
 
 					for(UINT p = 0; p < techDesc.Passes; ++p)
 					{
 						md3dImmediateContext->IASetVertexBuffers(0, 2, vbs, stride, offset);
-						md3dImmediateContext->IASetIndexBuffer(bufferItr->second.indexBuffer, DXGI_FORMAT_R32_UINT, 0);
+						md3dImmediateContext->IASetIndexBuffer(buffers.indexBuffer, DXGI_FORMAT_R32_UINT, 0);
 					
 						D3D11_BUFFER_DESC indexDesc;
-						bufferItr->second.indexBuffer->GetDesc(&indexDesc);
+						buffers.indexBuffer->GetDesc(&indexDesc);
 						int indexSize = indexDesc.ByteWidth / sizeof(UINT);
 
 						techniqueMap[aTechniqueKey]->GetPassByIndex(p)->Apply(0, md3dImmediateContext);
@@ -405,35 +411,30 @@ class RenderManager
 						md3dImmediateContext->DrawIndexedInstanced(indexSize, mVisibleObjectCount, 0, 0, 0);
 					}
 				}
-				bufferItr++;
 			}
 		}
 
-		void DrawScene(Camera* aCamera, vector<GameObject*> gameObjects)
+		void DrawScene(Camera* aCamera, const vector<GameObject*>& gameObjects)
 		{
+			PROFILE("Render");
+			ALLOC_SCOPE(ALLOC_RENDER);
 			// Performance increasers - Try to limit calls to size, map accessors, etc.
 			const unsigned int totalGameobjs = gameObjects.size();
-			vector<InstancedData>* instanceVector;
-			string currentKey = "";
 			D3DX11_TECHNIQUE_DESC techDesc;
 
 			// Update each instance's world matrix with the corresponding GameObect's world matrix.
 			for (unsigned int i = 0; i < totalGameobjs; ++i)
 			{
 				GameObject* aGameObject = gameObjects[i];
-				string bufferKey = aGameObject->GetMeshKey();
-
-				// Switch the instance we're updating.
-				if (currentKey != bufferKey)
-				{
-					instanceVector = &mInstancedDataMap[bufferKey];
-					currentKey = bufferKey;
-				}
+				const int instanceSlot = aGameObject->GetInstanceSlot();
 
-				unsigned int instanceCount = instanceCounts[bufferKey]++; 
+				// Never given an instance through AddInstance, so there's nothing to draw it with.
+				if (instanceSlot < 0)
+					continue;
 
-				(*instanceVector)[instanceCount].isRendered = aGameObject->isSeen();
-				(*instanceVector)[instanceCount].World = aGameObject->GetWorldMatrix();
+				InstancedData& instance = instances.get(aGameObject->GetMeshHandle(), instanceSlot);
+				instance.isRendered = aGameObject->isSeen();
+				instance.World = aGameObject->GetWorldMatrix();
 			}
 			
 			if (postProcessingFlags & WireframeEffect)
@@ -501,8 +502,8 @@ class RenderManager
 			mfxWorldInvTranspose->SetMatrix(identity);
 			mfxViewProj->SetMatrix(identity);
 			TexTransform->SetMatrix(identity);
-			md3dImmediateContext->IASetVertexBuffers(0, 1, &bufferPairs["Quad"].vertexBuffer, &stride, &offset);
-			md3dImmediateContext->IASetIndexBuffer(bufferPairs["Quad"].indexBuffer, DXGI_FORMAT_R32_UINT, 0);
+			md3dImmediateContext->IASetVertexBuffers(0, 1, &bufferPairs[quadHandle].vertexBuffer, &stride, &offset);
+			md3dImmediateContext->IASetIndexBuffer(bufferPairs[quadHandle].indexBuffer, DXGI_FORMAT_R32_UINT, 0);
 
 			#pragma region Post Processing - Blur
 			if (postProcessingFlags & BlurEffect)
@@ -515,8 +516,8 @@ class RenderManager
 				mfxDiffuseMapVar->SetResource(shaderResourceViewsMap["Default Render Texture"]);
 				for(UINT p = 0; p < techDesc.Passes; ++p)
 				{
-					md3dImmediateContext->IASetVertexBuffers(0, 1, &bufferPairs["Quad"].vertexBuffer, &stride, &offset);
-					md3dImmediateContext->IASetIndexBuffer(bufferPairs["Quad"].indexBuffer, DXGI_FORMAT_R32_UINT, 0);
+					md3dImmediateContext->IASetVertexBuffers(0, 1, &bufferPairs[quadHandle].vertexBuffer, &stride, &offset);
+					md3dImmediateContext->IASetIndexBuffer(bufferPairs[quadHandle].indexBuffer, DXGI_FORMAT_R32_UINT, 0);
 
 					techniqueMap["TexturePassThrough"]->GetPassByIndex(p)->Apply(0, md3dImmediateContext);
 					md3dImmediateContext->DrawIndexed(6, 0, 0);
@@ -563,8 +564,8 @@ class RenderManager
 				techniqueMap["TexturePassThrough"]->GetDesc(&techDesc);
 				for(UINT p = 0; p < techDesc.Passes; ++p)
 				{
-					md3dImmediateContext->IASetVertexBuffers(0, 1, &bufferPairs["Quad"].vertexBuffer, &stride, &offset);
-					md3dImmediateContext->IASetIndexBuffer(bufferPairs["Quad"].indexBuffer, DXGI_FORMAT_R32_UINT, 0);
+					md3dImmediateContext->IASetVertexBuffers(0, 1, &bufferPairs[quadHandle].vertexBuffer, &stride, &offset);
+					md3dImmediateContext->IASetIndexBuffer(bufferPairs[quadHandle].indexBuffer, DXGI_FORMAT_R32_UINT, 0);
 
 					techniqueMap["TexturePassThrough"]->GetPassByIndex(p)->Apply(0, md3dImmediateContext);
 					md3dImmediateContext->DrawIndexed(6, 0, 0);
@@ -603,7 +604,7 @@ class RenderManager
 			// Set shader view to null to prevent warnings.
 			mfxDiffuseMapVar->SetResource(NULL);
 			techniqueMap["Blur"]->GetPassByIndex(0)->Apply(0, md3dImmediateContext);
-			instanceCounts.clear();
+
 			mfxBlurColor->SetRawValue(&XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f), 0, sizeof(XMFLOAT4));
 		}
 		
@@ -617,8 +618,8 @@ class RenderManager
 			
 			for(UINT p = 0; p < techDesc.Passes; ++p)
 			{
-				md3dImmediateContext->IASetVertexBuffers(0, 1, &bufferPairs["Quad"].vertexBuffer, &stride, &offset);
-				md3dImmediateContext->IASetIndexBuffer(bufferPairs["Quad"].indexBuffer, DXGI_FORMAT_R32_UINT, 0);
+				md3dImmediateContext->IASetVertexBuffers(0, 1, &bufferPairs[quadHandle].vertexBuffer, &stride, &offset);
+				md3dImmediateContext->IASetIndexBuffer(bufferPairs[quadHandle].indexBuffer, DXGI_FORMAT_R32_UINT, 0);
 
 				techniqueMap[aTech]->GetPassByIndex(p)->Apply(0, md3dImmediateContext);
 				md3dImmediateContext->DrawIndexed(6, 0, 0);
@@ -631,7 +632,13 @@ class RenderManager
 			map<string, MeshData>::const_iterator itr = MeshMaps::MESH_MAPS.begin();
 			while (itr != MeshMaps::MESH_MAPS.end())
 			{
-				string currentKey = itr->first;
+				const unsigned int meshHandle = HandleTable::meshes.getHandle(itr->first);
+				if (bufferPairs.size() <= meshHandle)
+				{
+					BufferPair noBuffers = { NULL, NULL, NULL };
+					bufferPairs.resize(meshHandle + 1, noBuffers);
+				}
+				BufferPair& buffers = bufferPairs[meshHandle];
 
 				D3D11_BUFFER_DESC vertexBufferDesc;
 				D3D11_SUBRESOURCE_DATA vertexData;
@@ -659,67 +666,89 @@ class RenderManager
 				indexData.pSysMem = &itr->second.indices[0];
 				HR(md3dDevice->CreateBuffer(&indexBufferDesc, &indexData, &indexBuffer));
 				
-				if (bufferPairs[itr->first].vertexBuffer)
-					ReleaseCOM(bufferPairs[itr->first].vertexBuffer);
-				bufferPairs[itr->first].vertexBuffer = vertexBuffer;
+				if (buffers.vertexBuffer)
+					ReleaseCOM(buffers.vertexBuffer);
+				buffers.vertexBuffer = vertexBuffer;
 
-				if (bufferPairs[itr->first].indexBuffer)
-					ReleaseCOM(bufferPairs[itr->first].indexBuffer);
-				bufferPairs[itr->first].indexBuffer = indexBuffer;
+				if (buffers.indexBuffer)
+					ReleaseCOM(buffers.indexBuffer);
+				buffers.indexBuffer = indexBuffer;
 				
 				itr++;
 			}
+
+			quadHandle = HandleTable::meshes.getHandle("Quad");
 		}
 
-		// Build an instance buffer based on a set of gameObjects.
-		void BuildInstancedBuffer(vector<GameObject*> gameObjects)
+		// Drops every instance and adds one for each of gameObjects. Objects not in gameObjects lose their instances too,
+		// so only call this when the whole scene is replaced, AddInstance and RemoveInstance are for everything else.
+		void BuildInstancedBuffer(const vector<GameObject*>& gameObjects)
 		{
-			// Clear the map of the vector of instance data.
-			mInstancedDataMap.clear();
-			// Loop through all game objects, setting the world matrix appropriately for each instance.
+			PROFILE("Build Instance Buffers");
+			ALLOC_SCOPE(ALLOC_RENDER);
+			// Keeps each mesh's capacity, so the instance buffers only need remaking if this scene is bigger.
+			instances.clear();
 			for (unsigned int i = 0; i < gameObjects.size(); i++)
-			{
-				GameObject* aObject = gameObjects[i];
+				AddInstance(gameObjects[i]);
+		}
 
-				GameMaterial aGameMaterial = GAME_MATERIALS[aObject->GetMaterialKey()];
-				string bufferKey = aObject->GetMeshKey();
-				
-				// Fill up the fields of the InstancedData and then push it into a vector of instacedData of the appropriate kind.
-				InstancedData theData;
-				theData.World = aObject->GetWorldMatrix();
-				theData.SurfMaterial = SURFACE_MATERIALS[aGameMaterial.SurfaceKey];
-				theData.AtlasC = diffuseAtlasCoordsMap[aGameMaterial.DiffuseKey];
-				theData.GlowColor = aGameMaterial.GlowColor;
-				theData.TexScale = aObject->GetTexScale();
-
-				mInstancedDataMap[bufferKey].push_back(theData);
-			}
-				
-			// Go through and create each buffer.
-			std::map<string, BufferPair>::iterator itr = bufferPairs.begin();
-			while (itr != bufferPairs.end())
+		// Gives aObject an instance slot for DrawScene to keep up to date, its material and texture scale are read once here.
+		void AddInstance(GameObject* aObject)
+		{
+			ALLOC_SCOPE(ALLOC_RENDER);
+			const GameMaterial& aGameMaterial = GAME_MATERIALS[aObject->GetMaterialKey()];
+			InstancedData theData = InstanceRegistry::makeInstance(aObject, aGameMaterial,
+				SURFACE_MATERIALS[aGameMaterial.SurfaceKey], diffuseAtlasCoordsMap[aGameMaterial.DiffuseKey]);
+
+			const int meshHandle = aObject->GetMeshHandle();
+			aObject->SetInstanceSlot(instances.add(meshHandle, theData));
+			ReserveInstanceBuffer(meshHandle);
+		}
+
+		// Frees aObject's instance slot, call before deleting anything that was given one.
+		void RemoveInstance(GameObject* aObject)
+		{
+			if (aObject->GetInstanceSlot() < 0)
+				return;
+
+			instances.remove(aObject->GetMeshHandle(), aObject->GetInstanceSlot());
+			aObject->SetInstanceSlot(-1);
+		}
+
+		// Makes sure meshHandle's instance buffer can hold every slot it has. Slot capacity doubles when it grows,
+		// so the buffer is only remade a handful of times however many instances are added one at a time.
+		void ReserveInstanceBuffer(int meshHandle)
+		{
+			if ((int)bufferPairs.size() <= meshHandle)
 			{
-				// Only create instance buffer if there is data to draw!
-				if(mInstancedDataMap[itr->first].size() >= 1)
-				{
-					D3D11_BUFFER_DESC vbd;
-					vbd.Usage = D3D11_USAGE_DYNAMIC;
-					vbd.ByteWidth = sizeof(InstancedData) * mInstancedDataMap[itr->first].size();
-					vbd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-					vbd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-					vbd.MiscFlags = 0;
-					vbd.StructureByteStride = 0;
-					
-					// Release previous Instance buffer if needed.
-					if (itr->second.instanceBuffer)
-						ReleaseCOM(itr->second.instanceBuffer);
+				BufferPair noBuffers = { NULL, NULL, NULL };
+				bufferPairs.resize(meshHandle + 1, noBuffers);
+			}
+			BufferPair& buffers = bufferPairs[meshHandle];
+			const UINT instanceBytes = sizeof(InstancedData) * instances.getCapacity(meshHandle);
 
-					HR(md3dDevice->CreateBuffer(&vbd, 0, &itr->second.instanceBuffer));
+			// Only create instance buffer if there is data to draw, and a mesh to draw it with!
+			if(instanceBytes == 0 || !buffers.vertexBuffer)
+				return;
 
-					instanceCounts[itr->first] = 0;
-				}
-				itr++;
+			// Keep the previous instance buffer if it's already big enough.
+			D3D11_BUFFER_DESC vbd;
+			if (buffers.instanceBuffer)
+			{
+				buffers.instanceBuffer->GetDesc(&vbd);
+				if (vbd.ByteWidth >= instanceBytes)
+					return;
+				ReleaseCOM(buffers.instanceBuffer);
 			}
+
+			vbd.Usage = D3D11_USAGE_DYNAMIC;
+			vbd.ByteWidth = instanceBytes;
+			vbd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+			vbd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+			vbd.MiscFlags = 0;
+			vbd.StructureByteStride = 0;
+
+			HR(md3dDevice->CreateBuffer(&vbd, 0, &buffers.instanceBuffer));
 		}
 
 		void LoadFile(wstring fileName, string fileNameS) //, bool RHCoordSys
@@ -1127,7 +1156,6 @@ class RenderManager
 		map<string, ID3D11DepthStencilView*> depthStencilViewsMap;
 		map<string, ID3DX11EffectTechnique*> techniqueMap;
 		map<string, ID3D11RasterizerState*> rasterizerStatesMap;
-		map<std::string, unsigned int> instanceCounts;
 
 		ID3DX11EffectShaderResourceVariable* mfxDiffuseMapVar;
 		ID3DX11EffectShaderResourceVariable* mfxTextureAtlasVar;
@@ -1156,8 +1184,9 @@ class RenderManager
 		bool usingDX11; // If false, we're using DX10 for now.
 		UINT m4xMsaaQuality;
 
-		// Holds all the (vertex, index, instanceData) buffers. Separate map due to meshes being constant.
-		map<string, BufferPair> bufferPairs;
+		// Holds all the (vertex, index, instanceData) buffers, indexed by mesh handle. Separate due to meshes being constant.
+		vector<BufferPair> bufferPairs;
+		int quadHandle;
 
 		// FileLoader.cpp specific things
 		//vector<ObjModel> mObjModels;
@@ -1170,12 +1199,13 @@ class RenderManager
 		vector<PointLight> mPointLights;
 		SpotLight mSpotLight;
 
-		// Keep a system memory copy of the world matrices for culling.
-		map<string, std::vector<InstancedData>> mInstancedDataMap;
+		// Keep a system memory copy of the world matrices for culling, a slot per GameObject under each mesh handle.
+		InstanceRegistry instances;
 
 		RenderManager() 
 		{ 
 			vsync = 1;
+			quadHandle = 0;
 			md3dDevice = nullptr;
 			md3dImmediateContext = nullptr;
 			mSwapChain = nullptr;
@@ -1252,14 +1282,12 @@ class RenderManager
 			ReleaseCOM(md3dImmediateContext);
 			ReleaseCOM(md3dDevice);
 			
-			// Release all the buffers by going through the map.
-			map<string, BufferPair>::iterator bufferItr = bufferPairs.begin();
-			while (bufferItr != bufferPairs.end())
+			// Release all the buffers of every mesh.
+			for (unsigned int meshHandle = 0; meshHandle < bufferPairs.size(); ++meshHandle)
 			{
-				ReleaseCOM(bufferItr->second.vertexBuffer);
-				ReleaseCOM(bufferItr->second.indexBuffer);
-				ReleaseCOM(bufferItr->second.instanceBuffer);
-				bufferItr++;
+				ReleaseCOM(bufferPairs[meshHandle].vertexBuffer);
+				ReleaseCOM(bufferPairs[meshHandle].indexBuffer);
+				ReleaseCOM(bufferPairs[meshHandle].instanceBuffer);
 			}
 
 			ReleaseResizeMaps();
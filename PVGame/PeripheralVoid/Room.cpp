@@ -1,154 +1,34 @@
 #include "Room.h"
 #include "Crest.h"
+#include "Profiler.h"
+#include "AllocationTracker.h"
+#include "CacheDirectory.h"
 
 Room::Room(const char* xmlFile, PhysicsManager* pm, float xPos, float zPos)
 {
+	ALLOC_SCOPE(ALLOC_ROOMS);
 	winRoom = false;
-			if(strcmp(xmlFile, "Assets/level1.xml") == 0)
-				int xqya = 1;
-	mapFile = xmlFile;
+	staticBody = NULL;
+	cookedMesh = NULL;
+	prepared = false;
+	nextObject = 0;
 	physicsMan = pm;
 	x = xPos;
 	z = zPos;
 
-	tinyxml2::XMLDocument doc;
+	// The description outlives every room, so the file name is kept from there
+	level = LevelDescription::load(xmlFile);
+	mapFile = level->file.c_str();
+	errorLoading = !level->loaded;
 
-	doc.LoadFile(xmlFile);
-	if(doc.ErrorID() != 0)
-	{
-		errorLoading = true;
-		return;
-	}else
-		errorLoading = false;
-	
-
-	// Set initial room dimensions
-	width = -100.0f;
-	depth = -100.0f;
-
-	mapOffsetX = 0.0f;
-	mapOffsetZ = 0.0f;
-
-	bool isFirst = true;
-
-	XMLElement* walls = doc.FirstChildElement( "level" )->FirstChildElement( "walls" );
-
-	// Find room walls
-	for (XMLElement* wall = walls->FirstChildElement("wall"); wall != NULL; wall = wall->NextSiblingElement("wall"))
-	{
-		// Get information from xml
-		const char* row = wall->Attribute("row");
-		const char* col = wall->Attribute("col");
-
-		const char* xLength = wall->Attribute("xLength");
-		const char* zLength = wall->Attribute("zLength");
-
-		if (isFirst)
-		{
-			mapOffsetX = (float)-atof(col);
-			mapOffsetZ = (float)-atof(row);
-
-			isFirst = false;
-		}
-
-		else
-		{
-			if (atof(col) < -mapOffsetX)
-				mapOffsetX = (float)-atof(col);
-		}
-
-		// increase room dimensions if necessary
-		if (atof(col) + atof(xLength) + 1 + mapOffsetX > width)
-			width = (float)atof(col) + (float)atof(xLength) + (float)mapOffsetX;
-		if (atof(row) + atof(zLength) + 1 + mapOffsetZ > depth)
-			depth = (float)atof(row) + (float)atof(zLength) + (float)mapOffsetZ;
-	}
-
-	XMLElement* exits = doc.FirstChildElement( "level" )->FirstChildElement( "exits" );
-
-	// Find room exits
-	for (XMLElement* exit = exits->FirstChildElement("exit"); exit != NULL; exit = exit->NextSiblingElement("exit"))
-	{
-		Wall* tempWall = new Wall();
-
-		// Get information from xml
-		const char* row = exit->Attribute("row");
-		const char* col = exit->Attribute("col");
-		const char* file = exit->Attribute("file");
-		const char* xLength = exit->Attribute("xLength");
-		const char* zLength = exit->Attribute("zLength");
-		const char* centerX = exit->Attribute("centerX");
-		const char* centerY = exit->Attribute("centerY");
-		const char* centerZ = exit->Attribute("centerZ");
-
-		// Get full filename of xml file
-		char folder[80] = "Assets/";
-		const char* fullFile = strcat(folder, file);
-
-		// Store exit information in Wall object
-		tempWall->row = (float)atof(row) + mapOffsetZ;
-		tempWall->col = (float)atof(col) + mapOffsetX;
-		tempWall->xLength = (float)atof(xLength);
-		tempWall->zLength = (float)atof(zLength);
-		tempWall->centerX = (float)atof(centerX) + mapOffsetX;
-		tempWall->centerY = (float)atof(centerY);
-		tempWall->centerZ = (float)atof(centerZ) + mapOffsetZ;
-		tempWall->file = fullFile;
-		tempWall->direction = "";
-
-		// Add to exit vector
-		exitVector.push_back(tempWall);
-	}
+	width = level->width;
+	depth = level->depth;
+	mapOffsetX = level->mapOffsetX;
+	mapOffsetZ = level->mapOffsetZ;
 }
 
 Room::~Room(void)
 {
-	for (unsigned int i = 0; i < floorVector.size(); ++i)
-	{
-		Wall* temp = floorVector[floorVector.size() - 1];
-		floorVector.pop_back();
-		delete temp;
-		--i;
-	}
-	//floorVector.clear();
-
-	for (unsigned int i = 0; i < exitVector.size(); ++i)
-	{
-		Wall* temp = exitVector[exitVector.size() - 1];
-		exitVector.pop_back();
-		delete temp;
-		--i;
-	}
-	//exitVector.clear();
-
-	for (unsigned int i = 0; i < spawnVector.size(); ++i)
-	{
-		Wall* temp = spawnVector[spawnVector.size() - 1];
-		spawnVector.pop_back();
-		delete temp;
-		--i;
-	}
-	//spawnVector.clear();
-
-
-	for (unsigned int i = 0; i < cubeVector.size(); ++i)
-	{
-		Cube* temp = cubeVector[cubeVector.size() - 1];
-		cubeVector.pop_back();
-		delete temp;
-		--i;
-	}
-	//cubeVector.clear();
-
-	for (unsigned int i = 0; i < crestVector.size(); ++i)
-	{
-		Wall* temp = crestVector[crestVector.size() - 1];
-		crestVector.pop_back();
-		delete temp;
-		--i;
-	}
-	//crestVector.clear();
-
 	for (unsigned int i = 0; i < gameObjs.size(); ++i)
 	{
 		GameObject* temp = gameObjs[gameObjs.size() - 1];
@@ -157,354 +37,316 @@ Room::~Room(void)
 		--i;
 	}
 	//gameObjs.clear();
+
+	if (staticBody)
+		physicsMan->removeRigidBodyFromWorld(staticBody);
+	if (cookedMesh)
+		PhysicsManager::deleteStaticMesh(cookedMesh);
 }
 
 void Room::loadRoom(void)
 {
-	loadRoom(x, z);
+	loadObjects(0);
 }
 
-void Room::loadRoom(float xPos, float zPos)
+// Walls stand on their center, the box is lifted by half its height
+static StaticBox WallBox(const Wall& wall)
 {
-	tinyxml2::XMLDocument doc;
+	StaticBox box = { wall.centerX, wall.yLength / 2 + wall.centerY, wall.centerZ, wall.xLength, wall.yLength, wall.zLength };
+	return box;
+}
 
-	doc.LoadFile(mapFile);
+// Floors are always a unit thick with their top at centerY
+static StaticBox FloorBox(const Wall& floor)
+{
+	StaticBox box = { floor.centerX, floor.centerY - 0.5f, floor.centerZ, floor.xLength, 1.0f, floor.zLength };
+	return box;
+}
 
-	XMLElement* walls = doc.FirstChildElement( "level" )->FirstChildElement( "walls" );
-	XMLElement* floors = doc.FirstChildElement( "level" )->FirstChildElement( "floors" );
-	XMLElement* spawns = doc.FirstChildElement( "level" )->FirstChildElement( "spawns" );
-	XMLElement* cubes = doc.FirstChildElement( "level" )->FirstChildElement( "cubes" );
-	XMLElement* crests = doc.FirstChildElement( "level" )->FirstChildElement( "crests" );
+/* prepareRoom()
+ *
+ * Does the part of loading that needs neither the physics world nor the renderer, which
+ * is cooking the one static mesh all the walls and floors collide as. Can run on another
+ * thread as long as nothing else touches this room meanwhile. loadObjects() calls it if
+ * it hasn't been.
+ */
+void Room::prepareRoom(void)
+{
+	if (prepared)
+		return;
+	prepared = true;
+
+	#if MERGE_STATIC_GEOMETRY
+	PROFILE("Room Cook");
+	ALLOC_SCOPE(ALLOC_ROOMS);
+	const vector<Wall>& walls = level->walls;
+	const vector<Wall>& floors = level->floors;
+
+	// Walls and floors only get drawn on their own, their collision is one triangle mesh for the whole room.
+	// The boxes are kept relative to the room so the same cooked mesh works wherever the room ends up.
+	vector<StaticBox> staticBoxes;
+
+	staticBoxes.reserve(walls.size() + floors.size());
+	for (unsigned int i = 0; i < walls.size(); i++)
+		staticBoxes.push_back(WallBox(walls[i]));
+	for (unsigned int i = 0; i < floors.size(); i++)
+		staticBoxes.push_back(FloorBox(floors[i]));
+
+	#if CACHE_ROOM_PHYSICS
+	// Rooms get reloaded a lot, so the cooked mesh is kept in the user's cache. If it can't be
+	// written the room still loads, it just gets cooked again next time.
+	string cacheFile = CacheDirectory::fileFor(mapFile, ".phys");
+	unsigned int boxHash = PhysicsManager::hashStaticBoxes(staticBoxes);
+
+	cookedMesh = PhysicsManager::loadStaticBoxMesh(cacheFile, boxHash);
+	if (!cookedMesh)
+	{
+		cookedMesh = PhysicsManager::cookStaticBoxMesh(staticBoxes);
+		if (!CacheDirectory::create() || !PhysicsManager::saveStaticBoxMesh(cookedMesh, cacheFile, boxHash))
+			DBOUT("Could not cache " << cacheFile.c_str());
+	}
+	#else
+	cookedMesh = PhysicsManager::cookStaticBoxMesh(staticBoxes);
+	#endif
+	#endif
+}
 
-	vector<vector<Wall*>> wallRowCol;
-	vector<Wall*> wallVector;
+/* loadObjects()
+ *
+ * Makes the room's game objects and puts their bodies in the world, at most maxObjects
+ * of them a call so a room can be spread over several frames. Walls come first, then
+ * floors, cubes and crests, since crests point at the cubes. Game thread only.
+ *
+ * param: maxObjects - most objects to make this call, 0 or less makes all that are left
+ * returns: true once every object in the room has been made
+ */
+bool Room::loadObjects(int maxObjects)
+{
+	PROFILE("Room Load");
+	ALLOC_SCOPE(ALLOC_ROOMS);
+	prepareRoom();
 
-	wallRowCol.assign(25, wallVector);
+	const vector<Wall>& walls = level->walls;
+	const vector<Wall>& floors = level->floors;
+	const vector<Cube>& cubes = level->cubes;
+	const vector<Wall>& crests = level->crests;
+	unsigned int objectCount = walls.size() + floors.size() + cubes.size() + crests.size();
 
-	for (XMLElement* wall = walls->FirstChildElement("wall"); wall != NULL; wall = wall->NextSiblingElement("wall"))
+	if (nextObject == 0)
 	{
-		Wall* tempWall = new Wall();
-
-		const char* row = wall->Attribute("row");
-		const char* col = wall->Attribute("col");
-		const char* xLength = wall->Attribute("xLength");
-		const char* yLength = wall->Attribute("yLength");
-		const char* zLength = wall->Attribute("zLength");
-		const char* centerX = wall->Attribute("centerX");
-		const char* centerY = wall->Attribute("centerY");
-		const char* centerZ = wall->Attribute("centerZ");
-		const char* texture = wall->Attribute("texture");
-
-		tempWall->row = (float)atof(row) + mapOffsetZ;
-		tempWall->col = (float)atof(col) + mapOffsetX;
-		tempWall->xLength = (float)atof(xLength);
-		tempWall->yLength = (float)atof(yLength) + WALL_LOWERED;
-		tempWall->zLength = (float)atof(zLength);
-		tempWall->centerX = (float)atof(centerX) + mapOffsetX;
-		tempWall->centerY = (float)atof(centerY) - WALL_LOWERED;
-		tempWall->centerZ = (float)atof(centerZ) + mapOffsetZ;
-		tempWall->direction = "";
-		tempWall->file = "";
-		tempWall->texture = texture;
-	
-		wallRowCol[(unsigned int)atof(row) + (unsigned int)mapOffsetZ].push_back(tempWall);
+		// Make room in the physics pools for every body this room is about to create
+		int bodyCount = cubes.size() + crests.size();
+		#if MERGE_STATIC_GEOMETRY
+		bodyCount += 1;
+		#else
+		bodyCount += floors.size() + walls.size();
+		#endif
+		physicsMan->reserveBodies(bodyCount);
 	}
 
-	for (XMLElement* floor = floors->FirstChildElement("floor"); floor != NULL; floor = floor->NextSiblingElement("floor"))
+	for (int made = 0; nextObject <= objectCount && (maxObjects <= 0 || made < maxObjects); made++)
 	{
-		Wall* tempWall = new Wall();
-
-		const char* row = floor->Attribute("row");
-		const char* col = floor->Attribute("col");
-		const char* dir = floor->Attribute("dir");
-		const char* xLength = floor->Attribute("xLength");
-		const char* zLength = floor->Attribute("zLength");
-		const char* centerX = floor->Attribute("centerX");
-		const char* centerY = floor->Attribute("centerY");
-		const char* centerZ = floor->Attribute("centerZ");
-		const char* texture = floor->Attribute("texture");
-
-		tempWall->row = (float)atof(row) + mapOffsetZ;
-		tempWall->col = (float)atof(col) + mapOffsetX;
-		tempWall->xLength = (float)atof(xLength);
-		tempWall->zLength = (float)atof(zLength);
-		tempWall->centerX = (float)atof(centerX) + mapOffsetX;
-		tempWall->centerY = (float)atof(centerY);
-		tempWall->centerZ = (float)atof(centerZ) + mapOffsetZ;
-		tempWall->direction = "";
-		tempWall->file = "";
-		tempWall->texture = texture;
-	
-		floorVector.push_back(tempWall);
-	}
+		unsigned int i = nextObject;
 
-	for (XMLElement* spawn = spawns->FirstChildElement("spawn"); spawn != NULL; spawn = spawn->NextSiblingElement("spawn"))
-	{
-		Wall* tempWall = new Wall();
-
-		const char* row = spawn->Attribute("row");
-		const char* col = spawn->Attribute("col");
-		const char* dir = spawn->Attribute("dir");
-		const char* xLength = spawn->Attribute("xLength");
-		const char* zLength = spawn->Attribute("zLength");
-		const char* centerX = spawn->Attribute("centerX");
-		const char* centerY = spawn->Attribute("centerY");
-		const char* centerZ = spawn->Attribute("centerZ");
-
-		tempWall->row = (float)atof(row) + mapOffsetZ;
-		tempWall->col = (float)atof(col) + mapOffsetX;
-		tempWall->xLength = (float)atof(xLength);
-		tempWall->zLength = (float)atof(zLength);
-		tempWall->centerX = (float)atof(centerX) + mapOffsetX;
-		tempWall->centerY = (float)atof(centerY);
-		tempWall->centerZ = (float)atof(centerZ) + mapOffsetZ;
-		tempWall->direction = dir;
-		tempWall->file = "";
-	
-		spawnVector.push_back(tempWall);
-	}
+		#if MERGE_STATIC_GEOMETRY
+		// The floors have to be in the world before anything can land on them
+		if (i == walls.size() + floors.size() && cookedMesh)
+		{
+			staticBody = physicsMan->createStaticMeshBody(cookedMesh, x, 0.0f, z);
+			physicsMan->addRigidBodyToWorld(staticBody, WORLD);
+			cookedMesh = NULL;
+		}
+		#endif
+
+		if (i < walls.size())
+			loadWall(walls[i]);
+		else if ((i -= walls.size()) < floors.size())
+			loadFloor(floors[i]);
+		else if ((i -= floors.size()) < cubes.size())
+			loadCube(cubes[i]);
+		else if ((i -= cubes.size()) < crests.size())
+			loadCrest(crests[i]);
+		else
+			break;
 
-	for (XMLElement* cube = cubes->FirstChildElement("cube"); cube != NULL; cube = cube->NextSiblingElement("cube"))
-	{
-		Cube* tempCube = new Cube();
-
-		const char* row = cube->Attribute("row");
-		const char* col = cube->Attribute("col");
-		const char* xLength = cube->Attribute("xLength");
-		const char* yLength = cube->Attribute("yLength");
-		const char* zLength = cube->Attribute("zLength");
-		const char* centerX = cube->Attribute("centerX");
-		const char* centerY = cube->Attribute("centerY");
-		const char* centerZ = cube->Attribute("centerZ");
-		const char* translateX = cube->Attribute("translateX");
-		const char* translateY = cube->Attribute("translateY");
-		const char* translateZ = cube->Attribute("translateZ");
-		const char* texture = cube->Attribute("texture");
-
-		tempCube->row = (float)atof(row) + mapOffsetZ;
-		tempCube->col = (float)atof(col) + mapOffsetX;
-		tempCube->xLength = (float)atof(xLength);
-		tempCube->yLength = (float)atof(yLength);
-		tempCube->zLength = (float)atof(zLength);
-		tempCube->centerX = (float)atof(centerX) + mapOffsetX;
-		tempCube->centerY = (float)atof(centerY);
-		tempCube->centerZ = (float)atof(centerZ) + mapOffsetZ;
-		tempCube->translateX = (float)atof(translateX);
-		tempCube->translateY = (float)atof(translateY);
-		tempCube->translateZ = (float)atof(translateZ);
-		tempCube->direction = "";
-		tempCube->file = "";
-		tempCube->texture = texture;
-	
-		cubeVector.push_back(tempCube);
+		nextObject++;
 	}
 
-	for (XMLElement* crest = crests->FirstChildElement("crest"); crest != NULL; crest = crest->NextSiblingElement("crest"))
-	{
-		Wall* tempWall = new Wall();
-
-		const char* row = crest->Attribute("row");
-		const char* col = crest->Attribute("col");
-		const char* dir = crest->Attribute("dir");
-		const char* effect = crest->Attribute("effect");
-		const char* xLength = crest->Attribute("xLength");
-		const char* yLength = crest->Attribute("yLength");
-		const char* zLength = crest->Attribute("zLength");
-		const char* centerX = crest->Attribute("centerX");
-		const char* centerY = crest->Attribute("centerY");
-		const char* centerZ = crest->Attribute("centerZ");
-		const char* target = crest->Attribute("target");
-		const char* placement = crest->Attribute("placement");
-
-		tempWall->row = (float)atof(row) + mapOffsetZ;
-		tempWall->col = (float)atof(col) + mapOffsetX;
-		tempWall->xLength = (float)atof(xLength);
-		tempWall->yLength = (float)atof(yLength);
-		tempWall->zLength = (float)atof(zLength);
-		tempWall->centerX = (float)atof(centerX) + mapOffsetX;
-		tempWall->centerY = (float)atof(centerY);
-		tempWall->centerZ = (float)atof(centerZ) + mapOffsetZ;
-		tempWall->xRotation = 0.0f;
-		tempWall->yRotation = 0.0f;
-		tempWall->zRotation = 0.0f;
-		tempWall->direction = dir;
-		tempWall->file = "";
-		tempWall->effect = static_cast<CREST_TYPE>(atoi(effect));
-		tempWall->target = target;
-
-		if (strcmp(placement, "platform") == 0)
-			tempWall->yLength *= 0.5f;
-
-		if (strcmp(dir, "up") == 0)
-		{
-			if (strcmp(placement, "") == 0)
-				tempWall->centerZ -= 0.4f;
+	return nextObject >= objectCount && cookedMesh == NULL;
+}
 
-			if (strcmp(placement, "wall") == 0)
-			{
-				tempWall->zLength *= 0.1f;
-			}
-		}
+void Room::loadWall(const Wall& wall)
+{
+	#if MERGE_STATIC_GEOMETRY
+	StaticBox box = WallBox(wall);
+	XMMATRIX world = XMMatrixScaling(box.xLength, box.yLength, box.zLength) * XMMatrixTranslation(box.centerX + x, box.centerY, box.centerZ + z);
+	GameObject* wallObj = new GameObject("Cube", wall.texture, &world, physicsMan);
+	#else
+	GameObject* wallObj = new GameObject("Cube", wall.texture, physicsMan->createRigidBody("Cube", wall.centerX + x, wall.yLength / 2 + wall.centerY, wall.centerZ + z, wall.xLength, wall.yLength, wall.zLength), physicsMan, WORLD);
+	#endif
+	wallObj->SetTexScale(max(wall.xLength, wall.zLength), wall.yLength, 0.0f, 1.0f);
+	gameObjs.push_back(wallObj);
+}
 
-		if (strcmp(dir, "down") == 0)
-		{
-			if (strcmp(placement, "") == 0)
-				tempWall->centerZ += 0.4f;
+void Room::loadFloor(const Wall& floor)
+{
+	#if MERGE_STATIC_GEOMETRY
+	StaticBox box = FloorBox(floor);
+	XMMATRIX world = XMMatrixScaling(box.xLength, box.yLength, box.zLength) * XMMatrixTranslation(box.centerX + x, box.centerY, box.centerZ + z);
+	GameObject* floorObj = new GameObject("Cube", floor.texture, &world, physicsMan);
+	#else
+	GameObject* floorObj = new GameObject("Cube", floor.texture, physicsMan->createRigidBody("Cube", floor.centerX + x, floor.centerY - 0.5f, floor.centerZ + z, floor.xLength, 1.0f, floor.zLength), physicsMan, WORLD);
+	#endif
+	floorObj->SetTexScale(floor.xLength, floor.zLength, 0.0f, 1.0f);
+	gameObjs.push_back(floorObj);
+}
 
-			if (strcmp(placement, "wall") == 0)
-			{
-				tempWall->zLength *= 0.1f;
-				//tempWall->yLength = 1.0f;
-			}
-		}
+void Room::loadCube(const Cube& cube)
+{
+	MovingObject* cubeObj = new MovingObject("Cube", cube.texture, physicsMan->createRigidBody("Cube", cube.centerX + x, cube.centerY + cube.yLength / 2, cube.centerZ + z, cube.xLength, cube.yLength, cube.zLength), physicsMan);
+	cubeObj->SetTexScale(cube.xLength, cube.zLength, 0.0f, 1.0f);
+	cubeObj->AddPosition(XMFLOAT3(cube.centerX + x, cube.centerY + cube.yLength / 2, cube.centerZ + z));
+	cubeObj->AddPosition(XMFLOAT3(cube.centerX + x + cube.translateX, cube.centerY + (cube.yLength / 2) + cube.translateY, cube.centerZ + z + cube.translateZ));
 
-		if (strcmp(dir, "right") == 0)
-		{
-			if (strcmp(placement, "") == 0)
-			{
-				tempWall->centerX -= 0.4f;
-				tempWall->xRotation = 3.14f / 2.0f;
-			}
+	float rowId = cube.row - mapOffsetZ;
+	float colId = cube.col - mapOffsetX;
+	
+	char rowChar[30];
+	char colChar[30];
 
-			if (strcmp(placement, "wall") == 0)
-			{
-				tempWall->xLength *= 0.1f;
-			}
-		}
-		if (strcmp(dir, "left") == 0)
-		{
-			if (strcmp(placement, "") == 0)
-			{
-				tempWall->centerX += 0.4f;
-				tempWall->xRotation = -3.14f / 2.0f;
-			}
+	itoa((int)rowId, rowChar, 10); 
+	itoa((int)colId, colChar, 10); 
 
-			if (strcmp(placement, "wall") == 0)
-			{
-				tempWall->xLength *= 0.1f;
-				//tempWall->yLength = 1.0f;
-			}
-		}
+	strcat(rowChar, "|");
+	strcat(rowChar, colChar);
 
-		tempWall->centerY = tempWall->centerY + tempWall->yLength / 2;
+	string mapString = rowChar;
 
-		crestVector.push_back(tempWall);
-	}
-	
-	// Create walls and add to GameObject vector
-	for (unsigned int i = 0; i < wallRowCol.size(); i++)
-	{
-		for (unsigned int j = 0; j < wallRowCol[i].size(); j++)
-		{
-			GameObject* wallObj = new GameObject("Cube", wallRowCol[i][j]->texture, physicsMan->createRigidBody("Cube", wallRowCol[i][j]->centerX + xPos, wallRowCol[i][j]->yLength / 2 + wallRowCol[i][j]->centerY, wallRowCol[i][j]->centerZ + zPos), physicsMan, WORLD);
-			wallObj->scale(wallRowCol[i][j]->xLength, wallRowCol[i][j]->yLength, wallRowCol[i][j]->zLength);
-			wallObj->SetTexScale(max(wallRowCol[i][j]->xLength, wallRowCol[i][j]->zLength), wallRowCol[i][j]->yLength, 0.0f, 1.0f);
-			gameObjs.push_back(wallObj);
-		}
-	}
+	if (strcmp(mapString.c_str(), "") != 0)
+		cubeMap[mapString] = cubeObj;
 
-	for (unsigned int i = 0; i < floorVector.size(); i++)
-	{
-		GameObject* floorObj = new GameObject("Cube", floorVector[i]->texture, physicsMan->createRigidBody("Cube", floorVector[i]->centerX + xPos, floorVector[i]->centerY - 0.5f, floorVector[i]->centerZ + zPos), physicsMan, WORLD);
-		floorObj->scale(floorVector[i]->xLength, 1.0f, floorVector[i]->zLength);
-		floorObj->SetTexScale(floorVector[i]->xLength, floorVector[i]->zLength, 0.0f, 1.0f);
-		gameObjs.push_back(floorObj);
-	}
+	gameObjs.push_back(cubeObj);
+}
 
-	for (unsigned int i = 0; i < cubeVector.size(); i++)
+void Room::loadCrest(const Wall& crest)
+{
+	GameObject* crestObj;
+	switch(crest.effect)
 	{
-		MovingObject* cubeObj = new MovingObject("Cube", cubeVector[i]->texture, physicsMan->createRigidBody("Cube", cubeVector[i]->centerX + xPos, cubeVector[i]->centerY + cubeVector[i]->yLength / 2, cubeVector[i]->centerZ + zPos), physicsMan);
-		cubeObj->scale(cubeVector[i]->xLength, cubeVector[i]->yLength, cubeVector[i]->zLength);
-		cubeObj->SetTexScale(cubeVector[i]->xLength, cubeVector[i]->zLength, 0.0f, 1.0f);
-		cubeObj->AddPosition(XMFLOAT3(cubeVector[i]->centerX + xPos, cubeVector[i]->centerY + cubeVector[i]->yLength / 2, cubeVector[i]->centerZ + zPos));
-		cubeObj->AddPosition(XMFLOAT3(cubeVector[i]->centerX + xPos + cubeVector[i]->translateX, cubeVector[i]->centerY + (cubeVector[i]->yLength / 2) + cubeVector[i]->translateY, cubeVector[i]->centerZ + zPos + cubeVector[i]->translateZ));
-
-		float rowId = cubeVector[i]->row - mapOffsetZ;
-		float colId = cubeVector[i]->col - mapOffsetX;
-		
-		char rowChar[30];
-		char colChar[30];
+	case MEDUSA:
+		crestObj = new Crest("medusacrest", "MedusaCrest", physicsMan->createRigidBody("Cube", crest.centerX + x, crest.centerY + crest.yLength, crest.centerZ + z, 0.0f), physicsMan, crest.effect, 0.0f);
+		crestObj->SetTexScale(0.0f, 0.0f, 0.0f, 0.0f);
+		break;
+	case LEAP:
+		crestObj = new Crest("medusacrest", "LeapCrest", physicsMan->createRigidBody("Cube", crest.centerX + x, crest.centerY + crest.yLength, crest.centerZ + z, 0.0f), physicsMan, crest.effect, 0.0f);
+		crestObj->SetTexScale(0.0f, 0.0f, 0.0f, 0.0f);
+		break;
+	case MOBILITY:
+		crestObj = new Crest("medusacrest", "MobilityCrest", physicsMan->createRigidBody("Cube", crest.centerX + x, crest.centerY + crest.yLength, crest.centerZ + z, 0.0f), physicsMan, crest.effect, 0.0f);
+		crestObj->SetTexScale(0.0f, 0.0f, 0.0f, 0.0f);
+		break;
+	case UNLOCK:
+		crestObj = new Crest("unlockcrest", "UnlockCrest", physicsMan->createRigidBody("Cube", crest.centerX + x, crest.centerY + crest.yLength, crest.centerZ + z, 0.0f), physicsMan, crest.effect, 0.0f);
+		crestObj->SetTexScale(0.0f, 0.0f, 0.0f, 0.0f);
+		break;
+	case HADES:
+		crestObj = new Crest("Cube", "HadesCrest", physicsMan->createRigidBody("Cube", crest.centerX + x, crest.centerY, crest.centerZ + z, crest.xLength, crest.yLength, crest.zLength, 0.0f), physicsMan, crest.effect, 0.0f);
+		crestObj->SetTexScale(2.0f, 2.0f, 0.0f, 1.0f);
+		break;
+	case WIN:
+		crestObj = new Crest("boat", "WinCrest", physicsMan->createRigidBody("Cube", crest.centerX + x, crest.centerY + crest.yLength, crest.centerZ + z, 0.0f), physicsMan, crest.effect, 0.0f);
+		crestObj->SetTexScale(0.0f, 0.0f, 0.0f, 0.0f);
+		winRoom = true;
+		break;
+	case HEPHAESTUS:
+		crestObj = new Crest("unlockcrest", "HephaestusCrest", physicsMan->createRigidBody("Cube", crest.centerX + x, crest.yLength + crest.centerY, crest.centerZ + z, 0.0f), physicsMan, crest.effect, 0.0f);
+		crestObj->SetTexScale(0.0f, 0.0f, 0.0f, 0.0f);
+		break;
+	}
 
-		itoa((int)rowId, rowChar, 10); 
-		itoa((int)colId, colChar, 10); 
+	crestObj->rotate(crest.xRotation, crest.yRotation, crest.zRotation);
 
-		strcat(rowChar, "|");
-		strcat(rowChar, colChar);
+	dynamic_cast<Crest*>(crestObj)->SetTargetObject(cubeMap[crest.target]);
 
-		string mapString = rowChar;
+	gameObjs.push_back(crestObj);
+}
 
-		if (strcmp(mapString.c_str(), "") != 0)
-			cubeMap[mapString] = cubeObj;
+// Exits that don't name a file under Assets lead out of the game rather than to another room
+bool Room::leadsToRoom(const Wall& exit)
+{
+	return strcmp(exit.file.substr(0, 6).c_str(), "Assets") == 0;
+}
 
-		gameObjs.push_back(cubeObj);
+/* placeBeside()
+ *
+ * Moves this room so its entrance from another room lines up with that room's exit.
+ * Takes the other room's description and position rather than the room, so a room being
+ * loaded on another thread doesn't care if the one it was reached from goes away.
+ *
+ * params: from  - description of the room the exit is in
+ *         fromX - where that room is
+ *         fromZ
+ *         exit  - the exit of that room that leads here
+ * returns: false if this room has no exit back
+ */
+bool Room::placeBeside(const LevelDescription* from, float fromX, float fromZ, const Wall& exit)
+{
+	const Wall* roomEntrance = NULL;
+	for (unsigned int j = 0; j < level->exits.size(); j++)
+	{
+		if (level->exits[j].file == from->file)
+			roomEntrance = &level->exits[j];
 	}
+	if (roomEntrance == NULL)
+		return false;
 
-	for (unsigned int i = 0; i < crestVector.size(); i++)
+	float offsetX = fromX, offsetZ = fromZ;
+	if (exit.row == 0)
 	{
-		GameObject* crestObj;
-		switch(crestVector[i]->effect)
-		{
-		case MEDUSA:
-			crestObj = new Crest("medusacrest", "MedusaCrest", physicsMan->createRigidBody("Cube", crestVector[i]->centerX + xPos, crestVector[i]->centerY + crestVector[i]->yLength, crestVector[i]->centerZ + zPos, 0.0f), physicsMan, crestVector[i]->effect, 0.0f);
-			crestObj->SetTexScale(0.0f, 0.0f, 0.0f, 0.0f);
-			break;
-		case LEAP:
-			crestObj = new Crest("medusacrest", "LeapCrest", physicsMan->createRigidBody("Cube", crestVector[i]->centerX + xPos, crestVector[i]->centerY + crestVector[i]->yLength, crestVector[i]->centerZ + zPos, 0.0f), physicsMan, crestVector[i]->effect, 0.0f);
-			crestObj->SetTexScale(0.0f, 0.0f, 0.0f, 0.0f);
-			break;
-		case MOBILITY:
-			crestObj = new Crest("medusacrest", "MobilityCrest", physicsMan->createRigidBody("Cube", crestVector[i]->centerX + xPos, crestVector[i]->centerY + crestVector[i]->yLength, crestVector[i]->centerZ + zPos, 0.0f), physicsMan, crestVector[i]->effect, 0.0f);
-			crestObj->SetTexScale(0.0f, 0.0f, 0.0f, 0.0f);
-			break;
-		case UNLOCK:
-			crestObj = new Crest("unlockcrest", "UnlockCrest", physicsMan->createRigidBody("Cube", crestVector[i]->centerX + xPos, crestVector[i]->centerY + crestVector[i]->yLength, crestVector[i]->centerZ + zPos, 0.0f), physicsMan, crestVector[i]->effect, 0.0f);
-			crestObj->SetTexScale(0.0f, 0.0f, 0.0f, 0.0f);
-			break;
-		case HADES:
-			crestObj = new Crest("Cube", "HadesCrest", physicsMan->createRigidBody("Cube", crestVector[i]->centerX + xPos, crestVector[i]->centerY, crestVector[i]->centerZ + zPos, 0.0f), physicsMan, crestVector[i]->effect, 0.0f);
-			crestObj->scale(crestVector[i]->xLength, crestVector[i]->yLength, crestVector[i]->zLength);
-			crestObj->SetTexScale(2.0f, 2.0f, 0.0f, 1.0f);
-			break;
-		case WIN:
-			crestObj = new Crest("boat", "WinCrest", physicsMan->createRigidBody("Cube", crestVector[i]->centerX + xPos, crestVector[i]->centerY + crestVector[i]->yLength, crestVector[i]->centerZ + zPos, 0.0f), physicsMan, crestVector[i]->effect, 0.0f);
-			crestObj->SetTexScale(0.0f, 0.0f, 0.0f, 0.0f);
-			winRoom = true;
-			break;
-		case HEPHAESTUS:
-			crestObj = new Crest("unlockcrest", "HephaestusCrest", physicsMan->createRigidBody("Cube", crestVector[i]->centerX + xPos, crestVector[i]->yLength + crestVector[i]->centerY, crestVector[i]->centerZ + zPos, 0.0f), physicsMan, crestVector[i]->effect, 0.0f);
-			crestObj->SetTexScale(0.0f, 0.0f, 0.0f, 0.0f);
-			break;
-		}
-
-		crestObj->rotate(crestVector[i]->xRotation, crestVector[i]->yRotation, crestVector[i]->zRotation);
+		offsetX -= (roomEntrance->centerX - exit.centerX);
+		offsetZ -= depth;
+	}
 
-		dynamic_cast<Crest*>(crestObj)->SetTargetObject(cubeMap[crestVector[i]->target]);
+	if (exit.row == from->depth - 1)
+	{
+		offsetX -= (roomEntrance->centerX - exit.centerX);
+		offsetZ += from->depth;
+	}
 
-		gameObjs.push_back(crestObj);
+	if (exit.col == 0)
+	{
+		offsetX -= width;
+		offsetZ -= (roomEntrance->centerZ - exit.centerZ);
 	}
 
-	for (unsigned int i = 0; i < wallRowCol.size(); ++i)
-		for (unsigned int j = 0; j < wallRowCol[i].size(); ++j)
-			delete wallRowCol[i][j];
+	if (exit.col == from->width - 1)
+	{
+		offsetX += from->width;
+		offsetZ -= (roomEntrance->centerZ - exit.centerZ);
+	}
 
-	#pragma endregion
+	x = offsetX;
+	z = offsetZ;
+	return true;
 }
 
-void Room::loadNeighbors(vector<Room*> loadedRooms)
+void Room::loadNeighbors(const vector<Room*>& loadedRooms)
 {
+	PROFILE("Load Neighbors");
+	ALLOC_SCOPE(ALLOC_ROOMS);
 	// Clear neighbors
 	neighbors.clear();
 
 	Room* loadedRoom;
 
 	// Check exits
-	for (unsigned int i = 0; i < exitVector.size(); i++)
+	for (unsigned int i = 0; i < level->exits.size(); i++)
 	{
 		bool isLoaded = false;
 
 		for (unsigned int j = 0; j < loadedRooms.size(); j++)
 		{
-			if (strcmp(loadedRooms[j]->getFile(), exitVector[i]->file.c_str()) == 0)
+			if (strcmp(loadedRooms[j]->getFile(), level->exits[i].file.c_str()) == 0)
 			{
 				isLoaded = true;
 				loadedRoom = loadedRooms[j];
@@ -513,53 +355,17 @@ void Room::loadNeighbors(vector<Room*> loadedRooms)
 
 		if (!isLoaded)
 		{
-			float offsetX = x, offsetZ = z;
-			if(strcmp(exitVector[i]->file.substr(0, 6).c_str(), "Assets") == 0)
+			if(leadsToRoom(level->exits[i]))
 			{
-				Room* tmpRoom = new Room(exitVector[i]->file.c_str(), physicsMan, 0, 0); 
-				Wall* roomEntrance;
+				Room* tmpRoom = new Room(level->exits[i].file.c_str(), physicsMan, 0, 0); 
 
-				if(tmpRoom->errorLoading == true)
+				if(tmpRoom->errorLoading == true || !tmpRoom->placeBeside(level, x, z, level->exits[i]))
 				{
 					delete tmpRoom;
 				}
 				else
 				{
-					for (unsigned int j = 0; j < tmpRoom->getExits().size(); j++)
-					{
-						if (tmpRoom->getExits()[j]->file == mapFile)
-							roomEntrance = tmpRoom->getExits()[j];
-					}
-
-					if (exitVector[i]->row == 0)
-					{
-						offsetX -= (roomEntrance->centerX - exitVector[i]->centerX);
-						offsetZ -= tmpRoom->depth;
-					}
-
-					if (exitVector[i]->row == depth - 1)
-					{
-						offsetX -= (roomEntrance->centerX - exitVector[i]->centerX);
-						offsetZ += depth;
-					}
-
-					if (exitVector[i]->col == 0)
-					{
-						offsetX -= tmpRoom->width;
-						offsetZ -= (roomEntrance->centerZ - exitVector[i]->centerZ);
-					}
-
-					if (exitVector[i]->col == width - 1)
-					{
-						offsetX += width;
-						offsetZ -= (roomEntrance->centerZ - exitVector[i]->centerZ);
-					}
-
-					tmpRoom->setX(offsetX);
-					tmpRoom->setZ(offsetZ);
-
-					tmpRoom->loadRoom(offsetX, offsetZ);
-
+					tmpRoom->loadRoom();
 					neighbors.push_back(tmpRoom);
 				}
 			}
@@ -3,6 +3,7 @@
 #include "Constants.h"
 #include "PhysicsManager.h"
 #include "tinyxml2.h"
+#include "LevelDescription.h"
 
 using namespace tinyxml2;
 
@@ -13,30 +14,36 @@ class Room
 	public:
 		Room(const char* xmlFile, PhysicsManager* pm, float xPos, float zPos);
 		~Room(void);
-		vector<GameObject*> getGameObjs(void) { return gameObjs; }
+		const vector<GameObject*>& getGameObjs(void) const { return gameObjs; }
 		void loadRoom(void);
-		void loadNeighbors(vector<Room*> loadedRooms);
-		Wall* getSpawn(void){return spawnVector[0];};
+		void prepareRoom(void);
+		bool loadObjects(int maxObjects);
+		bool placeBeside(const LevelDescription* from, float fromX, float fromZ, const Wall& exit);
+		void loadNeighbors(const vector<Room*>& loadedRooms);
+		static bool leadsToRoom(const Wall& exit);
+		const Wall* getSpawn(void){return &level->spawns[0];};
 		float getX(void){return x;};
 		float getZ(void){return z;};
 		float getWidth(void){return width;};
 		float getDepth(void){return depth;};
 		const char* getFile(void){return mapFile;};
-		vector<Wall*> getExits(void){return exitVector;};
-		vector<Room*> getNeighbors(void){return neighbors;};
+		const vector<Wall>& getExits(void) const {return level->exits;};
+		const LevelDescription* getLevel(void) const {return level;};
+		vector<Room*>& getNeighbors(void){return neighbors;};
 		void setX(float xPos){x = xPos;};
 		void setZ(float zPos){z = zPos;};
 		bool hasWinCrest();
+		bool hasError(void){return errorLoading;};
 		int getNumNeighbors();
 		const char* getMapFile();
 	private:
 		PhysicsManager* physicsMan;
+		btRigidBody* staticBody; //All the walls and floors in one body when MERGE_STATIC_GEOMETRY is on
+		StaticMesh* cookedMesh;  //Mesh prepareRoom() cooked for staticBody, NULL once the body is made
+		bool prepared;
+		unsigned int nextObject; //How far loadObjects() has got through the room's objects
 		vector<GameObject*> gameObjs;
-		vector<Wall*> floorVector;
-		vector<Wall*> exitVector;
-		vector<Wall*> spawnVector;
-		vector<Cube*> cubeVector;
-		vector<Wall*> crestVector;
+		const LevelDescription* level; //Shared by every room made from the same file
 		vector<Room*> neighbors;
 		map<string, MovingObject*> cubeMap; 
 		const char* mapFile;
@@ -48,7 +55,10 @@ class Room
 		float height;
 		float mapOffsetX;
 		float mapOffsetZ;
-		void loadRoom(float xPos, float zPos);
+		void loadWall(const Wall& wall);
+		void loadFloor(const Wall& floor);
+		void loadCube(const Cube& cube);
+		void loadCrest(const Wall& crest);
 		bool winRoom;
 };
 
@@ -0,0 +1,302 @@
+#include "RoomSet.h"
+#include "Crest.h"
+#include "MovingObject.h"
+#include "Profiler.h"
+#include "AllocationTracker.h"
+#include <algorithm>
+
+RoomSet::RoomSet(PhysicsManager* pm, vector<GameObject*>* objects, RoomSetListener* aListener)
+{
+	physicsMan = pm;
+	gameObjects = objects;
+	listener = aListener;
+	startRoom = NULL;
+	currentRoom = NULL;
+	streamCenter = NULL;
+	roomStreamer = new RoomStreamer(physicsMan);
+}
+
+RoomSet::~RoomSet(void)
+{
+	clear();
+	delete roomStreamer;
+}
+
+/* load()
+ *
+ * Loads levelFile as the current room and builds the rooms around it.
+ *
+ * params: levelFile    - the start room's level xml
+ *         xPos, zPos   - where the start room goes
+ *         dontLoadRoom - a level never to load, say the area the player just left
+ */
+void RoomSet::load(const char* levelFile, float xPos, float zPos, const char* dontLoadRoom)
+{
+	startRoom = new Room(levelFile, physicsMan, xPos, zPos);
+	startRoom->loadRoom();
+	currentRoom = startRoom;
+	buildRooms(startRoom, dontLoadRoom);
+}
+
+void RoomSet::clear(void)
+{
+	// Rooms still streaming in never made it into loadedRooms, the streamer deletes those
+	roomStreamer->clear();
+	streamCenter = NULL;
+
+	for (unsigned int i = 0; i < loadedRooms.size(); i++)
+	{
+		for (unsigned int j = 0; j < loadedRooms[i]->getNeighbors().size(); j++)
+		{
+			loadedRooms[i]->getNeighbors()[j] = NULL;
+		}
+
+		delete loadedRooms[i];
+	}
+	loadedRooms.clear();
+	startRoom = NULL;
+	currentRoom = NULL;
+}
+
+void RoomSet::buildRooms(Room* room, const char* dontLoadRoom)
+{
+	PROFILE("Build Rooms");
+	ALLOC_SCOPE(ALLOC_ROOMS);
+
+	#if STREAM_ROOMS
+	// Only the start room is in so far, the rest come in through stream()
+	roomStreamer->skip(dontLoadRoom);
+	addRoom(room);
+	updateResidentRooms();
+	#else
+	bool isLoaded = false;
+
+	for (unsigned int i = 0; i < loadedRooms.size(); i++)
+	{
+		if (strcmp(loadedRooms[i]->getFile(), room->getFile()) == 0)
+		{
+			isLoaded = true;
+		}
+	}
+
+	if (!isLoaded && strcmp(room->getMapFile(), dontLoadRoom) != 0)
+	{
+		addRoom(room);
+
+		if(!room->hasWinCrest())
+			room->loadNeighbors(loadedRooms);
+
+		for (unsigned int i = 0; i < room->getNeighbors().size(); i++)
+		{
+			buildRooms(room->getNeighbors()[i], dontLoadRoom);
+		}
+	}
+	#endif
+}
+
+// Puts a loaded room's objects in the scene
+void RoomSet::addRoom(Room* room)
+{
+	const vector<GameObject*>& roomObjects = room->getGameObjs();
+	gameObjects->insert(gameObjects->end(), roomObjects.begin(), roomObjects.end());
+	loadedRooms.push_back(room);
+}
+
+/* stream()
+ *
+ * Adds a little more of whatever room is streaming in, and once the current room has
+ * changed, unloads and requests rooms to match. Only call this while the game owns the
+ * physics world.
+ *
+ * returns: true if a room came in or went out, the culler needs rebuilding then
+ */
+bool RoomSet::stream(void)
+{
+	Room* room = roomStreamer->update(ROOM_STREAM_BATCH);
+	if(room == NULL && currentRoom == streamCenter)
+		return false;
+
+	bool changed = false;
+	if(room != NULL)
+	{
+		addRoom(room);
+		if(listener)
+			listener->roomLoaded(room);
+		roomStreamer->report("load", room->getFile(), loadedRooms.size(), countResidentObjects());
+		changed = true;
+	}
+	if(updateResidentRooms())
+		changed = true;
+
+	return changed;
+}
+
+/* updateResidentRooms()
+ *
+ * Unloads every room more than ROOM_STREAM_DEPTH exits from the current one and requests
+ * the rooms past the ones closer than that. Distance only counts exits between loaded
+ * rooms, so a room cut off from the current one is unloaded too. The start room stays
+ * loaded however far away it is. Rooms past a win crest are never requested, same as
+ * buildRooms.
+ *
+ * returns: true if any room was unloaded
+ */
+bool RoomSet::updateResidentRooms(void)
+{
+	PROFILE("Resident Rooms");
+	streamCenter = currentRoom;
+
+	// Breadth first over the exits, hops stays -1 for rooms that can't be reached
+	vector<int> hops(loadedRooms.size(), -1);
+	vector<unsigned int> open;
+	for (unsigned int i = 0; i < loadedRooms.size(); i++)
+	{
+		if (loadedRooms[i] == currentRoom)
+		{
+			hops[i] = 0;
+			open.push_back(i);
+		}
+	}
+	if (open.empty())
+		return false;
+
+	for (unsigned int next = 0; next < open.size(); next++)
+	{
+		const vector<Wall>& exits = loadedRooms[open[next]]->getExits();
+		for (unsigned int i = 0; i < exits.size(); i++)
+		{
+			for (unsigned int j = 0; j < loadedRooms.size(); j++)
+			{
+				if (hops[j] == -1 && exits[i].file == loadedRooms[j]->getFile())
+				{
+					hops[j] = hops[open[next]] + 1;
+					open.push_back(j);
+				}
+			}
+		}
+	}
+
+	// Backwards, so unloading a room doesn't move the ones still to be looked at
+	bool unloaded = false;
+	for (int i = loadedRooms.size() - 1; i >= 0; i--)
+	{
+		if ((hops[i] == -1 || hops[i] > ROOM_STREAM_DEPTH) && loadedRooms[i] != startRoom)
+		{
+			unloadRoom(i);
+			unloaded = true;
+		}
+		else if (hops[i] < ROOM_STREAM_DEPTH && !loadedRooms[i]->hasWinCrest())
+			roomStreamer->request(loadedRooms[i]);
+	}
+
+	return unloaded;
+}
+
+// Takes a room's objects out of the scene and deletes it, which takes its bodies out of the world
+void RoomSet::unloadRoom(unsigned int index)
+{
+	Room* room = loadedRooms[index];
+	if(listener)
+		listener->roomUnloading(room);
+
+	vector<GameObject*> removed(room->getGameObjs().begin(), room->getGameObjs().end());
+	sort(removed.begin(), removed.end());
+
+	vector<GameObject*>& objects = *gameObjects;
+	unsigned int kept = 0;
+	for (unsigned int i = 0; i < objects.size(); i++)
+	{
+		if (!binary_search(removed.begin(), removed.end(), objects[i]))
+			objects[kept++] = objects[i];
+	}
+	objects.resize(kept);
+
+	// Rooms that loadNeighbors() linked to this one
+	for (unsigned int i = 0; i < loadedRooms.size(); i++)
+		replace(loadedRooms[i]->getNeighbors().begin(), loadedRooms[i]->getNeighbors().end(), room, (Room*)NULL);
+
+	loadedRooms.erase(loadedRooms.begin() + index);
+	roomStreamer->forget(room->getFile());
+	roomStreamer->report("unload", room->getFile(), loadedRooms.size(), countResidentObjects());
+	delete room;
+}
+
+int RoomSet::countResidentObjects(void)
+{
+	int count = 0;
+	for (unsigned int i = 0; i < loadedRooms.size(); i++)
+		count += loadedRooms[i]->getGameObjs().size();
+	return count;
+}
+
+// Makes whichever loaded room the player is standing over the current one
+void RoomSet::trackPlayer(Player* player)
+{
+	for (unsigned int i = 0; i < loadedRooms.size(); i++)
+	{
+		if ((player->getPosition().x > loadedRooms[i]->getX()) && (player->getPosition().x < (loadedRooms[i]->getX() + loadedRooms[i]->getWidth())) &&
+			(player->getPosition().z > loadedRooms[i]->getZ()) && (player->getPosition().z < (loadedRooms[i]->getZ() + loadedRooms[i]->getDepth())))
+		{
+			currentRoom = loadedRooms[i];
+			break;
+		}
+	}
+}
+
+// Puts the player on the current room's spawn, facing the way it says
+void RoomSet::spawnPlayer(Player* player)
+{
+	if(currentRoom)
+	{
+		player->setPosition((currentRoom->getX() + currentRoom->getSpawn()->centerX), currentRoom->getSpawn()->centerY + 4, (currentRoom->getZ() + currentRoom->getSpawn()->centerZ));
+		if(currentRoom->getSpawn()->direction.compare("up") == 0)
+			player->setRotation(3.14f/2.0f);
+		else if(currentRoom->getSpawn()->direction.compare("left") == 0)
+			player->setRotation(3.14f);
+		else if(currentRoom->getSpawn()->direction.compare("down") == 0)
+			player->setRotation((3.0f*3.14f)/2.0f);
+		else if(currentRoom->getSpawn()->direction.compare("right") == 0)
+			player->setRotation(3.14f *2.0f);
+	}
+}
+
+/* updateVisionAffected()
+ *
+ * Updates every vision affected object. Every crest that passes the broad phase goes to the
+ * narrow phase together, so their uncached rays share one walk of the broadphase trees,
+ * then each crest is told whether it's in view.
+ */
+void RoomSet::updateVisionAffected(Player* player)
+{
+	vector<GameObject*>& objects = *gameObjects;
+
+	crestTargets.clear();
+	for(unsigned int i = 0; i < objects.size(); i++)
+	{
+		if(objects[i]->GetVisionAffected() && dynamic_cast<Crest*>(objects[i]) && physicsMan->broadPhase(player->GetCamera(), objects[i]))
+			crestTargets.push_back(objects[i]);
+	}
+	physicsMan->narrowPhase(player->GetCamera(), crestTargets, crestInView);
+	unsigned int nextCrestTarget = 0;
+
+	for(unsigned int i = 0; i < objects.size(); i++)
+	{
+		if(!objects[i]->GetVisionAffected())
+			continue;
+
+		if(MovingObject* currentMovObj = dynamic_cast<MovingObject*>(objects[i]))
+			currentMovObj->Update();
+
+		if(Crest* currentCrest = dynamic_cast<Crest*>(objects[i]))
+		{
+			bool inView = false;
+			if(nextCrestTarget < crestTargets.size() && crestTargets[nextCrestTarget] == objects[i])
+				inView = crestInView[nextCrestTarget++];
+
+			currentCrest->ChangeView(inView);
+			if(inView && listener)
+				listener->crestInView(currentCrest);
+			currentCrest->Update(player);
+		}
+	}
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "Room.h"
+#include "RoomStreamer.h"
+
+class Player;
+class Crest;
+
+/* RoomSetListener
+ *
+ * Told when rooms stream in or out and when a crest is seen, for whatever the game does
+ * about those that the game logic can't, say drawing the room or blurring the screen.
+ */
+class RoomSetListener
+{
+	public:
+		//room's objects have just been added to the game objects
+		virtual void roomLoaded(Room* room) = 0;
+		//room's objects are about to be taken out of the game objects and deleted
+		virtual void roomUnloading(Room* room) = 0;
+		//Called every frame crest is in view, before it updates
+		virtual void crestInView(Crest* crest) = 0;
+};
+
+/* RoomSet
+ *
+ * The rooms that are loaded and everything the game logic does with them, with no
+ * renderer or sound, so PVGame and the headless runner load and play levels the same way.
+ *
+ * load() puts a level's start room in, then either every room connected to it or, with
+ * STREAM_ROOMS on, only the start room with the rest coming in through stream(). Each
+ * room's objects are added to the game objects it was given, and taken back out when a
+ * room is unloaded. clear() deletes every room but leaves emptying the game objects, which
+ * can hold more than the rooms' objects, to the caller.
+ *
+ * The listener, if there is one, is not told about the rooms load() adds, the caller
+ * builds whatever it needs for those once load() returns.
+ */
+class RoomSet
+{
+	public:
+		RoomSet(PhysicsManager* pm, vector<GameObject*>* objects, RoomSetListener* aListener = NULL);
+		~RoomSet(void);
+
+		void load(const char* levelFile, float xPos, float zPos, const char* dontLoadRoom);
+		void clear(void);
+		bool stream(void);
+
+		void trackPlayer(Player* player);
+		void spawnPlayer(Player* player);
+		void updateVisionAffected(Player* player);
+
+		Room* getStartRoom(void) { return startRoom; }
+		Room* getCurrentRoom(void) { return currentRoom; }
+		void setCurrentRoom(Room* room) { currentRoom = room; }
+		const vector<Room*>& getLoadedRooms(void) const { return loadedRooms; }
+		int countResidentObjects(void);
+
+		RoomStreamer* getStreamer(void) { return roomStreamer; }
+
+	private:
+		void buildRooms(Room* room, const char* dontLoadRoom);
+		void addRoom(Room* room);
+		bool updateResidentRooms(void);
+		void unloadRoom(unsigned int index);
+
+		PhysicsManager* physicsMan;
+		vector<GameObject*>* gameObjects;
+		RoomSetListener* listener;
+		vector<Room*> loadedRooms;
+		Room* startRoom;                  //The room load() started in, never unloaded so the player can be sent back to it
+		Room* currentRoom;
+		RoomStreamer* roomStreamer;       //Loads every room but the start one, when STREAM_ROOMS is on
+		Room* streamCenter;               //The current room when updateResidentRooms() last ran
+		vector<GameObject*> crestTargets; //Crests checked by this frame's batched narrow phase
+		vector<bool> crestInView;         //Narrow phase result for each of crestTargets
+};
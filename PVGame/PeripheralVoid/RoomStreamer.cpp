@@ -0,0 +1,236 @@
+#include "RoomStreamer.h"
+#include "Profiler.h"
+#include "AllocationTracker.h"
+
+RoomStreamer::RoomStreamer(PhysicsManager* pm)
+{
+	physicsMan = pm;
+	loading.room = NULL;
+	blocking = false;
+	stopThread = false;
+	generation = 0;
+
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	msPerTick = 1000.0 / (double)frequency.QuadPart;
+	lastLatency = 0.0;
+	totalLatency = 0.0;
+	worstLatency = 0.0;
+	roomsLoaded = 0;
+	roomsUnloaded = 0;
+
+	InitializeCriticalSection(&lock);
+	requestReady = CreateEvent(NULL, FALSE, FALSE, NULL);
+	loaderIdle = CreateEvent(NULL, TRUE, TRUE, NULL);
+	loaderThread = CreateThread(NULL, 0, loaderThreadProc, this, 0, NULL);
+}
+
+RoomStreamer::~RoomStreamer(void)
+{
+	clear();
+
+	stopThread = true;
+	SetEvent(requestReady);
+	WaitForSingleObject(loaderThread, INFINITE);
+	CloseHandle(loaderThread);
+	CloseHandle(requestReady);
+	CloseHandle(loaderIdle);
+	DeleteCriticalSection(&lock);
+
+	if(roomsLoaded > 0)
+	{
+		DBOUT("Room streaming: " << roomsLoaded << " loaded, " << roomsUnloaded << " unloaded, avg " <<
+			totalLatency / roomsLoaded << " ms from request to loaded, worst " << worstLatency << " ms");
+	}
+	if(out.is_open())
+		out.close();
+}
+
+//Never loads file, say the area the player just left, until the next clear()
+void RoomStreamer::skip(const char* file)
+{
+	knownFiles.insert(file);
+}
+
+//Lets file be requested again, only call this once its room is no longer loaded
+void RoomStreamer::forget(const char* file)
+{
+	knownFiles.erase(file);
+}
+
+/* request()
+ *
+ * Queues every room from's exits lead to that hasn't been requested yet. Only from's
+ * position is kept, so it can be unloaded while its neighbors are still loading.
+ *
+ * param: from - a room that is already loaded
+ */
+void RoomStreamer::request(Room* from)
+{
+	//Called whenever what's resident changes, so look before inserting to not allocate every time
+	if (knownFiles.find(from->getFile()) == knownFiles.end())
+		knownFiles.insert(from->getFile());
+
+	const vector<Wall>& exits = from->getExits();
+	bool queued = false;
+
+	EnterCriticalSection(&lock);
+	for (unsigned int i = 0; i < exits.size(); i++)
+	{
+		if (Room::leadsToRoom(exits[i]) && knownFiles.find(exits[i].file) == knownFiles.end())
+		{
+			knownFiles.insert(exits[i].file);
+			RoomRequest roomRequest = { from->getLevel(), from->getX(), from->getZ(), &exits[i], NULL };
+			QueryPerformanceCounter(&roomRequest.requested);
+			requests.push_back(roomRequest);
+			queued = true;
+		}
+	}
+	if (queued)
+	{
+		ResetEvent(loaderIdle);
+		SetEvent(requestReady);
+	}
+	LeaveCriticalSection(&lock);
+}
+
+/* update()
+ *
+ * Makes up to maxObjects objects of the room being streamed in, starting on the next
+ * cooked one if there's none. Only call this while the game owns the physics world.
+ * Blocking, it waits for the loader thread to cook everything requested before looking.
+ *
+ * param: maxObjects - most objects to add to the world this call
+ * returns: a room whose objects are all made, NULL if none finished this call
+ */
+Room* RoomStreamer::update(int maxObjects)
+{
+	PROFILE("Stream Rooms");
+	if (loading.room == NULL)
+	{
+		if (blocking)
+			WaitForSingleObject(loaderIdle, INFINITE);
+
+		EnterCriticalSection(&lock);
+		if (!cooked.empty())
+		{
+			loading = cooked.front();
+			cooked.pop_front();
+		}
+		LeaveCriticalSection(&lock);
+
+		if (loading.room == NULL)
+			return NULL;
+	}
+
+	if (!loading.room->loadObjects(maxObjects))
+		return NULL;
+
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	lastLatency = (double)(now.QuadPart - loading.requested.QuadPart) * msPerTick;
+	totalLatency += lastLatency;
+	worstLatency = max(worstLatency, lastLatency);
+	roomsLoaded++;
+
+	Room* room = loading.room;
+	loading.room = NULL;
+	return room;
+}
+
+//Drops every request and deletes the rooms made for them, without waiting on the one being cooked
+void RoomStreamer::clear(void)
+{
+	deque<RoomRequest> dropped;
+	EnterCriticalSection(&lock);
+	requests.clear();
+	dropped.swap(cooked);
+	generation++;
+	LeaveCriticalSection(&lock);
+
+	for (unsigned int i = 0; i < dropped.size(); i++)
+		delete dropped[i].room;
+
+	delete loading.room;
+	loading.room = NULL;
+	knownFiles.clear();
+}
+
+//Starts writing a csv row for every report() call
+bool RoomStreamer::openReport(string fileName)
+{
+	out.open(fileName.c_str());
+	if(out.is_open())
+		out << "event,room,latency ms,resident rooms,resident objects" << endl;
+	return out.is_open();
+}
+
+/* report()
+ *
+ * Records a room being loaded or unloaded, and what's resident after it.
+ *
+ * params: event           - "load" for a room update() just handed back, else "unload"
+ *         file            - the room's level file
+ *         residentRooms   - rooms loaded now
+ *         residentObjects - their game objects, all of them
+ */
+void RoomStreamer::report(const char* event, const char* file, int residentRooms, int residentObjects)
+{
+	bool load = strcmp(event, "load") == 0;
+	if(!load)
+		roomsUnloaded++;
+	if(out.is_open())
+		out << event << "," << file << "," << (load ? lastLatency : 0.0) << "," << residentRooms << "," << residentObjects << endl;
+}
+
+DWORD WINAPI RoomStreamer::loaderThreadProc(LPVOID param)
+{
+	((RoomStreamer*)param)->runLoaderThread();
+	return 0;
+}
+
+//Loader thread loop, cooks requested rooms until there are none left then waits for more
+void RoomStreamer::runLoaderThread()
+{
+	ALLOC_SCOPE(ALLOC_ROOMS);
+	while (!stopThread)
+	{
+		WaitForSingleObject(requestReady, INFINITE);
+
+		while (true)
+		{
+			EnterCriticalSection(&lock);
+			if (stopThread || requests.empty())
+			{
+				SetEvent(loaderIdle);
+				LeaveCriticalSection(&lock);
+				break;
+			}
+			RoomRequest roomRequest = requests.front();
+			requests.pop_front();
+			LONG requestGeneration = generation;
+			LeaveCriticalSection(&lock);
+
+			// Rooms are placed at 0, 0 and moved once their size is known, same as Room::loadNeighbors
+			roomRequest.room = new Room(roomRequest.exit->file.c_str(), physicsMan, 0, 0);
+			if (roomRequest.room->hasError() || !roomRequest.room->placeBeside(roomRequest.from, roomRequest.fromX, roomRequest.fromZ, *roomRequest.exit))
+			{
+				delete roomRequest.room;
+				continue;
+			}
+			// No point cooking a room clear() has already dropped
+			if (generation == requestGeneration)
+				roomRequest.room->prepareRoom();
+
+			EnterCriticalSection(&lock);
+			bool stale = generation != requestGeneration;
+			if (!stale)
+				cooked.push_back(roomRequest);
+			LeaveCriticalSection(&lock);
+
+			// None of a room that was never handed back is in the world, so it's safe to delete here
+			if (stale)
+				delete roomRequest.room;
+		}
+	}
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <Windows.h>
+#include <deque>
+#include <fstream>
+#include <set>
+#include "Room.h"
+
+/* RoomStreamer
+ *
+ * Loads the rooms around the player without holding up a frame. request() queues every
+ * room a loaded room's exits lead to, and a loader thread reads each one's level, places
+ * it beside the room it was reached from and cooks its static mesh. update() then makes
+ * the objects of the first cooked room on the game thread, a batch a frame, and hands the
+ * room back once all of them are in the world.
+ *
+ * Each room file is only requested once until forget() is called for it, say once it has
+ * been unloaded, or clear(), which also deletes every room that hasn't been handed back.
+ * clear() doesn't wait on a room the loader thread is in the middle of, the loader thread
+ * throws it away once it's done.
+ *
+ * With setBlocking() on, update() waits for every requested room to be cooked first, so
+ * rooms come in on the same frame every run, which recording and replaying input need.
+ *
+ * How long each room took from request() to coming back out of update() is kept, and with
+ * a report open every load and unload is written as csv along with what was resident.
+ */
+class RoomStreamer
+{
+	public:
+		RoomStreamer(PhysicsManager* pm);
+		~RoomStreamer(void);
+
+		void skip(const char* file);
+		void forget(const char* file);
+		void request(Room* from);
+		Room* update(int maxObjects);
+		void clear(void);
+		void setBlocking(bool block) { blocking = block; }
+
+		bool openReport(string fileName);
+		void report(const char* event, const char* file, int residentRooms, int residentObjects);
+
+		//Milliseconds from request() to update() handing back the last room it returned
+		double getLastLatency(void) { return lastLatency; }
+
+	private:
+		//A room to load, found through one of the exits of the room at fromX, fromZ
+		struct RoomRequest
+		{
+			const LevelDescription* from;
+			float fromX;
+			float fromZ;
+			const Wall* exit;
+			Room* room; //NULL until the loader thread has cooked it
+			LARGE_INTEGER requested;
+		};
+
+		static DWORD WINAPI loaderThreadProc(LPVOID param);
+		void runLoaderThread();
+
+		PhysicsManager* physicsMan;
+		set<string> knownFiles;      //Every room file requested or skipped since the last clear()
+		deque<RoomRequest> requests; //Waiting for the loader thread
+		deque<RoomRequest> cooked;   //Waiting for the game thread
+		RoomRequest loading;         //The room update() is making the objects of, room is NULL if none
+		bool blocking;
+
+		CRITICAL_SECTION lock;       //Guards requests and cooked
+		HANDLE loaderThread;
+		HANDLE requestReady;
+		HANDLE loaderIdle;           //Set while the loader thread has nothing to do
+		volatile bool stopThread;
+		volatile LONG generation;    //Counts clear() calls, rooms requested before the last one are thrown away
+
+		double msPerTick;
+		double lastLatency;
+		double totalLatency;
+		double worstLatency;
+		int roomsLoaded;
+		int roomsUnloaded;
+		ofstream out;
+};